@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <memory>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -8,13 +10,21 @@
 #include <OrbitalCamera.hpp>
 #include <Model.hpp>
 #include <Kelvinlet.hpp>
+#include <KelvinletBatch.hpp>
 #include <Ray.hpp>
+#include <ThreadPool.hpp>
+#include <ModelDeformer.hpp>
+#include <SceneBVH.hpp>
+#include <ModelLoader.hpp>
+#include <UniformBuffer.hpp>
 
 namespace Config {
     constexpr int WINDOW_WIDTH = 800;
     constexpr int WINDOW_HEIGHT = 800;
     const std::string SHADER_PATH = "shaders/";
     const std::string MODELS_PATH = "data/models/";
+    // GL upload time given to a loading model every frame
+    constexpr double UPLOAD_BUDGET_MS = 4.0;
 };
 
 class Application {
@@ -28,18 +38,52 @@ class Application {
         using GLFWwindowPtr = std::unique_ptr<GLFWwindow, void(*)(GLFWwindow*)>;        
         GLFWwindowPtr m_window = GLFWwindowPtr(nullptr, glfwDestroyWindow);
         bool m_wireframe = false;
+        bool m_cpuDeformation = false;
+        bool m_cpuPositionsUploaded = false;
+        int m_workerThreads = 0;
 
         // Objects
         std::unique_ptr<PointGrid> m_pointGrid;
         std::unique_ptr<Model> m_loadedModel;
         std::unique_ptr<OrbitalCamera> m_camera;
         std::unique_ptr<Kelvinlet> m_kelvinlet;
+        // Copies of m_kelvinlet applied together, rebuilt every frame by fillBrushBatch()
+        KelvinletBatch m_brushBatch;
+        glm::vec3 m_brushCenter = glm::vec3(0.0f);
+        // Copies rotated around the Y axis, each one mirrored across x = 0 if set
+        int m_radialCopies = 1;
+        bool m_mirrorX = false;
+        // Sculpting: left drags in picking mode move the rest pose. The grab brush
+        // follows the cursor on the view plane through the first hit, the others
+        // the surface under it. Strokes are followed in world space and sculpt the
+        // mesh of the scene instance they started on, in its local space.
+        bool m_sculptMode = false;
+        bool m_stroking = false;
+        size_t m_strokeInstance = 0;
+        glm::vec3 m_strokeAnchor = glm::vec3(0.0f);
+        glm::vec3 m_strokeLast = glm::vec3(0.0f);
+        glm::vec3 m_strokeTarget = glm::vec3(0.0f);
+        KelvinletBatch m_strokeFrom;
+        KelvinletBatch m_strokeTo;
+        // World-space copies before toInstanceSpace()
+        KelvinletBatch m_brushScratch;
+        // Rays of the brush copies, traced together by fillBrushBatch()
+        mutable RayBatch m_projectionRays;
+        std::chrono::steady_clock::time_point m_lastFrame = std::chrono::steady_clock::now();
         std::unique_ptr<Ray> m_ray;
+        std::unique_ptr<ThreadPool> m_threadPool;
+        std::unique_ptr<ModelDeformer> m_modelDeformer;
+        std::unique_ptr<SceneBVH> m_sceneBVH;
+        std::unique_ptr<ModelLoader> m_modelLoader;
+        char m_modelPath[256] = {};
 
         // Shaders
-        std::unique_ptr<Shader> m_baseShader;
-        std::unique_ptr<Shader> m_kelvinletsShader;
+        // Base program per ANALYTIC_NORMALS flag, BrushType and scale count, compiled on first use by brushShader()
+        std::array<std::unique_ptr<Shader>, 2 * BRUSH_TYPE_COUNT * MAX_BRUSH_SCALES> m_baseShaders;
         std::unique_ptr<Shader> m_lineShader;
+        std::unique_ptr<UniformBuffer<CameraUniforms>> m_cameraUniforms;
+        std::unique_ptr<UniformBuffer<KelvinletUniforms>> m_kelvinletUniforms;
+        std::unique_ptr<UniformBuffer<KelvinletInstanceUniforms>> m_kelvinletInstanceUniforms;
 
         // Matrices
         glm::mat4 m_viewMatrix;
@@ -56,13 +100,26 @@ class Application {
         glm::vec3 m_lastRayStart;
         glm::vec3 m_lastRayEnd;
         bool m_hasRayToDraw = false;
+        RayHit m_lastHit;
+        int m_lastHitEntry = -1;
+        double m_lastPickMs = 0.0;
         glm::vec3 screenPosToWorldRayDir(float mouseX, float mouseY);
-        bool rayIntersectsTriangle(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& outT);
         glm::vec3 getRaycastHitPosition(float mouseX, float mouseY, const glm::vec3& rayOrigin);
 
         // Rendering
+        // With project, every copy is moved to the surface along the matching copy of the camera ray
+        void fillBrushBatch(const glm::vec3& center, KelvinletBatch& batch, bool project = false) const;
+        // Maps centers, directions, radii and loads into the local space of instance
+        void toInstanceSpace(const KelvinletBatch& world, const BVHInstance& instance, KelvinletBatch& local) const;
+        void updateStroke(double mouseX, double mouseY);
+        bool sculptStroke(float dt);
         void sendKelvinletToShader();
+        Shader& brushShader();
+        void renderBrushUI();
         void renderUI();
+        void renderDeformationUI();
+        void renderModelUI();
+        void swapModel(std::unique_ptr<Model> model);
         void render();
         void cleanup();
         
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <PositionsSoA.hpp>
+#include <TrianglePacket.hpp>
+
+class ThreadPool;
+
+struct AABB {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    void grow(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void grow(const AABB& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool empty() const {
+        return min.x > max.x;
+    }
+
+    // 0 for points inside
+    float distanceSquared(const glm::vec3& p) const {
+        const glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+
+    bool overlaps(const AABB& other) const {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+               min.y <= other.max.y && max.y >= other.min.y &&
+               min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    static AABB infinite() {
+        AABB box;
+        box.min = glm::vec3(-std::numeric_limits<float>::max());
+        box.max = glm::vec3(std::numeric_limits<float>::max());
+        return box;
+    }
+
+    float surfaceArea() const {
+        if (empty()) return 0.0f;
+        glm::vec3 e = max - min;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+// 32 bytes, two nodes per cache line. Interior nodes store the index of their
+// right child in leftFirst, the left child always follows its parent.
+// Leaves store their first TrianglePacket in leftFirst and their triangle count.
+struct BVHNode {
+    glm::vec3 boundsMin;
+    uint32_t leftFirst;
+    glm::vec3 boundsMax;
+    uint32_t count;
+
+    bool isLeaf() const {
+        return count > 0;
+    }
+};
+
+// Slab test, returns the entry distance or +inf when the box is missed before tMax
+inline float intersectNode(const BVHNode& node, const glm::vec3& origin, const glm::vec3& invDirection, float tMax) {
+    glm::vec3 t0 = (node.boundsMin - origin) * invDirection;
+    glm::vec3 t1 = (node.boundsMax - origin) * invDirection;
+    glm::vec3 tSmall = glm::min(t0, t1);
+    glm::vec3 tBig = glm::max(t0, t1);
+    float tNear = glm::max(glm::max(tSmall.x, tSmall.y), glm::max(tSmall.z, 0.0f));
+    float tFar = glm::min(glm::min(tBig.x, tBig.y), glm::min(tBig.z, tMax));
+    return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+}
+
+// Rays traced together, hits[i] is both the result and the t limit of ray i
+struct RayBatch {
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+    std::vector<RayHit> hits;
+
+    void add(const glm::vec3& origin, const glm::vec3& direction) {
+        origins.push_back(origin);
+        directions.push_back(direction);
+        hits.emplace_back();
+    }
+
+    size_t size() const {
+        return origins.size();
+    }
+
+    void clear() {
+        origins.clear();
+        directions.clear();
+        hits.clear();
+    }
+};
+
+// Binned-SAH bounding volume hierarchy over the triangles of one mesh
+class BVH {
+    public:
+        static constexpr uint32_t MAX_LEAF_TRIANGLES = TrianglePacket::WIDTH;
+        static constexpr int SAH_BINS = 16;
+
+        BVH();
+        BVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+        void build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+        // Closest hit with t in (0, hit.t), hit.triangle is the index in the source index buffer / 3
+        bool intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const;
+
+        // Updates the leaves overlapping region from the new positions, then their
+        // ancestors level by level. region must hold the old and new position of
+        // every moved vertex. Returns the number of leaves refitted.
+        size_t refit(const PositionsSoA& positions, const AABB& region, ThreadPool& pool);
+        // SAH cost normalized by the root area, and its ratio to the one right after build
+        float getCost() const;
+        float getDegradation() const;
+
+        const AABB& getBounds() const;
+        size_t getNodeCount() const;
+        size_t getTriangleCount() const;
+
+    private:
+        struct BuildTriangle {
+            AABB bounds;
+            glm::vec3 centroid;
+        };
+
+        std::vector<BVHNode> m_nodes;
+        // Triangle order of the leaves during build, maps to the source triangle index
+        std::vector<uint32_t> m_triangleIds;
+        // Leaf triangles, each leaf starts on a new packet
+        std::vector<TrianglePacket> m_packets;
+        // Source vertex index of the 3 corners of every packet lane
+        std::vector<uint32_t> m_packetCorners;
+        size_t m_triangleCount = 0;
+        std::vector<uint32_t> m_leaves;
+        // Interior nodes grouped by depth, refit walks them deepest first
+        std::vector<std::vector<uint32_t>> m_levels;
+        std::vector<uint8_t> m_refitted;
+        AABB m_bounds;
+        float m_buildCost = 0.0f;
+        double m_cost = 0.0;
+
+        uint32_t buildRecursive(std::vector<BuildTriangle>& triangles, uint32_t first, uint32_t count, int depth);
+        bool findSplit(const std::vector<BuildTriangle>& triangles, uint32_t first, uint32_t count, const AABB& centroidBounds, int& axis, float& position, float& cost) const;
+        void collectLevels();
+        double nodeCost(const BVHNode& node) const;
+        double computeCost() const;
+        void buildPackets(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+        uint32_t packetCount(const BVHNode& leaf) const;
+};
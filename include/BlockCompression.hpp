@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Block-compressed formats, 4x4 texels per block
+enum class BlockFormat : uint32_t {
+    BC1,    // RGB, 8 bytes
+    BC3,    // RGBA, BC1 color + BC4 alpha, 16 bytes
+    BC4,    // R, 8 bytes
+    BC5     // RG, two BC4 blocks, 16 bytes. Normal maps, z is rebuilt from x and y
+};
+
+struct CompressedLevel {
+    size_t offset = 0;
+    size_t size = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Full mip chain of a block-compressed image, levels stored from largest to smallest
+struct CompressedImage {
+    BlockFormat format = BlockFormat::BC1;
+    std::vector<CompressedLevel> levels;
+    std::vector<uint8_t> data;
+
+    uint32_t width() const { return levels.empty() ? 0 : levels[0].width; }
+    uint32_t height() const { return levels.empty() ? 0 : levels[0].height; }
+};
+
+size_t blockBytes(BlockFormat format);
+size_t compressedLevelSize(BlockFormat format, uint32_t width, uint32_t height);
+
+// Format for an image with the given channel count, normal maps go to BC5
+BlockFormat chooseBlockFormat(int channels, bool normalMap);
+
+// Box-filters pixels down to 1x1 and compresses every level. Normal map levels
+// are renormalized after filtering.
+CompressedImage compressImage(const uint8_t* pixels, uint32_t width, uint32_t height, int channels, BlockFormat format, bool normalMap);
+
+// Single 4x4 blocks, rgba is 16 texels of 4 bytes in row order
+void encodeBC1Block(const uint8_t* rgba, uint8_t* out);
+void encodeBC4Block(const uint8_t* rgba, int channel, uint8_t* out);
+void encodeBC3Block(const uint8_t* rgba, uint8_t* out);
+void encodeBC5Block(const uint8_t* rgba, uint8_t* out);
@@ -2,11 +2,33 @@
 
 #include <glm/glm.hpp>
 
+// Regularized Kelvinlet brushes of de Goes and James. Grab applies a force,
+// the others an affine load: a rotation (twist), a uniform scaling (scale) or
+// a traceless symmetric squeeze along an axis (pinch).
+enum class BrushType {
+    Grab,
+    Twist,
+    Scale,
+    Pinch
+};
+
+constexpr int BRUSH_TYPE_COUNT = 4;
+constexpr int MAX_BRUSH_SCALES = 3;
+
 struct Brush {
+    BrushType type = BrushType::Grab;
     float epsilon = 0.1f;
     float f = 2500.0f;
     float nu = 0.5f;
     float mu = 45.0f;
+    // Force direction of the grab brush, rotation axis of the twist and squeeze
+    // axis of the pinch. Scaled by f, unused by the scale brush.
+    glm::vec3 direction = glm::vec3(1.0f);
+    // 2 or 3 for the bi/tri-scale extrapolation over epsilon, epsilon2 and
+    // epsilon3, which falls off much faster than a single scale
+    int scales = 1;
+    float epsilon2 = 0.2f;
+    float epsilon3 = 0.4f;
 };
 
 class Kelvinlet {
@@ -14,10 +36,39 @@ class Kelvinlet {
         Brush m_brush;
         double m_a;
         double m_b;
+        // u = sum of m_scaleWeights[s] * u with epsilon m_scaleEpsilons[s], over scaleCount() scales
+        glm::vec3 m_scaleEpsilons;
+        glm::vec3 m_scaleWeights;
 
         Kelvinlet();
         Kelvinlet(Brush brush);
         ~Kelvinlet();
 
         void computeConstants();
-};
\ No newline at end of file
+        int scaleCount() const;
+
+        // Force vector applied by the grab brush, f * direction
+        glm::vec3 force() const;
+        // Load matrix F of the affine brushes, u depends on it through F r:
+        // the cross product matrix of f * direction (twist), f I (scale) or
+        // f (d d^T - I/3) with d the normalized direction (pinch)
+        glm::mat3 affineLoad() const;
+        // Scalar reference of the regularized Kelvinlet, r = x - x0
+        glm::vec3 displacement(const glm::vec3& r) const;
+        // Scalar reference of its Jacobian du/dr, column k holds du/dr_k
+        glm::mat3 gradient(const glm::vec3& r) const;
+        // Upper bound of |u| over all r, reached at the brush center
+        float maxDisplacement() const;
+        // Distance from x0 beyond which |u| stays below tolerance
+        float influenceRadius(float tolerance) const;
+        // Magnitude f for which the grab brush moves its center by distance
+        float grabForce(float distance) const;
+
+        static const char* typeName(BrushType type);
+
+    private:
+        // |u| <= c / r_eps for the grab brush and c / r_eps^2 for the affine ones, for a single scale
+        float boundNumerator() const;
+        glm::vec3 singleScaleDisplacement(const glm::vec3& r, float epsilon) const;
+        glm::mat3 singleScaleGradient(const glm::vec3& r, float epsilon) const;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <Kelvinlet.hpp>
+
+// One applied copy of a brush
+struct BrushInstance {
+    glm::vec3 x0;
+    glm::vec3 direction;
+    float f;
+};
+
+// Per instance values read by the kernels, one stream per component. The
+// load depends on the brush type: grab force f d (xyz), twist axis -a f d
+// (xyz), (2b - a) f for the scale brush (w), unit axis d and f for the pinch.
+struct BrushStreams {
+    std::vector<float> x0;
+    std::vector<float> y0;
+    std::vector<float> z0;
+    std::vector<float> lx;
+    std::vector<float> ly;
+    std::vector<float> lz;
+    std::vector<float> lw;
+};
+
+// Many instances of one brush whose displacements add up, like the samples
+// of a stroke or symmetric copies. Type, epsilons and material come from the
+// shape, every instance has its own center, direction and magnitude.
+class KelvinletBatch {
+    public:
+        KelvinletBatch();
+        explicit KelvinletBatch(const Kelvinlet& shape);
+
+        // Recomputes the loads of the instances already added
+        void setShape(const Kelvinlet& shape);
+        void clear();
+        // With the direction and magnitude of the shape
+        void add(const glm::vec3& x0);
+        void add(const glm::vec3& x0, const glm::vec3& direction, float f);
+
+        size_t size() const;
+        bool empty() const;
+        const Kelvinlet& getShape() const;
+        const BrushInstance& getInstance(size_t i) const;
+        // The single brush applied by instance i, for its bounds
+        Kelvinlet getKelvinlet(size_t i) const;
+        glm::vec4 getLoad(size_t i) const;
+        const BrushStreams& getStreams() const;
+        // Scalar reference, sum of the displacements of every instance at p
+        glm::vec3 displacement(const glm::vec3& p) const;
+        // and of its Jacobian
+        glm::mat3 gradient(const glm::vec3& p) const;
+
+    private:
+        Kelvinlet m_shape;
+        std::vector<BrushInstance> m_instances;
+        BrushStreams m_streams;
+
+        glm::vec4 computeLoad(const BrushInstance& instance) const;
+        void pushLoad(const BrushInstance& instance);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include <Kelvinlet.hpp>
+#include <KelvinletBatch.hpp>
+#include <Mesh.hpp>
+#include <PositionsSoA.hpp>
+
+// CPU evaluation of the regularized Kelvinlet over every vertex of a Mesh.
+// Rest and deformed positions are kept as SoA streams and processed by an
+// explicitly vectorized kernel (AVX2 when compiled with it, SSE2 otherwise),
+// instantiated once per BrushType and scale count. Several brushes are
+// applied in one pass: each block of vertices stays in registers while the
+// instances of a KelvinletBatch are streamed over it.
+class KelvinletDeformer {
+    public:
+        KelvinletDeformer();
+        KelvinletDeformer(const Mesh& mesh);
+        KelvinletDeformer(const std::vector<Vertex>& vertices);
+
+        void setRestPose(const std::vector<Vertex>& vertices);
+        void setRestPose(const std::vector<glm::vec3>& positions);
+        void resetToRestPose();
+        // Moves rest vertex indices[n] to positions[n], for n < count, and its deformed
+        // position along. The change is accumulated in the displacement buffer.
+        void sculptIndices(const uint32_t* indices, size_t count, const PositionsSoA& positions);
+        // Back to the rest pose given to setRestPose()
+        void clearSculpt();
+        // Copies the rest positions of [begin, end) back into the deformed ones
+        void resetRange(size_t begin, size_t end);
+        void resetIndices(const uint32_t* indices, size_t count);
+
+        // deformed = rest + u(rest - x0) for every vertex
+        void apply(const Kelvinlet& kelvinlet, const glm::vec3& x0);
+        // Same as apply() but restricted to vertices [begin, end)
+        void applyRange(const Kelvinlet& kelvinlet, const glm::vec3& x0, size_t begin, size_t end);
+        // Same as apply() but restricted to the listed vertices, which must be distinct
+        void applyIndices(const Kelvinlet& kelvinlet, const glm::vec3& x0, const uint32_t* indices, size_t count);
+        // deformed = rest + sum of u over the instances of batch listed in active
+        void applyRange(const KelvinletBatch& batch, const uint32_t* active, size_t activeCount, size_t begin, size_t end);
+        void applyIndices(const KelvinletBatch& batch, const uint32_t* active, size_t activeCount, const uint32_t* indices, size_t count);
+        // out = positions + sum of u over the active instances, for [begin, end)
+        // With rest frames set, the batch overloads above also carry normal, tangent and
+        // bitangent through the brush Jacobian J = I + du/dr: the normal by cof(J), the
+        // inverse transpose up to scale, tangent and bitangent by J, all renormalized.
+        // Sculpting does not update the rest frames.
+        void setRestFrames(const FramesSoA& frames);
+        void clearFrames();
+        bool hasFrames() const;
+        static void evaluate(const KelvinletBatch& batch, const uint32_t* active, size_t activeCount, const PositionsSoA& positions, PositionsSoA& out, size_t begin, size_t end);
+
+        size_t size() const;
+        const PositionsSoA& getRestPositions() const;
+        const PositionsSoA& getDeformedPositions() const;
+        // Sum of the sculpted displacements, rest minus the initial rest pose
+        const PositionsSoA& getDisplacement() const;
+        const FramesSoA& getRestFrames() const;
+        const FramesSoA& getDeformedFrames() const;
+        glm::vec3 getDeformedPosition(size_t i) const;
+        void copyDeformedPositions(std::vector<glm::vec3>& out) const;
+
+        static const char* kernelName();
+
+    private:
+        PositionsSoA m_rest;
+        PositionsSoA m_deformed;
+        PositionsSoA m_displacement;
+        FramesSoA m_restFrames;
+        FramesSoA m_deformedFrames;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <BlockCompression.hpp>
+
+// KTX2 file header, identifier and index included
+struct Ktx2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// Block-compressed mip chains of source images, written next to them as
+// <image>.ktx2. A key/value entry records the source content hash and the
+// encoder version so a changed image or encoder re-encodes it.
+class Ktx2Cache {
+    public:
+        // Bump when the encoder output changes
+        static constexpr uint32_t VERSION = 1;
+
+        static std::string cachePath(const std::string& sourcePath);
+        // False if missing, stale, or not in the expected format
+        static bool read(const std::string& path, uint64_t sourceHash, BlockFormat format, CompressedImage& image);
+        static bool write(const std::string& path, uint64_t sourceHash, const CompressedImage& image);
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+    public:
+        MappedFile();
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        bool open(const std::string& path);
+        void close();
+
+        bool isOpen() const;
+        const uint8_t* data() const;
+        size_t size() const;
+
+    private:
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+#if _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
+};
@@ -2,10 +2,22 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <future>
 #include <memory>
 #include <vector>
 #include <Shader.hpp>
 #include <Material.hpp>
+#include <BVH.hpp>
+#include <ThreadPool.hpp>
+#include <VertexAdjacency.hpp>
+#include <VertexQuantization.hpp>
+
+// Background rebuild of a degraded BVH on its own thread, swapped in once ready.
+// It stays off the ThreadPool, whose helping waits would pick it up mid-frame.
+// Destroying the Mesh mid-rebuild waits for it, like any std::async future.
+struct BVHRebuild {
+    std::future<std::shared_ptr<BVH>> result;
+};
 
 struct Vertex {
     glm::vec3 position;
@@ -15,23 +27,71 @@ struct Vertex {
     glm::vec2 uv;
 };
 
+// Contents of one GL buffer, allocated by a deferred setup_mesh() and sent
+// later by Mesh::upload_buffer_range()
+struct BufferUpload {
+    GLuint buffer;
+    const void* data;
+    size_t size;
+};
+
+// Half-open range [begin, end) of vertex indices
+struct VertexRange {
+    size_t begin;
+    size_t end;
+};
+
+// Interleaved keeps one Vertex array in a single VBO. Separate keeps every
+// attribute in its own stream and VBO, so position-only passes and uploads
+// only touch the 12 bytes of the position. Quantized keeps the float position
+// stream and packs the other attributes in 12 bytes (24 B/vertex instead of 56).
+enum class VertexLayout {
+    Interleaved,
+    Separate,
+    Quantized
+};
+
 class Mesh {
     public:
         // Public attributes
+        VertexLayout layout = VertexLayout::Interleaved;
         std::vector<Vertex> vertices;
+        // Attribute streams of the Separate layout
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec3> tangents;
+        std::vector<glm::vec3> bitangents;
+        std::vector<glm::vec2> uvs;
+        // Attributes of the Quantized layout, which drops the float streams above
+        std::vector<PackedAttributes> packed_attributes;
+        QuantizationError quantization_error;
         std::vector<unsigned int> indices;
         std::shared_ptr<Material> material = nullptr;
         std::shared_ptr<Shader> shader;
+        std::shared_ptr<BVH> bvh;
+        // Built on first use by build_adjacency(), for topology-based normals
+        std::shared_ptr<VertexAdjacency> adjacency;
+        // Flat packets of every triangle, only used when there is no BVH
+        std::vector<TrianglePacket> triangle_packets;
         
         // Constructors
         Mesh() {}
         Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::shared_ptr<Material> material) : vertices(std::move(vertices)), indices(std::move(indices)), material(material) {
             setup_mesh();
         }
+        // Without upload, no GL call is made and setup_mesh() must be called later on the GL thread
+        Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::shared_ptr<Material> material, VertexLayout layout, bool upload = true) : layout(layout), vertices(std::move(vertices)), indices(std::move(indices)), material(material) {
+            if (layout != VertexLayout::Interleaved) split_streams();
+            if (layout == VertexLayout::Quantized) pack_streams();
+            if (upload) setup_mesh();
+        }
 
         // Destructor
         ~Mesh() {
+            if (vao == 0) return;
             glDeleteBuffers(1, &vbo);
+            glDeleteBuffers(1, &ebo);
+            glDeleteBuffers(ATTRIBUTE_STREAMS, attribute_vbos);
             glDeleteVertexArrays(1, &vao);
         }
 
@@ -39,13 +99,62 @@ class Mesh {
         void bind_shader(const GLchar* vertex_path, const GLchar* fragment_path);
         void unbind_shader();
         void draw();
-        void setup_mesh();
+        // With deferred, buffers are only allocated and their contents are appended to it,
+        // so that large meshes can be uploaded in pieces over several frames
+        void setup_mesh(std::vector<BufferUpload>* deferred = nullptr);
+        bool is_uploaded() const;
         void bindVAO();
         void drawElements();
         void add_texture(std::shared_ptr<Texture> texture);
         glm::vec3 getVerticeFromIndice(unsigned int indice);
+        size_t vertex_count() const;
+        std::vector<glm::vec3> get_positions() const;
+        size_t vertex_size() const;
+        // Replaces the positions and re-uploads them (only them outside the Interleaved layout),
+        // returns the bytes sent
+        size_t set_positions(const PositionsSoA& new_positions);
+        // Same, restricted to the given ranges
+        size_t set_positions(const PositionsSoA& new_positions, const std::vector<VertexRange>& ranges);
+        std::vector<glm::vec2> get_uvs() const;
+        // Normal, tangent and bitangent of every vertex, decoded in the Quantized layout
+        FramesSoA get_frames() const;
+        // Replaces the frames of the given ranges and re-uploads them, returns the bytes
+        // sent. Interleaved vertices are only marked dirty, the next update_positions() sends them.
+        size_t set_frames(const FramesSoA& frames, const std::vector<VertexRange>& ranges);
+        void mark_positions_dirty(VertexRange range);
+        // Streams the dirty ranges to the vertex buffer, returns the bytes sent
+        size_t update_positions();
+        // Sends size bytes of the upload from offset with glBufferSubData, leaves the VAO untouched
+        static void upload_buffer_range(const BufferUpload& upload, size_t offset, size_t size);
+        void build_bvh();
+        void build_adjacency();
+        // Refits the BVH to deformed positions on the pool, and starts a full rebuild
+        // on a separate thread once refitting has degraded it past BVH_REBUILD_THRESHOLD.
+        // Without a BVH, the triangle packets are rebuilt instead.
+        void refit_bvh(const PositionsSoA& positions, const AABB& region, ThreadPool& pool);
+
+        static constexpr float BVH_REBUILD_THRESHOLD = 1.5f;
+        // Triangle packets per task when they are rebuilt without a BVH
+        static constexpr size_t PACKET_REFIT_GRAIN = 256;
+        // Dirty ranges closer than this many vertices are sent in one glBufferSubData
+        static constexpr size_t DIRTY_MERGE_GAP = 64;
     
     private:
+        // Normal, tangent, bitangent and uv buffers of the Separate layout,
+        // the Quantized layout only uses the first one
+        static constexpr int ATTRIBUTE_STREAMS = 4;
+
         // Private attributes
-        GLuint vao,vbo,ebo;
+        GLuint vao = 0, vbo = 0, ebo = 0;
+        GLuint attribute_vbos[ATTRIBUTE_STREAMS] = {0, 0, 0, 0};
+        std::shared_ptr<BVHRebuild> bvh_rebuild;
+        std::vector<VertexRange> dirty_ranges;
+
+        // Sorts ranges and joins those closer than DIRTY_MERGE_GAP
+        static std::vector<VertexRange> merge_ranges(std::vector<VertexRange> ranges);
+        void split_streams();
+        void pack_streams();
+        void setup_interleaved(std::vector<BufferUpload>* deferred);
+        void setup_separate(std::vector<BufferUpload>* deferred);
+        void setup_quantized(std::vector<BufferUpload>* deferred);
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <MappedFile.hpp>
+#include <Mesh.hpp>
+
+// .kmesh layout: header, entry, mesh, material and texture tables, string
+// bytes, then the vertex and index streams. Every section is 16-byte aligned
+// and read in place from the mapping.
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t importFlags;
+    uint32_t vertexSize;
+    uint32_t entryCount;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t textureCount;
+    uint64_t entriesOffset;
+    uint64_t meshesOffset;
+    uint64_t materialsOffset;
+    uint64_t texturesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t verticesOffset;
+    uint64_t vertexCount;
+    uint64_t indicesOffset;
+    uint64_t indexCount;
+    uint64_t reserved;
+};
+
+struct MeshCacheEntry {
+    float transform[16];
+    uint32_t mesh;
+    uint32_t padding[3];
+};
+
+struct MeshCacheMesh {
+    uint64_t firstVertex;
+    uint64_t firstIndex;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t material;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t padding[3];
+};
+
+struct MeshCacheMaterial {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float emissive[3];
+    float shininess;
+    uint32_t firstTexture;
+    uint32_t textureCount;
+};
+
+struct MeshCacheTexture {
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    uint32_t typeOffset;
+    uint32_t typeLength;
+};
+
+// Read side: maps a .kmesh file and checks it matches the source and import flags
+class MeshCache {
+    public:
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t NO_MATERIAL = 0xffffffffu;
+
+        // Cache file stored next to the source
+        static std::string cachePath(const std::string& sourcePath);
+        // FNV-1a of the file content and, for a .gltf, of the external buffers it
+        // references. 0 when one of them cannot be read.
+        static uint64_t hashSource(const std::string& path);
+
+        bool open(const std::string& path, uint64_t sourceHash, uint32_t importFlags);
+        void close();
+
+        const MeshCacheHeader& getHeader() const;
+        const MeshCacheEntry& getEntry(size_t index) const;
+        const MeshCacheMesh& getMesh(size_t index) const;
+        const MeshCacheMaterial& getMaterial(size_t index) const;
+        const MeshCacheTexture& getTexture(size_t index) const;
+        std::string getString(uint32_t offset, uint32_t length) const;
+        const Vertex* getVertices(const MeshCacheMesh& mesh) const;
+        const unsigned int* getIndices(const MeshCacheMesh& mesh) const;
+
+    private:
+        MappedFile m_file;
+        const MeshCacheHeader* m_header = nullptr;
+
+        template <typename T>
+        const T* section(uint64_t offset) const {
+            return reinterpret_cast<const T*>(m_file.data() + offset);
+        }
+        bool validate(uint64_t sourceHash, uint32_t importFlags) const;
+};
+
+// Write side: collects the processed meshes while a model is imported
+class MeshCacheWriter {
+    public:
+        uint32_t addMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const Material* material);
+        void addEntry(uint32_t mesh, const glm::mat4& transform);
+        // Writes to a temporary file then renames it, so readers never see a partial cache
+        bool write(const std::string& path, uint64_t sourceHash, uint32_t importFlags) const;
+
+    private:
+        std::vector<MeshCacheEntry> m_entries;
+        std::vector<MeshCacheMesh> m_meshes;
+        std::vector<MeshCacheMaterial> m_materials;
+        std::vector<MeshCacheTexture> m_textures;
+        std::string m_strings;
+        std::vector<Vertex> m_vertices;
+        std::vector<unsigned int> m_indices;
+
+        uint32_t addString(const std::string& value);
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Post-transform cache efficiency of an index buffer, simulated with a FIFO cache.
+// ACMR is the number of vertex shader runs per triangle (0.5 at best, 3 at worst),
+// ATVR the number of runs per referenced vertex (1 at best).
+struct VertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Reorders triangles for post-transform cache locality (Forsyth, linear-speed vertex cache optimisation)
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+// Reorders the clusters of a cache-optimized index buffer so that outward facing
+// ones are drawn first, as long as the ACMR stays within threshold times the original
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, float threshold = 1.05f);
+
+// Renumbers vertices in order of first use and rewrites indices, returns
+// remap[old] = new (unreferenced vertices are moved to the end)
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount);
+
+// Applies a remap from optimizeVertexFetch to a vertex array
+template <typename T>
+void remapVertices(std::vector<T>& vertices, const std::vector<unsigned int>& remap) {
+    std::vector<T> remapped(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        remapped[remap[i]] = vertices[i];
+    }
+    vertices.swap(remapped);
+}
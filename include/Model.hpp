@@ -1,3 +1,5 @@
+#pragma once
+
 #include <assimp/matrix4x4.h>
 #include <assimp/material.h>
 #include <assimp/mesh.h>
@@ -5,11 +7,32 @@
 #include <assimp/Importer.hpp>
 
 #include <Mesh.hpp>
+#include <MeshCache.hpp>
+#include <MeshOptimization.hpp>
 #include <memory>
+#include <string>
+#include <vector>
 
 struct MeshEntry {
     std::shared_ptr<Mesh> mesh;
     glm::mat4 transform;
+    // Local space bounds of the mesh
+    AABB bounds;
+};
+
+// Post-transform cache efficiency of one mesh, before and after its optimization at import
+struct MeshImportStats {
+    std::string name;
+    VertexCacheStats before;
+    VertexCacheStats after;
+};
+
+// Import statistics, shown in the Model panel
+struct ModelStats {
+    // Worst error of the packed attributes over every mesh, Quantized layout only
+    QuantizationError quantization;
+    // Meshes optimized by this import, empty when they came from the cache
+    std::vector<MeshImportStats> meshes;
 };
 
 class Model {
@@ -17,11 +40,21 @@ class Model {
         // Public attributes
         std::vector<MeshEntry> entries;
         std::string directory;
-        static std::vector<std::shared_ptr<Texture>> textures_loaded;
+        VertexLayout layout = VertexLayout::Interleaved;
+        ModelStats stats;
+        // Assimp post-processing steps, part of the .kmesh cache key
+        static const unsigned int IMPORT_FLAGS;
+        // Reads and writes a .kmesh cache next to the source file
+        bool use_cache = true;
+        // Builds meshes and decodes textures without any GL call, for loading
+        // off the GL thread. Mesh::setup_mesh() and Texture::upload() are left to the caller.
+        bool defer_upload = false;
         
         // Constructors
         Model();
         Model(const std::string& path);
+        Model(const std::string& path, VertexLayout layout);
+        Model(const std::string& path, VertexLayout layout, bool defer_upload);
         Model(std::shared_ptr<Mesh> mesh);
 
         // Factory
@@ -52,6 +85,8 @@ class Model {
         
         // Public methods
         void draw();
+        // Draws every entry with its node transform bound to u_modelMatrix
+        void draw(Shader& shader);
         void bind_shader_to_meshes(std::shared_ptr<Shader> shader);
         void bind_shader_to_meshes(const GLchar* vertex_path, const GLchar* fragment_path);
         void bind_texture_to_meshes(std::shared_ptr<Texture> texture);
@@ -59,9 +94,13 @@ class Model {
     
     private:
         // Private methods
+        MeshCacheWriter* cache_writer = nullptr;
+
         void load_model(const std::string& path);
+        void load_from_cache(const MeshCache& cache);
         void process_node(aiNode *node, const aiScene *scene, glm::mat4 parent_transform);
         std::shared_ptr<Mesh> process_mesh(aiMesh *mesh, const aiScene *scene);
         std::shared_ptr<Material> load_material_textures(aiMaterial *material);
         void load_textures_from_material(aiMaterial *material, aiTextureType tex_type, std::string tex_type_name, std::shared_ptr<Material> mat);
+        void load_texture(const std::string& texture_path, const std::string& tex_type_name, std::shared_ptr<Material> mat);
 };
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <KelvinletDeformer.hpp>
+#include <Model.hpp>
+#include <SpatialGrid.hpp>
+#include <ThreadPool.hpp>
+
+// Time integration of the brush flow while sculpting, see ModelDeformer::sculpt()
+enum class Integrator {
+    Euler,
+    RK4
+};
+
+// How uploadPositions() keeps normals, tangents and bitangents up to date:
+// not at all (the rest frames), through the brush Jacobian evaluated along the
+// displacement, or recomputed from the deformed triangles around every moved vertex
+enum class NormalUpdate {
+    Rest,
+    Analytic,
+    Topology
+};
+
+struct DeformStats {
+    double wallMs = 0.0;
+    // Vertices evaluated by the kernel, out of totalVertices
+    size_t vertices = 0;
+    size_t totalVertices = 0;
+    size_t chunks = 0;
+    // Meshes evaluated through their grid rather than streamed in full
+    size_t gridTargets = 0;
+    // Brush instances applied and instance-vertex pairs left after culling them per chunk
+    size_t brushes = 0;
+    size_t brushEvaluations = 0;
+    // Last sculpt()
+    double sculptMs = 0.0;
+    size_t sculptedVertices = 0;
+    int substeps = 0;
+    // Last uploadPositions()
+    size_t uploadedVertices = 0;
+    size_t uploadedBytes = 0;
+    // Frames recomputed from the triangles in NormalUpdate::Topology
+    size_t recomputedFrames = 0;
+    double framesMs = 0.0;
+};
+
+// One KelvinletDeformer per distinct Mesh of a Model. Meshes beyond the
+// influence radius are not evaluated. For the others a spatial grid over the
+// rest pose finds the vertices within reach, evaluated by an indexed kernel
+// and the only ones written back to the vertex buffers, along with those the
+// previous sample moved. Brushes reaching a large part of a mesh stream it in
+// cache-sized chunks instead. A batch of brushes is culled per instance, then
+// every chunk evaluates only the instances reaching its bounds. Each skipped
+// instance errs by less than the tolerance, n instances by less than n times it.
+//
+// Sculpting moves the rest pose itself: the vertices are advected by the
+// brush displacement field along a drag, and what they moved by is kept in
+// the displacement buffer of their KelvinletDeformer.
+class ModelDeformer {
+    public:
+        // 8192 vertices * (12 B rest + 12 B deformed) = 192 KiB, fits in L2
+        static constexpr size_t CHUNK_VERTICES = 8192;
+        // Indexed vertices per task, gathers cost more than streaming
+        static constexpr size_t CHUNK_INDICES = 2048;
+        // Above this fraction of a mesh, streaming all of it beats the indexed kernel
+        static constexpr float DENSE_FRACTION = 0.25f;
+        // Sculpting substeps move brush centers, and the vertices under them, by
+        // at most this fraction of the smallest epsilon
+        static constexpr float MAX_SCULPT_STEP = 0.25f;
+        // setModel() sets the tolerance to this fraction of the largest mesh diagonal,
+        // under a pixel when the mesh fills a 1000 pixel view
+        static constexpr float TOLERANCE_FRACTION = 1e-3f;
+
+        ModelDeformer();
+        ModelDeformer(const Model& model);
+
+        void setModel(const Model& model);
+        void apply(const Kelvinlet& kelvinlet, const glm::vec3& x0, ThreadPool& pool);
+        // deformed = rest + the sum of the displacements of every instance of batch
+        void apply(const KelvinletBatch& batch, ThreadPool& pool);
+        // Integrates the rest pose over a drag of dt seconds during which instance i
+        // moves from from.getInstance(i) to to.getInstance(i). A grab brush carries
+        // its center along, the others apply their load per second. Only vertices
+        // within reach of the swept instances are updated. Only the target of mesh is
+        // sculpted, and from and to are in its local space.
+        void sculpt(const KelvinletBatch& from, const KelvinletBatch& to, float dt, const std::shared_ptr<Mesh>& mesh, ThreadPool& pool);
+        // Drops every sculpted displacement
+        void clearSculpt();
+        void setIntegrator(Integrator integrator);
+        Integrator getIntegrator() const;
+        // Fast drags are split in up to this many substeps
+        void setMaxSubsteps(int substeps);
+        int getMaxSubsteps() const;
+        // Refits the mesh BVHs over the region moved by the last two apply() calls
+        void refitHierarchies(ThreadPool& pool);
+        // Writes the deformed positions moved by the last two apply() calls, and
+        // those sculpted since the last upload, back to the meshes and their vertex
+        // buffers. Frames are updated along as set by setNormalUpdate(), in
+        // Topology for the moved vertices and their one-ring.
+        void uploadPositions(ThreadPool& pool);
+        // Analytic carries the frames through the Jacobian in the same pass as the
+        // positions. Topology recomputes them from scratch the first time, then only
+        // where vertices moved, which gives the same frames. Rest restores the rest
+        // frames of the meshes.
+        void setNormalUpdate(NormalUpdate mode);
+        NormalUpdate getNormalUpdate() const;
+        // Displacements below tolerance are ignored, which bounds the evaluated region.
+        // Reset by setModel() from the size of the model.
+        void setTolerance(float tolerance);
+        float getTolerance() const;
+        void resetToRestPose();
+
+        size_t getTargetCount() const;
+        std::shared_ptr<Mesh> getMesh(size_t target) const;
+        KelvinletDeformer& getDeformer(size_t target);
+        KelvinletDeformer* findDeformer(const Mesh* mesh);
+        const SpatialGrid& getGrid(size_t target) const;
+        // Vertex ranges written by the last uploadPositions(), for local attribute updates
+        const std::vector<VertexRange>& getDirtyRanges(size_t target) const;
+        const DeformStats& getLastStats() const;
+
+    private:
+        struct Target {
+            std::shared_ptr<Mesh> mesh;
+            KelvinletDeformer deformer;
+            AABB bounds;
+            // Over the rest pose, built the first time the brush reaches the mesh
+            SpatialGrid grid;
+            // Vertices moved by the last apply() and by the one before, sorted.
+            // The whole mesh when the matching flag is set.
+            std::vector<uint32_t> displaced;
+            std::vector<uint32_t> previous;
+            bool allDisplaced = false;
+            bool allPrevious = false;
+            std::vector<VertexRange> dirty;
+            // Rest pose bounds of every CHUNK_VERTICES vertices
+            std::vector<AABB> chunkBounds;
+            // Vertices sculpted since the last upload, sorted, or all of them
+            std::vector<uint32_t> sculpted;
+            bool allSculpted = false;
+            // Vertices reached by the current sculpt() call
+            std::vector<uint32_t> sculpting;
+            // NormalUpdate::Topology: frames of the mesh before it, current frames
+            // (empty until the next upload), uvs and the vertices to recompute
+            FramesSoA restFrames;
+            FramesSoA frames;
+            std::vector<glm::vec2> uvs;
+            std::vector<uint32_t> ring;
+        };
+        // Vertices [begin, end) of a mesh, or entries [begin, end) of an index list
+        struct Task {
+            size_t target;
+            const uint32_t* indices;
+            size_t begin;
+            size_t end;
+        };
+
+        std::vector<Target> m_targets;
+        std::vector<Task> m_resets;
+        std::vector<Task> m_evaluations;
+        std::vector<Task> m_sculpts;
+        // Per brush instance: center and squared influence radius
+        std::vector<glm::vec4> m_reach;
+        DeformStats m_lastStats;
+        // Displacements below this are considered as not moving the vertex
+        float m_tolerance = 1e-4f;
+        AABB m_lastRegion;
+        AABB m_dirtyRegion;
+        // Moved by sculpt() since the last refitHierarchies()
+        AABB m_sculptRegion;
+        Integrator m_integrator = Integrator::RK4;
+        int m_maxSubsteps = 64;
+        NormalUpdate m_normalUpdate = NormalUpdate::Rest;
+
+        void selectVertices(Target& target, ThreadPool& pool);
+        // Instances of m_reach whose influence overlaps bounds
+        void cullInstances(const AABB& bounds, std::vector<uint32_t>& active) const;
+        void addTasks(std::vector<Task>& tasks, size_t target, const uint32_t* indices, size_t count, size_t chunk);
+        static std::vector<VertexRange> dirtyRanges(const Target& target);
+        // Topology frames of the dirty vertices, returns the ranges to upload
+        std::vector<VertexRange> updateTopologyFrames(Target& target, ThreadPool& pool);
+        void restoreFrames(Target& target);
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Model.hpp>
+#include <ThreadPool.hpp>
+#include <TextureUploader.hpp>
+
+enum class LoadState {
+    Idle,
+    Importing,
+    Uploading
+};
+
+// Loads models in two stages: import and vertex processing on a loader thread,
+// with images decoded in parallel on the application's pool, then GL uploads on
+// the main thread, a few per frame. The pool must not be resized while importing.
+class ModelLoader {
+    public:
+        // Texture bytes streamed per update()
+        static constexpr size_t TEXTURE_BYTES_PER_UPDATE = 16 * 1024 * 1024;
+        // Vertex and index bytes per glBufferSubData, large meshes take several of them
+        static constexpr size_t MESH_UPLOAD_CHUNK = 4 * 1024 * 1024;
+
+        ModelLoader(ThreadPool& pool);
+        ~ModelLoader();
+        ModelLoader(const ModelLoader&) = delete;
+        ModelLoader& operator=(const ModelLoader&) = delete;
+
+        // Starts loading path, a model still in flight is dropped
+        void load(const std::string& path, VertexLayout layout);
+        // Main thread, once per frame: uploads pending meshes and textures for about
+        // budgetMs and returns the model once everything is on the GPU
+        std::unique_ptr<Model> update(double budgetMs);
+
+        LoadState getState() const;
+        const std::string& getPath() const;
+        size_t getUploadedCount() const;
+        size_t getUploadCount() const;
+        double getImportMs() const;
+
+    private:
+        struct Request {
+            std::string path;
+            VertexLayout layout;
+            uint64_t generation;
+        };
+
+        ThreadPool& m_pool;
+        TextureUploader m_textureUploader;
+        std::thread m_thread;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        bool m_stopping = false;
+        bool m_hasRequest = false;
+        Request m_request;
+        // Result of the loader thread, dropped if its generation is not the latest
+        std::unique_ptr<Model> m_imported;
+        uint64_t m_importedGeneration = 0;
+        double m_importMs = 0.0;
+
+        // Main thread state
+        uint64_t m_generation = 0;
+        bool m_busy = false;
+        std::string m_path;
+        std::unique_ptr<Model> m_uploading;
+        // Steps of the uploads, each returns true once its object is on the GPU
+        std::vector<std::function<bool()>> m_uploads;
+        size_t m_nextUpload = 0;
+        size_t m_textureCount = 0;
+
+        void loaderLoop();
+        void collectUploads(const Model& model);
+        static std::function<bool()> meshUpload(std::shared_ptr<Mesh> mesh);
+        static std::vector<std::shared_ptr<Texture>> collectTextures(const Model& model);
+};
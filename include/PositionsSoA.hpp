@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Vertex positions stored as three separate float streams so that SIMD kernels
+// can load 4/8 consecutive x (resp. y, z) coordinates with a single instruction.
+struct PositionsSoA {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+
+    void clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+    }
+
+    glm::vec3 get(size_t i) const {
+        return glm::vec3(x[i], y[i], z[i]);
+    }
+
+    void set(size_t i, const glm::vec3& p) {
+        x[i] = p.x;
+        y[i] = p.y;
+        z[i] = p.z;
+    }
+};
+
+// Normal, tangent and bitangent of every vertex, each one as SoA streams
+struct FramesSoA {
+    PositionsSoA normal;
+    PositionsSoA tangent;
+    PositionsSoA bitangent;
+
+    size_t size() const {
+        return normal.size();
+    }
+
+    void resize(size_t count) {
+        normal.resize(count);
+        tangent.resize(count);
+        bitangent.resize(count);
+    }
+
+    void clear() {
+        normal.clear();
+        tangent.clear();
+        bitangent.clear();
+    }
+};
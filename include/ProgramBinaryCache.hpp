@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <glad/glad.h>
+
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+};
+
+// Linked programs saved with glGetProgramBinary under <shader dir>/cache/.
+// The key hashes both sources with the GL vendor, renderer and version
+// strings, so a shader edit or driver update misses and the caller compiles.
+// GL thread only.
+class ProgramBinaryCache {
+    public:
+        static constexpr uint32_t VERSION = 1;
+
+        // GL 4.1 or ARB_get_program_binary, with at least one binary format
+        static bool isSupported();
+        static uint64_t key(const std::string& vertexSource, const std::string& fragmentSource);
+        static std::string cachePath(const std::string& vertexPath, uint64_t key);
+        // True if program is linked from the cached binary
+        static bool load(GLuint program, const std::string& path, uint64_t key);
+        // program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        static bool store(GLuint program, const std::string& path, uint64_t key);
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include <BVH.hpp>
+#include <Model.hpp>
+
+class ThreadPool;
+
+struct BVHInstance {
+    std::shared_ptr<Mesh> mesh;
+    glm::mat4 transform;
+    glm::mat4 inverseTransform;
+    AABB worldBounds;
+};
+
+// Two-level hierarchy: a top level over the MeshEntries of a Model in world
+// space, whose leaves hand the ray over to the per-mesh BVH in local space.
+// Local directions are not renormalized, so t stays comparable between
+// instances and with the world-space ray.
+class SceneBVH {
+    public:
+        SceneBVH();
+        SceneBVH(const Model& model);
+
+        void build(const Model& model);
+        // Updates instance bounds after their mesh BVH was refitted or rebuilt
+        void refit();
+        bool intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const;
+        void intersect(RayBatch& batch, ThreadPool& pool) const;
+
+        size_t getInstanceCount() const;
+        const BVHInstance& getInstance(size_t index) const;
+
+    private:
+        std::vector<BVHInstance> m_instances;
+        std::vector<uint32_t> m_instanceOrder;
+        std::vector<BVHNode> m_nodes;
+
+        AABB localBounds(const Mesh& mesh) const;
+        AABB transformBounds(const AABB& bounds, const glm::mat4& transform) const;
+        uint32_t buildRecursive(uint32_t first, uint32_t count);
+        void updateBounds(uint32_t nodeIndex);
+        bool intersectInstance(uint32_t index, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const;
+};
@@ -3,15 +3,22 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <string>
+#include <unordered_map>
 
 class Shader {
     public:
         Shader();
         Shader(const std::string& vertexPath, const std::string& fragmentPath);
         Shader(const char* vertexPath, const char* fragmentPath);
+        // defines holds "#define ..." lines, inserted after the #version line of both stages
+        Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines);
         ~Shader();
         void use();
-        void initFromPaths(const char* vertexPath, const char* fragmentPath);
+        void initFromPaths(const char* vertexPath, const char* fragmentPath, const std::string& defines = "");
+        // Resolved once at link time, -1 for unknown or inactive uniforms
+        GLint getUniformLocation(const char* name) const;
+        // Attaches a std140 block to one of the UniformBinding points, ignored if the program has no such block
+        void bindUniformBlock(const char* blockName, GLuint binding);
         void setVec2(const char* name, const float x, const float y);
         void setVec2(const char* name, const glm::vec2 v);
         void setVec3(const char* name, const glm::vec3 v);
@@ -21,8 +28,17 @@ class Shader {
         void setFloat(const char* name, const float val);
         void setBool(const char* name, const bool val);
         void setMat4(const char* name, const glm::mat4& mat);
+        // Same with a location from getUniformLocation(), for per-draw uniforms
+        void setInt(GLint location, const int val);
+        void setFloat(GLint location, const float val);
+        void setBool(GLint location, const bool val);
+        void setVec3(GLint location, const glm::vec3 v);
+        void setMat4(GLint location, const glm::mat4& mat);
 
     private:
         GLuint m_id = 0;
         bool initialized = false;
+        std::unordered_map<std::string, GLint> m_uniformLocations;
+
+        void cacheUniformLocations();
 };
\ No newline at end of file
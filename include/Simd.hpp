@@ -0,0 +1,12 @@
+#pragma once
+
+// Instruction sets the CPU kernels are compiled for (see KELVINLETS_ENABLE_AVX2)
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define KELVINLET_KERNEL_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#define KELVINLET_KERNEL_SSE
+#endif
+#if defined(KELVINLET_KERNEL_AVX2) || defined(KELVINLET_KERNEL_SSE)
+#include <immintrin.h>
+#endif
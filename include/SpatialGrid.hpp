@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <PositionsSoA.hpp>
+#include <ThreadPool.hpp>
+
+// Points sharing one bucket of a SpatialGrid
+struct GridSpan {
+    const uint32_t* begin;
+    const uint32_t* end;
+};
+
+// Hashed uniform grid over a point set. Buckets are laid out CSR style with
+// slack: bucket b holds m_count[b] point indices from m_start[b] and may grow
+// up to m_start[b + 1], so points that moved change bucket in place and only
+// a full bucket forces a rebuild.
+class SpatialGrid {
+    public:
+        // Spare capacity of every bucket: a fraction of its initial count plus a few slots
+        static constexpr float SLACK = 0.25f;
+        static constexpr uint32_t MIN_SLACK = 4;
+        // Larger queries are refused, scanning all points is cheaper then
+        static constexpr size_t MAX_QUERY_CELLS = 4096;
+
+        SpatialGrid();
+
+        void build(const PositionsSoA& positions, float cellSize, ThreadPool& pool);
+        // Moves the listed points to the bucket of their new position. Returns false
+        // if a bucket overflowed and the grid was rebuilt instead.
+        bool rebin(const PositionsSoA& positions, const uint32_t* moved, size_t count, ThreadPool& pool);
+        // Appends one span per bucket of the cells overlapping the sphere. Spans may
+        // hold points outside of it. False, with spans untouched, if too many cells overlap.
+        bool query(const glm::vec3& center, float radius, std::vector<GridSpan>& spans) const;
+        // Appends the points within radius of center, scanning every point if query() refuses
+        void gather(const PositionsSoA& positions, const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+
+        bool isBuilt() const;
+        size_t size() const;
+        size_t getBucketCount() const;
+        float getCellSize() const;
+
+        // Twice the mean edge length, a few points per occupied cell on a surface
+        static float suggestCellSize(const PositionsSoA& positions, const std::vector<unsigned int>& indices);
+
+    private:
+        float m_cellSize = 1.0f;
+        float m_invCellSize = 1.0f;
+        uint32_t m_mask = 0;
+        std::vector<uint32_t> m_start;
+        std::vector<uint32_t> m_count;
+        std::vector<uint32_t> m_slots;
+        // Per point: its bucket and its slot in m_slots
+        std::vector<uint32_t> m_bucketOf;
+        std::vector<uint32_t> m_slotOf;
+
+        glm::ivec3 cellOf(const glm::vec3& p) const;
+        uint32_t bucketOf(const glm::ivec3& cell) const;
+};
@@ -3,11 +3,14 @@
 #include <glad/glad.h>
 #include <string>
 #include <stb_image.hpp>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <BlockCompression.hpp>
 
 class Texture {
     public:
-        unsigned int ID;
+        unsigned int ID = 0;
         std::string type;
         std::string path;
 
@@ -22,7 +25,49 @@ class Texture {
             return std::make_shared<Texture>(image_path);
         }
 
+        // Decodes path from a mapping of the file without touching GL, so it can run
+        // on any thread. upload() then creates the texture on the GL thread.
+        // When the driver takes the matching block format, the compressed mip chain is
+        // read from the .ktx2 cache next to the image, or encoded and cached on a miss.
+        bool decode();
+
+        // GL thread, once the context exists: enables the formats the driver supports
+        static void detect_compression_support();
+        static bool supports_compression(BlockFormat format);
+
         static unsigned int texture_from_file(const char* image_path, const std::string &directory);
+        // Decodes first if needed
+        void upload();
+        // Same, reading pixel_data() from the bound GL_PIXEL_UNPACK_BUFFER
+        void upload_from_unpack_buffer();
+        // Decoded pixels, or the compressed mip chain
+        const unsigned char* pixel_data() const;
+        size_t pixel_bytes() const;
+        // Safe from any thread, ID itself is only touched by the GL thread
+        bool is_uploaded() const;
+        // Texture memory once uploaded, mip chain included
+        size_t gpu_bytes() const;
         void use();
         void unbind();
+
+    private:
+        // Decoded pixels waiting for upload()
+        std::shared_ptr<unsigned char> pixels;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        // Compressed mip chain waiting for upload(), replaces pixels
+        CompressedImage compressed;
+        size_t compressed_bytes = 0;
+        bool decoded = false;
+        std::mutex decode_mutex;
+        // Set once ID names the texture
+        std::atomic<bool> uploaded{false};
+
+        static std::atomic<bool> s3tc_supported;
+        static std::atomic<bool> rgtc_supported;
+
+        bool decode_from_memory(const unsigned char* data, size_t size);
+        bool decode_compressed(const unsigned char* data, size_t size);
+        void create_gl_texture(const unsigned char* data);
 };
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <Texture.hpp>
+
+struct TextureCacheStats {
+    size_t textures = 0;
+    size_t residentBytes = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+// Textures shared between materials, looked up by normalized path, then by
+// content hash so copies of one image under several names load once. The cache
+// only holds weak references: a texture is evicted when the last material
+// using it goes away, and its GL name is freed by the next collectGarbage().
+class TextureCache {
+    public:
+        static TextureCache& instance();
+
+        // Safe from any thread. A texture new to the cache is neither decoded nor uploaded yet.
+        std::shared_ptr<Texture> acquire(const std::string& path, const std::string& type);
+        // Safe from any thread: forgets a texture whose decode failed, so that the
+        // next acquire() of its path or content reads the file again
+        void evict(const Texture& texture);
+        // GL thread: deletes the textures evicted since the last call
+        void collectGarbage();
+        TextureCacheStats getStats() const;
+
+        static std::string normalizePath(const std::string& path);
+
+    private:
+        struct Entry {
+            std::weak_ptr<Texture> texture;
+            uint64_t contentHash = 0;
+        };
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_byPath;
+        std::unordered_map<uint64_t, std::weak_ptr<Texture>> m_byContent;
+        std::vector<unsigned int> m_pendingDeletes;
+        size_t m_hits = 0;
+        size_t m_misses = 0;
+
+        TextureCache() = default;
+        std::shared_ptr<Texture> find(const std::string& key);
+        void release(Texture* texture, const std::string& key, uint64_t contentHash);
+};
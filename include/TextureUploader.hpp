@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <glad/glad.h>
+#include <Texture.hpp>
+
+// Streams decoded textures to the GPU through a ring of pixel unpack buffers.
+// glTexImage2D then copies from the buffer without blocking the CPU, and a
+// fence per slot tells when the slot can be written again. GL thread only.
+class TextureUploader {
+    public:
+        static constexpr size_t RING_SIZE = 3;
+
+        TextureUploader();
+        ~TextureUploader();
+        TextureUploader(const TextureUploader&) = delete;
+        TextureUploader& operator=(const TextureUploader&) = delete;
+
+        void enqueue(std::shared_ptr<Texture> texture);
+        // Uploads queued textures until about budgetBytes are sent or the next
+        // slot is still read by the GPU. At least one texture goes per call.
+        void update(size_t budgetBytes);
+        // Drops the queued textures, those already sent stay uploaded
+        void clear();
+        size_t getPendingCount() const;
+
+    private:
+        struct Slot {
+            GLuint buffer = 0;
+            size_t capacity = 0;
+            GLsync fence = nullptr;
+        };
+
+        Slot m_slots[RING_SIZE];
+        size_t m_nextSlot = 0;
+        std::deque<std::shared_ptr<Texture>> m_queue;
+
+        bool uploadThroughSlot(Slot& slot, Texture& texture);
+};
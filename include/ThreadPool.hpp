@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the tasks of one batch so the submitter can wait for all of them
+class TaskGroup {
+    public:
+        bool done() const {
+            return m_pending.load(std::memory_order_acquire) == 0;
+        }
+
+    private:
+        friend class ThreadPool;
+        std::atomic<size_t> m_pending{0};
+};
+
+struct WorkerStats {
+    size_t tasks = 0;
+    size_t steals = 0;
+    double busyMs = 0.0;
+};
+
+// Work-stealing pool: every worker owns a deque, pops its own work LIFO and
+// steals FIFO from the others when it runs dry. Threads waiting on a group
+// execute pending tasks instead of blocking.
+class ThreadPool {
+    public:
+        using Task = std::function<void()>;
+        using RangeTask = std::function<void(size_t, size_t)>;
+
+        ThreadPool();
+        ThreadPool(unsigned int threadCount);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Joins the workers, so it waits for the tasks they are running, and hands
+        // the queued ones over to the new workers without running any of them here
+        void setThreadCount(unsigned int threadCount);
+        unsigned int getThreadCount() const;
+        static unsigned int defaultThreadCount();
+
+        void run(TaskGroup& group, Task task);
+        void wait(TaskGroup& group);
+        // Splits [begin, end) into chunks of at most grain items and blocks until all are done
+        void parallelFor(size_t begin, size_t end, size_t grain, const RangeTask& fn);
+
+        // Per-worker counters since the last reset (index 0 is the calling thread)
+        std::vector<WorkerStats> getStats() const;
+        void resetStats();
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            WorkerStats stats;
+        };
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::vector<std::thread> m_threads;
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wakeUp;
+        std::atomic<size_t> m_queued{0};
+        std::atomic<size_t> m_nextQueue{0};
+        bool m_stopping = false;
+
+        void start(unsigned int threadCount);
+        void joinWorkers();
+        // Joins the workers and runs what is left on the caller
+        void stop();
+        void workerLoop(size_t index);
+        bool tryRunOne(size_t index);
+        bool popLocal(size_t index, Task& task);
+        bool steal(size_t index, Task& task);
+        size_t currentWorker() const;
+};
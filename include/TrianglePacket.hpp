@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct RayHit {
+    float t = std::numeric_limits<float>::max();
+    uint32_t triangle = std::numeric_limits<uint32_t>::max();
+    // Barycentrics of the hit: p = (1 - u - v) v0 + u v1 + v v2
+    float u = 0.0f;
+    float v = 0.0f;
+    // MeshEntry index when traced through a SceneBVH
+    uint32_t instance = std::numeric_limits<uint32_t>::max();
+
+    bool hit() const {
+        return triangle != std::numeric_limits<uint32_t>::max();
+    }
+};
+
+// Eight triangles with their first corner, edges and (unnormalized) normal
+// precomputed and stored SoA, so one kernel call tests them all at once.
+// Unused lanes are degenerate (zero normal) and never report a hit.
+struct alignas(32) TrianglePacket {
+    static constexpr int WIDTH = 8;
+    static constexpr uint32_t INVALID_ID = std::numeric_limits<uint32_t>::max();
+
+    float v0[3][WIDTH];
+    float e1[3][WIDTH];
+    float e2[3][WIDTH];
+    float n[3][WIDTH];
+    uint32_t ids[WIDTH];
+
+    TrianglePacket();
+    void set(int lane, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, uint32_t id);
+    void clear(int lane);
+};
+
+// Closest hit of the packet with t in (0, hit.t), returns true if hit was updated
+bool intersectTrianglePacket(const TrianglePacket& packet, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit);
+// Brute-force test of every packet, for meshes without a BVH
+bool intersectTrianglePackets(const std::vector<TrianglePacket>& packets, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit);
+// Packs every triangle of an index buffer, triangle ids are index / 3
+std::vector<TrianglePacket> buildTrianglePackets(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
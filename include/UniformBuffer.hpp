@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstring>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Binding points shared by every program, see Shader::bindUniformBlock()
+namespace UniformBinding {
+    constexpr GLuint CAMERA = 0;
+    constexpr GLuint KELVINLET = 1;
+    constexpr GLuint KELVINLET_INSTANCES = 2;
+};
+
+// Brush instances the vertex shader can sum, 32 B each. GL 3.3 has no storage
+// buffers and only guarantees 16 KiB per uniform block.
+constexpr int MAX_GPU_BRUSHES = 256;
+
+// std140 mirror of CameraBlock
+struct CameraUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+// std140 mirror of KelvinletBlock, the shape shared by every instance. Each
+// vec3 shares its 16 bytes with the following scalar.
+struct KelvinletUniforms {
+    // Kelvinlet::m_scaleEpsilons and m_scaleWeights, the program knows how many are used
+    glm::vec3 epsilons;
+    float a;
+    glm::vec3 weights;
+    float b;
+    // Instances summed by the shader, 0 when the positions are deformed on the CPU
+    int count;
+    float padding[3];
+};
+
+// One instance of a KelvinletBatch
+struct KelvinletInstance {
+    // Brush center in xyz, influence radius in w: vertices further away are not displaced by it
+    glm::vec4 center;
+    // KelvinletBatch::getLoad()
+    glm::vec4 load;
+};
+
+// std140 mirror of KelvinletInstanceBlock
+struct KelvinletInstanceUniforms {
+    KelvinletInstance instances[MAX_GPU_BRUSHES];
+};
+
+static_assert(sizeof(CameraUniforms) == 128, "CameraUniforms must match the std140 layout of CameraBlock");
+static_assert(sizeof(KelvinletUniforms) == 48, "KelvinletUniforms must match the std140 layout of KelvinletBlock");
+static_assert(sizeof(KelvinletInstanceUniforms) == 32 * MAX_GPU_BRUSHES, "KelvinletInstanceUniforms must match the std140 layout of KelvinletInstanceBlock");
+
+// Uniform buffer object holding one T, bound to a fixed binding point.
+// set() only touches GL when the value changed. GL thread only.
+template <typename T>
+class UniformBuffer {
+    public:
+        explicit UniformBuffer(GLuint binding) {
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_buffer);
+        }
+        ~UniformBuffer() {
+            glDeleteBuffers(1, &m_buffer);
+        }
+        UniformBuffer(const UniformBuffer&) = delete;
+        UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+        void set(const T& value) {
+            if (m_uploaded && std::memcmp(&value, &m_value, sizeof(T)) == 0) return;
+            m_value = value;
+            m_uploaded = true;
+            glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &m_value);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        const T& get() const { return m_value; }
+
+    private:
+        GLuint m_buffer = 0;
+        T m_value = {};
+        bool m_uploaded = false;
+};
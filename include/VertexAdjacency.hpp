@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <PositionsSoA.hpp>
+#include <ThreadPool.hpp>
+
+// Triangles around every vertex in CSR form. Vertices at the same position,
+// like the duplicates of uv and material seams, are welded into one group:
+// the triangles of group g are m_triangles[m_offsets[g]] to
+// m_triangles[m_offsets[g + 1]], in increasing order.
+class VertexAdjacency {
+    public:
+        VertexAdjacency();
+        VertexAdjacency(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions);
+
+        void build(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions);
+        // Appends the vertices at the position of one of the listed ones or sharing
+        // a triangle of indices with it, each once and sorted
+        void oneRing(const std::vector<unsigned int>& indices, const uint32_t* vertices, size_t count, std::vector<uint32_t>& out);
+
+        size_t vertexCount() const;
+        // Distinct positions, the number of groups
+        size_t positionCount() const;
+        size_t triangleCount() const;
+        // Triangles around the position of vertex
+        const uint32_t* trianglesBegin(uint32_t vertex) const;
+        const uint32_t* trianglesEnd(uint32_t vertex) const;
+
+    private:
+        // Group of every vertex, and the vertices of every group in CSR form
+        std::vector<uint32_t> m_groups;
+        std::vector<uint32_t> m_memberOffsets;
+        std::vector<uint32_t> m_members;
+        std::vector<uint32_t> m_offsets;
+        std::vector<uint32_t> m_triangles;
+        // Group g was reached by the current oneRing() when m_visited[g] == m_generation
+        std::vector<uint32_t> m_visited;
+        uint32_t m_generation = 0;
+
+        void weld(const std::vector<glm::vec3>& positions);
+};
+
+// Area weighted normals over the triangles around the position of the listed
+// vertices, so seam duplicates share them, and tangents from the uv gradients
+// of their own triangles. Every vertex sums its triangles, so vertices are
+// written by one task each and the result does not depend on which ones are
+// listed nor on the previous frames. The uv bitangent gives the handedness.
+// Without uv gradients the rest tangent is projected, with its handedness.
+void recomputeFrames(const VertexAdjacency& adjacency, const std::vector<unsigned int>& indices, const PositionsSoA& positions, const std::vector<glm::vec2>& uvs, const uint32_t* vertices, size_t count, const FramesSoA& rest, FramesSoA& frames, ThreadPool& pool);
+// Same for every vertex
+void recomputeFrames(const VertexAdjacency& adjacency, const std::vector<unsigned int>& indices, const PositionsSoA& positions, const std::vector<glm::vec2>& uvs, const FramesSoA& rest, FramesSoA& frames, ThreadPool& pool);
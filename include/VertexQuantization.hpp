@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Normal, tangent and bitangent packed as one 16-bit snorm quaternion rotating
+// the canonical frame (x = tangent, z = normal). w is kept strictly positive
+// so its sign can carry the handedness of the bitangent. The uv follows as two
+// half floats, 12 bytes instead of the 44 of the float attributes.
+struct PackedAttributes {
+    int16_t tangent_frame[4];
+    uint16_t uv[2];
+};
+
+// Largest errors measured while packing, angles in degrees
+struct QuantizationError {
+    float normal = 0.0f;
+    float tangent = 0.0f;
+    float bitangent = 0.0f;
+    float uv = 0.0f;
+
+    void grow(const QuantizationError& other);
+};
+
+PackedAttributes packAttributes(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent, const glm::vec2& uv);
+// Same decode as kelvinlets.vert
+void unpackAttributes(const PackedAttributes& packed, glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent, glm::vec2& uv);
+// Packs every vertex and measures the round trip error against the float attributes
+std::vector<PackedAttributes> packAttributes(const std::vector<glm::vec3>& normals, const std::vector<glm::vec3>& tangents, const std::vector<glm::vec3>& bitangents, const std::vector<glm::vec2>& uvs, QuantizationError& error);
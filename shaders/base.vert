@@ -2,8 +2,10 @@
 
 layout(location = 0) in vec3 aPos;
 
-uniform mat4 u_viewMatrix;
-uniform mat4 u_projectionMatrix;
+layout(std140) uniform CameraBlock {
+    mat4 u_viewMatrix;
+    mat4 u_projectionMatrix;
+};
 
 void main() {
     gl_PointSize = 10.0;
@@ -1,43 +1,177 @@
 #version 330 core
 
 layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec3 aTangent;
+layout(location = 3) in vec3 aBitangent;
+layout(location = 4) in vec2 aUV;
+// Snorm16 quaternion of the Quantized layout, w carries the bitangent sign
+layout(location = 5) in vec4 aTangentFrame;
 
-struct Brush {
-    float epsilon;
-    float f;
+out vec3 vNormal;
+out vec3 vTangent;
+out vec3 vBitangent;
+out vec2 vUV;
+
+// Shared with the other programs, see UniformBuffer.hpp for the C++ side
+layout(std140) uniform CameraBlock {
+    mat4 u_viewMatrix;
+    mat4 u_projectionMatrix;
 };
 
-struct Kelvinlet {
-    Brush brush;
+// One program per brush type and scale count, compiled with BRUSH_TWIST,
+// BRUSH_SCALE or BRUSH_PINCH defined (grab otherwise) and BRUSH_SCALES set
+// to 2 or 3 for multi-scale brushes, see Application::brushShader()
+#ifndef BRUSH_SCALES
+#define BRUSH_SCALES 1
+#endif
+// MAX_GPU_BRUSHES of UniformBuffer.hpp
+#ifndef MAX_BRUSHES
+#define MAX_BRUSHES 256
+#endif
+
+// Shape shared by every instance
+layout(std140) uniform KelvinletBlock {
+    vec3 epsilons;
     float a;
+    vec3 weights;
     float b;
+    int count;
+} kelvinlet;
+
+// Center and influence radius (w), and load of each instance, see KelvinletBatch
+struct KelvinletInstance {
+    vec4 center;
+    vec4 load;
 };
 
-uniform mat4 u_viewMatrix;
-uniform mat4 u_projectionMatrix;
-uniform vec3 x0;
-uniform Kelvinlet kelvinlet;
-
-mat3 outerProduct(vec3 u, vec3 v) {
-    return mat3(
-        u.x * v.x, u.x * v.y, u.x * v.z,
-        u.y * v.x, u.y * v.y, u.y * v.z,
-        u.z * v.x, u.z * v.y, u.z * v.z
-    );
+layout(std140) uniform KelvinletInstanceBlock {
+    KelvinletInstance instances[MAX_BRUSHES];
+};
+
+uniform mat4 u_modelMatrix;
+uniform bool u_quantizedAttributes;
+
+// Same terms as the kernels of KelvinletDeformer.cpp. Scales only add radial
+// terms, the vector parts are computed once. With ANALYTIC_NORMALS defined the
+// Jacobian du/dr is added to jacobian, radial terms being differentiated through
+// r_eps: d(1/re^n)/dr = -n/re^(n+2) r.
+vec3 kelvinletDisplacement(vec3 r, vec4 load, inout mat3 jacobian) {
+    float r2 = dot(r, r);
+    float A = 0.0;
+    float B = 0.0;
+    float w = 0.0;
+    float s3 = 0.0;
+    float s5 = 0.0;
+    float Ag = 0.0;
+    float Bg = 0.0;
+    float wg = 0.0;
+    float s3g = 0.0;
+    float s5g = 0.0;
+    for (int s = 0; s < BRUSH_SCALES; ++s) {
+        float eps2 = kelvinlet.epsilons[s] * kelvinlet.epsilons[s];
+        float weight = kelvinlet.weights[s];
+        float invR = 1.0 / max(sqrt(r2 + eps2), 0.0001);
+        float invR3 = invR * invR * invR;
+        float invR5 = invR3 * invR * invR;
+#if defined(BRUSH_TWIST) || defined(BRUSH_SCALE) || defined(BRUSH_PINCH)
+        w += weight * (invR3 + 1.5 * eps2 * invR5);
+        s3 += weight * invR3;
+        s5 += weight * invR5;
+#ifdef ANALYTIC_NORMALS
+        float invR7 = invR5 * invR * invR;
+        wg -= weight * (3.0 * invR5 + 7.5 * eps2 * invR7);
+        s3g -= 3.0 * weight * invR5;
+        s5g -= 5.0 * weight * invR7;
+#endif
+#else
+        A += weight * ((kelvinlet.a - kelvinlet.b) * invR + 0.5 * kelvinlet.a * eps2 * invR3);
+        B += weight * kelvinlet.b * invR3;
+#ifdef ANALYTIC_NORMALS
+        Ag -= weight * ((kelvinlet.a - kelvinlet.b) * invR3 + 1.5 * kelvinlet.a * eps2 * invR5);
+        Bg -= 3.0 * weight * kelvinlet.b * invR5;
+#endif
+#endif
+    }
+#if defined(BRUSH_TWIST)
+    vec3 l = load.xyz;
+#ifdef ANALYTIC_NORMALS
+    // Columns of the cross product matrix of l
+    jacobian += w * mat3(0.0, l.z, -l.y, -l.z, 0.0, l.x, l.y, -l.x, 0.0) + outerProduct(cross(l, r), wg * r);
+#endif
+    return w * cross(l, r);
+#elif defined(BRUSH_SCALE)
+#ifdef ANALYTIC_NORMALS
+    jacobian += load.w * (mat3(w) + outerProduct(r, wg * r));
+#endif
+    return w * load.w * r;
+#elif defined(BRUSH_PINCH)
+    vec3 Fr = load.w * (dot(load.xyz, r) * load.xyz - r / 3.0);
+    float P = 2.0 * kelvinlet.b * s3 - kelvinlet.a * w;
+    float Q = 3.0 * kelvinlet.b * s5 * dot(r, Fr);
+#ifdef ANALYTIC_NORMALS
+    float Pf = P * load.w;
+    float Pg = 2.0 * kelvinlet.b * s3g - kelvinlet.a * wg;
+    float Qg = 3.0 * kelvinlet.b * s5g * dot(r, Fr);
+    jacobian += Pf * outerProduct(load.xyz, load.xyz) - mat3(Pf / 3.0 + Q) + outerProduct(Fr, Pg * r)
+        - outerProduct(r, Qg * r + 6.0 * kelvinlet.b * s5 * Fr);
+#endif
+    return P * Fr - Q * r;
+#else
+    float rF = dot(r, load.xyz);
+#ifdef ANALYTIC_NORMALS
+    jacobian += outerProduct(load.xyz, Ag * r) + outerProduct(r, Bg * rF * r + B * load.xyz) + mat3(B * rF);
+#endif
+    return A * load.xyz + B * rF * r;
+#endif
 }
 
-void main() {
-    vec3 r = aPos - x0;
-    float rEpsilon = sqrt(dot(r, r) + pow(kelvinlet.brush.epsilon, 2));
-    if (rEpsilon < 0.0001) rEpsilon = 0.0001;
+vec3 rotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Same decode as unpackAttributes() in VertexQuantization.cpp
+void decodeTangentFrame(vec4 packed, out vec3 normal, out vec3 tangent, out vec3 bitangent) {
+    float handedness = packed.w < 0.0 ? -1.0 : 1.0;
+    vec4 q = normalize(packed);
+    normal = rotate(q, vec3(0.0, 0.0, 1.0));
+    tangent = rotate(q, vec3(1.0, 0.0, 0.0));
+    bitangent = cross(normal, tangent) * handedness;
+}
 
-    vec3 identity = vec3(1.0);
-    vec3 term1 = (kelvinlet.a - kelvinlet.b) / rEpsilon * identity;
-    mat3 rrT = outerProduct(r, r);
-    vec3 term2 = (kelvinlet.b / pow(rEpsilon, 3)) * rrT * identity;
-    vec3 term3 = (kelvinlet.a / 2.0) * (pow(kelvinlet.brush.epsilon, 2) / pow(rEpsilon, 3)) * identity;
-    vec3 displacement = (term1 + term2 + term3) * kelvinlet.brush.f; 
+void main() {
+    vec3 displacement = vec3(0.0);
+    // du/dr summed over the instances, only accumulated with ANALYTIC_NORMALS
+    mat3 gradient = mat3(0.0);
+    for (int i = 0; i < kelvinlet.count; ++i) {
+        vec3 r = aPos - instances[i].center.xyz;
+        // Beyond the influence radius the displacement is below the tolerance
+        if (dot(r, r) <= instances[i].center.w * instances[i].center.w) {
+            displacement += kelvinletDisplacement(r, instances[i].load, gradient);
+        }
+    }
 
     vec3 newPos = aPos + displacement;
-    gl_Position = u_projectionMatrix * u_viewMatrix * vec4(newPos, 1.0);
-}
\ No newline at end of file
+
+    vec3 normal = aNormal;
+    vec3 tangent = aTangent;
+    vec3 bitangent = aBitangent;
+    if (u_quantizedAttributes) {
+        decodeTangentFrame(aTangentFrame, normal, tangent, bitangent);
+    }
+#ifdef ANALYTIC_NORMALS
+    // Tangents follow J = I + du/dr, the normal its cofactor matrix, which is the
+    // inverse transpose scaled by det(J)
+    mat3 J = mat3(1.0) + gradient;
+    mat3 cofactor = mat3(cross(J[1], J[2]), cross(J[2], J[0]), cross(J[0], J[1]));
+    normal = normalize(cofactor * normal);
+    tangent = normalize(J * tangent);
+    bitangent = normalize(J * bitangent);
+#endif
+    mat3 normalMatrix = mat3(u_modelMatrix);
+    vNormal = normalMatrix * normal;
+    vTangent = normalMatrix * tangent;
+    vBitangent = normalMatrix * bitangent;
+    vUV = aUV;
+    gl_Position = u_projectionMatrix * u_viewMatrix * u_modelMatrix * vec4(newPos, 1.0);
+}
@@ -1,8 +1,14 @@
 #include <stdexcept>
 #include <memory>
 #include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
 #include <Application.hpp>
+#include <TextureCache.hpp>
 #include <glm/ext/matrix_clip_space.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
 #include <imgui.h>
@@ -56,6 +62,7 @@ void Application::initOpenGL() {
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         throw std::runtime_error("Failed to initialize GLAD");
     }
+    Texture::detect_compression_support();
     glEnable(GL_DEPTH_TEST);
     glViewport(0, 0, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT);
     glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
@@ -63,8 +70,12 @@ void Application::initOpenGL() {
 
 void Application::initShaders() {
     m_projectionMatrix = glm::perspective(glm::radians(45.0f), (float)Config::WINDOW_WIDTH / (float)Config::WINDOW_HEIGHT, 0.1f, 1000.0f);
-    m_baseShader = std::make_unique<Shader>(Config::SHADER_PATH + "kelvinlets.vert", Config::SHADER_PATH + "base.frag");
     m_lineShader = std::make_unique<Shader>(Config::SHADER_PATH + "line.vert", Config::SHADER_PATH + "line.frag");
+    m_cameraUniforms = std::make_unique<UniformBuffer<CameraUniforms>>(UniformBinding::CAMERA);
+    m_kelvinletUniforms = std::make_unique<UniformBuffer<KelvinletUniforms>>(UniformBinding::KELVINLET);
+    m_kelvinletInstanceUniforms = std::make_unique<UniformBuffer<KelvinletInstanceUniforms>>(UniformBinding::KELVINLET_INSTANCES);
+    m_lineShader->bindUniformBlock("CameraBlock", UniformBinding::CAMERA);
+    m_lineShader->bindUniformBlock("KelvinletBlock", UniformBinding::KELVINLET);
 }
 
 void Application::initImGui() {
@@ -76,10 +87,29 @@ void Application::initImGui() {
 
 void Application::initObjects() {
     m_pointGrid = std::make_unique<PointGrid>();
-    m_loadedModel = std::make_unique<Model>(Config::MODELS_PATH + "capsule/capsule.gltf");
+    // Empty until the loader has uploaded the first model
+    m_loadedModel = std::make_unique<Model>();
     m_camera = std::make_unique<OrbitalCamera>();
     m_kelvinlet = std::make_unique<Kelvinlet>();
     m_ray = std::make_unique<Ray>();
+    m_threadPool = std::make_unique<ThreadPool>();
+    m_workerThreads = m_threadPool->getThreadCount();
+    m_modelDeformer = std::make_unique<ModelDeformer>(*m_loadedModel);
+    m_sceneBVH = std::make_unique<SceneBVH>(*m_loadedModel);
+    m_modelLoader = std::make_unique<ModelLoader>(*m_threadPool);
+    std::snprintf(m_modelPath, sizeof(m_modelPath), "%s", (Config::MODELS_PATH + "capsule/capsule.gltf").c_str());
+    m_modelLoader->load(m_modelPath, VertexLayout::Quantized);
+}
+
+void Application::swapModel(std::unique_ptr<Model> model) {
+    m_loadedModel = std::move(model);
+    m_modelDeformer->setModel(*m_loadedModel);
+    m_sceneBVH->build(*m_loadedModel);
+    m_cpuPositionsUploaded = false;
+    m_lastHit = RayHit();
+    m_lastHitEntry = -1;
+    // The instance of the stroke is gone
+    m_stroking = false;
 }
 
 void Application::renderUI() {
@@ -89,38 +119,333 @@ void Application::renderUI() {
 
     ImGui::Begin("Kelvinlets app");
     ImGui::Checkbox("Display ray picking", &m_hasRayToDraw);
+    if (m_lastHit.hit()) {
+        ImGui::Text("Hit entry %d, triangle %u at t = %.4f", m_lastHitEntry, m_lastHit.triangle, m_lastHit.t);
+        ImGui::Text("Barycentrics (%.3f, %.3f, %.3f), picked in %.3f ms", 1.0f - m_lastHit.u - m_lastHit.v, m_lastHit.u, m_lastHit.v, m_lastPickMs);
+    }
+    renderModelUI();
+    renderBrushUI();
+    renderDeformationUI();
     ImGui::End();
+    // The loader thread decodes on the pool while importing, resized once it is done
+    if (m_modelLoader->getState() != LoadState::Importing) {
+        m_threadPool->setThreadCount(static_cast<unsigned int>(m_workerThreads));
+    }
 
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void Application::renderModelUI() {
+    if (!ImGui::CollapsingHeader("Model")) return;
+    ImGui::InputText("Path", m_modelPath, sizeof(m_modelPath));
+    if (ImGui::Button("Load")) {
+        m_modelLoader->load(m_modelPath, VertexLayout::Quantized);
+    }
+    switch (m_modelLoader->getState()) {
+        case LoadState::Importing:
+            ImGui::Text("Importing %s...", m_modelLoader->getPath().c_str());
+            break;
+        case LoadState::Uploading:
+            ImGui::Text("Uploading %zu / %zu", m_modelLoader->getUploadedCount(), m_modelLoader->getUploadCount());
+            break;
+        case LoadState::Idle:
+            ImGui::Text("%zu entries, imported in %.1f ms", m_loadedModel->entries.size(), m_modelLoader->getImportMs());
+            break;
+    }
+    if (m_loadedModel->layout == VertexLayout::Quantized) {
+        const QuantizationError& error = m_loadedModel->stats.quantization;
+        ImGui::Text("Quantization error: normal %.3f, tangent %.3f, bitangent %.3f deg, uv %.2e", error.normal, error.tangent, error.bitangent, error.uv);
+    }
+    const std::vector<MeshImportStats>& meshes = m_loadedModel->stats.meshes;
+    if (!meshes.empty() && ImGui::TreeNode("Vertex cache", "Vertex cache of %zu optimized meshes", meshes.size())) {
+        for (const MeshImportStats& mesh : meshes) {
+            ImGui::Text("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", mesh.name.c_str(), mesh.before.acmr, mesh.after.acmr, mesh.before.atvr, mesh.after.atvr);
+        }
+        ImGui::TreePop();
+    }
+    const TextureCacheStats textures = TextureCache::instance().getStats();
+    ImGui::Text("Textures: %zu resident, %.1f MiB, %zu hits / %zu misses", textures.textures, textures.residentBytes / (1024.0 * 1024.0), textures.hits, textures.misses);
+}
+
+void Application::renderBrushUI() {
+    if (!ImGui::CollapsingHeader("Brush")) return;
+    Brush& brush = m_kelvinlet->m_brush;
+    int type = static_cast<int>(brush.type);
+    const char* names[BRUSH_TYPE_COUNT];
+    for (int i = 0; i < BRUSH_TYPE_COUNT; ++i) names[i] = Kelvinlet::typeName(static_cast<BrushType>(i));
+    bool changed = ImGui::Combo("Type", &type, names, BRUSH_TYPE_COUNT);
+    brush.type = static_cast<BrushType>(type);
+    changed |= ImGui::SliderInt("Scales", &brush.scales, 1, MAX_BRUSH_SCALES);
+    changed |= ImGui::SliderFloat("Epsilon", &brush.epsilon, 0.01f, 2.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+    if (brush.scales >= 2) {
+        changed |= ImGui::SliderFloat("Epsilon 2", &brush.epsilon2, 0.01f, 2.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+    }
+    if (brush.scales >= 3) {
+        changed |= ImGui::SliderFloat("Epsilon 3", &brush.epsilon3, 0.01f, 2.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+    }
+    changed |= ImGui::SliderFloat("Magnitude", &brush.f, -5000.0f, 5000.0f);
+    changed |= ImGui::SliderFloat("Poisson ratio", &brush.nu, 0.0f, 0.5f);
+    if (brush.type != BrushType::Scale) {
+        changed |= ImGui::SliderFloat3("Direction", &brush.direction.x, -1.0f, 1.0f);
+    }
+    if (changed) m_kelvinlet->computeConstants();
+    ImGui::SliderFloat3("Center", &m_brushCenter.x, -2.0f, 2.0f);
+    ImGui::SliderInt("Radial copies", &m_radialCopies, 1, 32);
+    ImGui::Checkbox("Mirror X", &m_mirrorX);
+    ImGui::Checkbox("Sculpt (drag in picking mode)", &m_sculptMode);
+    if (m_sculptMode) {
+        int integrator = static_cast<int>(m_modelDeformer->getIntegrator());
+        const char* integrators[] = {"Euler", "RK4"};
+        if (ImGui::Combo("Integrator", &integrator, integrators, 2)) {
+            m_modelDeformer->setIntegrator(static_cast<Integrator>(integrator));
+        }
+        int substeps = m_modelDeformer->getMaxSubsteps();
+        if (ImGui::SliderInt("Max substeps", &substeps, 1, 256)) {
+            m_modelDeformer->setMaxSubsteps(substeps);
+        }
+        const DeformStats& stats = m_modelDeformer->getLastStats();
+        ImGui::Text("Last step: %zu vertices, %d substeps, %.3f ms", stats.sculptedVertices, stats.substeps, stats.sculptMs);
+    }
+    if (ImGui::Button("Clear sculpt")) {
+        m_modelDeformer->clearSculpt();
+        m_modelDeformer->uploadPositions(*m_threadPool);
+        m_modelDeformer->refitHierarchies(*m_threadPool);
+        m_sceneBVH->refit();
+    }
+}
+
+void Application::renderDeformationUI() {
+    if (!ImGui::CollapsingHeader("CPU deformation")) return;
+    ImGui::Checkbox("Deform on CPU every frame", &m_cpuDeformation);
+    int normals = static_cast<int>(m_modelDeformer->getNormalUpdate());
+    const char* normalUpdates[] = {"Rest", "Analytic", "Topology"};
+    if (ImGui::Combo("Normals", &normals, normalUpdates, 3)) {
+        m_modelDeformer->setNormalUpdate(static_cast<NormalUpdate>(normals));
+        // Topology frames are computed by the first upload
+        m_modelDeformer->uploadPositions(*m_threadPool);
+    }
+    int maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()) * 2);
+    ImGui::SliderInt("Worker threads", &m_workerThreads, 0, maxThreads);
+    float tolerance = m_modelDeformer->getTolerance();
+    if (ImGui::SliderFloat("Tolerance", &tolerance, 1e-6f, 1e3f, "%.1e", ImGuiSliderFlags_Logarithmic)) {
+        m_modelDeformer->setTolerance(tolerance);
+    }
+    ImGui::Text("Influence radius: %.3f", m_kelvinlet->influenceRadius(tolerance));
+    const DeformStats& stats = m_modelDeformer->getLastStats();
+    ImGui::Text("Kernel: %s", KelvinletDeformer::kernelName());
+    ImGui::Text("%zu / %zu vertices in %zu chunks: %.3f ms", stats.vertices, stats.totalVertices, stats.chunks, stats.wallMs);
+    ImGui::Text("Meshes queried through the grid: %zu", stats.gridTargets);
+    ImGui::Text("%zu brushes, %zu brush-vertex evaluations", stats.brushes, stats.brushEvaluations);
+    ImGui::Text("Uploaded %zu vertices, %.1f KiB", stats.uploadedVertices, stats.uploadedBytes / 1024.0);
+    if (m_modelDeformer->getNormalUpdate() == NormalUpdate::Topology) {
+        ImGui::Text("Recomputed %zu frames: %.3f ms", stats.recomputedFrames, stats.framesMs);
+    }
+    auto workers = m_threadPool->getStats();
+    double busyMs = 0.0;
+    for (size_t i = 0; i < workers.size(); ++i) {
+        ImGui::Text("Worker %zu: %zu tasks (%zu stolen), %.3f ms busy", i, workers[i].tasks, workers[i].steals, workers[i].busyMs);
+        busyMs += workers[i].busyMs;
+    }
+    if (stats.wallMs > 0.0) {
+        ImGui::Text("Parallel efficiency: %.1f %%", 100.0 * busyMs / (stats.wallMs * workers.size()));
+    }
+    for (size_t t = 0; t < m_modelDeformer->getTargetCount(); ++t) {
+        auto mesh = m_modelDeformer->getMesh(t);
+        if (mesh->bvh) {
+            ImGui::Text("Mesh %zu BVH: SAH cost %.2f (x%.2f since build)", t, mesh->bvh->getCost(), mesh->bvh->getDegradation());
+        }
+    }
+}
+
+void Application::fillBrushBatch(const glm::vec3& center, KelvinletBatch& batch, bool project) const {
+    batch.clear();
+    batch.setShape(*m_kelvinlet);
+    const glm::vec3 direction = m_kelvinlet->m_brush.direction;
+    const float f = m_kelvinlet->m_brush.f;
+    // The twist axis is a pseudovector, reflections flip its other components
+    const glm::vec3 mirror = m_kelvinlet->m_brush.type == BrushType::Twist ? glm::vec3(1.0f, -1.0f, -1.0f) : glm::vec3(-1.0f, 1.0f, 1.0f);
+    const glm::vec3 flip(-1.0f, 1.0f, 1.0f);
+    const glm::vec3 eye = m_camera->getPosition();
+    m_projectionRays.clear();
+    for (int i = 0; i < m_radialCopies; ++i) {
+        const glm::mat3 rotation = glm::mat3(glm::rotate(glm::mat4(1.0f), glm::two_pi<float>() * i / m_radialCopies, glm::vec3(0.0f, 1.0f, 0.0f)));
+        const glm::vec3 x0 = rotation * center;
+        const glm::vec3 d = rotation * direction;
+        batch.add(x0, d, f);
+        if (m_mirrorX) {
+            batch.add(flip * x0, mirror * d, f);
+        }
+        if (!project) continue;
+        // The copies of the camera ray through center
+        const glm::vec3 origin = rotation * eye;
+        const glm::vec3 ray = glm::normalize(x0 - origin);
+        m_projectionRays.add(origin, ray);
+        if (m_mirrorX) m_projectionRays.add(flip * origin, flip * ray);
+    }
+    if (!project) return;
+    // Copies land on the surface their ray hits first, or stay where they are
+    m_sceneBVH->intersect(m_projectionRays, *m_threadPool);
+    KelvinletBatch copies = batch;
+    batch.clear();
+    batch.setShape(*m_kelvinlet);
+    for (size_t i = 0; i < copies.size(); ++i) {
+        const RayHit& hit = m_projectionRays.hits[i];
+        const BrushInstance& copy = copies.getInstance(i);
+        const glm::vec3 x0 = hit.hit() ? m_projectionRays.origins[i] + hit.t * m_projectionRays.directions[i] : copy.x0;
+        batch.add(x0, copy.direction, copy.f);
+    }
+}
+
+void Application::toInstanceSpace(const KelvinletBatch& world, const BVHInstance& instance, KelvinletBatch& local) const {
+    const glm::mat3 linear(instance.inverseTransform);
+    const float determinant = glm::determinant(linear);
+    // Local units per world unit. Non-uniform scales are approximated by the
+    // uniform one of the same volume, the brush stays round in local space.
+    const float scale = std::cbrt(std::fabs(determinant));
+    Kelvinlet shape = world.getShape();
+    shape.m_brush.epsilon *= scale;
+    shape.m_brush.epsilon2 *= scale;
+    shape.m_brush.epsilon3 *= scale;
+    shape.computeConstants();
+    local.clear();
+    local.setShape(shape);
+    // u scales as F / length for the grab brush and F / length^2 for the affine
+    // ones, the load keeps the displacement at scale times the world one
+    const bool grab = shape.m_brush.type == BrushType::Grab;
+    const float load = grab ? scale * scale : scale * scale * scale;
+    // The twist axis is a pseudovector, like in fillBrushBatch()
+    const float handedness = shape.m_brush.type == BrushType::Twist && determinant < 0.0f ? -1.0f : 1.0f;
+    for (size_t i = 0; i < world.size(); ++i) {
+        const BrushInstance& brush = world.getInstance(i);
+        // Only the orientation of the direction changes, its length is part of the load
+        glm::vec3 direction = linear * brush.direction;
+        const float length = glm::length(direction);
+        if (length > 0.0f) direction *= handedness * glm::length(brush.direction) / length;
+        local.add(glm::vec3(instance.inverseTransform * glm::vec4(brush.x0, 1.0f)), direction, brush.f * load);
+    }
+}
+
+void Application::updateStroke(double mouseX, double mouseY) {
+    const glm::vec3 origin = m_camera->getPosition();
+    if (m_kelvinlet->m_brush.type == BrushType::Grab) {
+        const glm::vec3 direction = screenPosToWorldRayDir(static_cast<float>(mouseX), static_cast<float>(mouseY));
+        const glm::vec3 normal = glm::normalize(m_strokeAnchor - origin);
+        const float denominator = glm::dot(direction, normal);
+        if (std::fabs(denominator) > 1e-6f) {
+            m_strokeTarget = origin + direction * (glm::dot(m_strokeAnchor - origin, normal) / denominator);
+        }
+        return;
+    }
+    const glm::vec3 hit = getRaycastHitPosition(static_cast<float>(mouseX), static_cast<float>(mouseY), origin);
+    if (!std::isnan(hit.x)) m_strokeTarget = hit;
+}
+
+bool Application::sculptStroke(float dt) {
+    if (!m_stroking) return false;
+    // Affine brushes keep acting while the cursor rests, the grab brush only moves along
+    if (m_kelvinlet->m_brush.type == BrushType::Grab && m_strokeTarget == m_strokeLast) return false;
+    // Copies are laid out in world space, then taken to the space of the mesh.
+    // Surface brushes project their copies too, the grab brush moves them off the surface.
+    const BVHInstance& instance = m_sceneBVH->getInstance(m_strokeInstance);
+    const bool project = m_kelvinlet->m_brush.type != BrushType::Grab;
+    fillBrushBatch(m_strokeLast, m_brushScratch, project);
+    toInstanceSpace(m_brushScratch, instance, m_strokeFrom);
+    fillBrushBatch(m_strokeTarget, m_brushScratch, project);
+    toInstanceSpace(m_brushScratch, instance, m_strokeTo);
+    m_modelDeformer->sculpt(m_strokeFrom, m_strokeTo, dt, instance.mesh, *m_threadPool);
+    m_strokeLast = m_strokeTarget;
+    return true;
+}
+
 void Application::sendKelvinletToShader() {
-    m_kelvinletsShader->use();
-    m_kelvinletsShader->setFloat("kelvinlet.brush.epsilon", m_kelvinlet->m_brush.epsilon);
-    m_kelvinletsShader->setFloat("kelvinlet.brush.f", m_kelvinlet->m_brush.f);
-    m_kelvinletsShader->setFloat("kelvinlet.a", m_kelvinlet->m_a);
-    m_kelvinletsShader->setFloat("kelvinlet.b", m_kelvinlet->m_b);
-    m_kelvinletsShader->setVec3("x0", glm::vec3(0.0f));
+    KelvinletUniforms uniforms = {};
+    uniforms.epsilons = m_kelvinlet->m_scaleEpsilons;
+    uniforms.weights = m_kelvinlet->m_scaleWeights;
+    uniforms.a = static_cast<float>(m_kelvinlet->m_a);
+    uniforms.b = static_cast<float>(m_kelvinlet->m_b);
+    // Positions deformed on the CPU are uploaded as is, the shader must not deform them again
+    KelvinletInstanceUniforms instances = {};
+    if (!m_cpuDeformation) {
+        const size_t count = std::min<size_t>(m_brushBatch.size(), MAX_GPU_BRUSHES);
+        const float tolerance = m_modelDeformer->getTolerance();
+        for (size_t i = 0; i < count; ++i) {
+            const float radius = m_brushBatch.getKelvinlet(i).influenceRadius(tolerance);
+            instances.instances[i] = KelvinletInstance{glm::vec4(m_brushBatch.getInstance(i).x0, radius), m_brushBatch.getLoad(i)};
+        }
+        uniforms.count = static_cast<int>(count);
+    }
+    m_kelvinletUniforms->set(uniforms);
+    m_kelvinletInstanceUniforms->set(instances);
+}
+
+Shader& Application::brushShader() {
+    const int type = static_cast<int>(m_kelvinlet->m_brush.type);
+    const int scales = m_kelvinlet->scaleCount();
+    // GPU brushes bend the frames of the vertex buffer unless they are left at rest
+    const int normals = m_modelDeformer->getNormalUpdate() != NormalUpdate::Rest ? 1 : 0;
+    std::unique_ptr<Shader>& shader = m_baseShaders[(normals * BRUSH_TYPE_COUNT + type) * MAX_BRUSH_SCALES + scales - 1];
+    if (!shader) {
+        // Each variant only evaluates the terms of its brush
+        const char* typeDefines[BRUSH_TYPE_COUNT] = {"", "#define BRUSH_TWIST\n", "#define BRUSH_SCALE\n", "#define BRUSH_PINCH\n"};
+        const std::string defines = typeDefines[type] + std::string("#define BRUSH_SCALES ") + std::to_string(scales) + "\n" +
+                                    "#define MAX_BRUSHES " + std::to_string(MAX_GPU_BRUSHES) + "\n" +
+                                    (normals ? "#define ANALYTIC_NORMALS\n" : "");
+        shader = std::make_unique<Shader>(Config::SHADER_PATH + "kelvinlets.vert", Config::SHADER_PATH + "base.frag", defines);
+        shader->bindUniformBlock("CameraBlock", UniformBinding::CAMERA);
+        shader->bindUniformBlock("KelvinletBlock", UniformBinding::KELVINLET);
+        shader->bindUniformBlock("KelvinletInstanceBlock", UniformBinding::KELVINLET_INSTANCES);
+    }
+    return *shader;
 }
 
 void Application::render() {
+    if (auto model = m_modelLoader->update(Config::UPLOAD_BUDGET_MS)) {
+        swapModel(std::move(model));
+    }
+    TextureCache::instance().collectGarbage();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    m_baseShader->use();
     m_viewMatrix = m_camera->getViewMatrix();
-    m_baseShader->setMat4("u_viewMatrix", m_viewMatrix);
-    m_baseShader->setMat4("u_projectionMatrix", m_projectionMatrix);
-    m_baseShader->setFloat("kelvinlet.brush.epsilon", m_kelvinlet->m_brush.epsilon);
-    m_baseShader->setFloat("kelvinlet.brush.f", m_kelvinlet->m_brush.f);
-    m_baseShader->setFloat("kelvinlet.a", m_kelvinlet->m_a);
-    m_baseShader->setFloat("kelvinlet.b", m_kelvinlet->m_b);
-    m_baseShader->setVec3("x0", glm::vec3(0.0f));
+    // The blocks are only re-uploaded when their content changed
+    m_cameraUniforms->set(CameraUniforms{m_viewMatrix, m_projectionMatrix});
+    const auto now = std::chrono::steady_clock::now();
+    const float dt = std::min(std::chrono::duration<float>(now - m_lastFrame).count(), 0.1f);
+    m_lastFrame = now;
+    // While sculpting the brush only shows through the rest pose it moves
+    if (m_sculptMode) {
+        m_brushBatch.clear();
+    }
+    else {
+        fillBrushBatch(m_brushCenter, m_brushBatch);
+    }
+    sendKelvinletToShader();
+    brushShader().use();
+    const bool sculpted = sculptStroke(dt);
+    if (m_cpuDeformation) {
+        m_threadPool->resetStats();
+        m_modelDeformer->apply(m_brushBatch, *m_threadPool);
+        m_modelDeformer->uploadPositions(*m_threadPool);
+        m_modelDeformer->refitHierarchies(*m_threadPool);
+        m_sceneBVH->refit();
+        m_cpuPositionsUploaded = true;
+    }
+    else if (m_cpuPositionsUploaded) {
+        // Back to GPU deformation, restore the rest pose in the vertex buffers
+        m_modelDeformer->resetToRestPose();
+        m_modelDeformer->uploadPositions(*m_threadPool);
+        m_modelDeformer->refitHierarchies(*m_threadPool);
+        m_sceneBVH->refit();
+        m_cpuPositionsUploaded = false;
+    }
+    else if (sculpted) {
+        m_modelDeformer->uploadPositions(*m_threadPool);
+        m_modelDeformer->refitHierarchies(*m_threadPool);
+        m_sceneBVH->refit();
+    }
     //m_pointGrid->drawGrid();
-    m_loadedModel->draw();
+    m_loadedModel->draw(brushShader());
     if (m_hasRayToDraw) {
         m_lineShader->use();
-        m_lineShader->setMat4("u_viewMatrix", m_viewMatrix);
-        m_lineShader->setMat4("u_projectionMatrix", m_projectionMatrix);
         m_ray->updateRay();
         m_ray->drawRay();
     }
@@ -146,62 +471,18 @@ glm::vec3 Application::screenPosToWorldRayDir(float mouseX, float mouseY) {
     return rayDir;
 }
 
-// Returns true if ray intersects triangle, and sets 'outT' to distance along ray
-bool Application::rayIntersectsTriangle(const glm::vec3& rayOrigin, const glm::vec3& rayDir, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& outT) {
-    const float EPSILON = 1e-8f;
-    glm::vec3 edge1 = v1 - v0;
-    glm::vec3 edge2 = v2 - v0;
-    glm::vec3 h = glm::cross(rayDir, edge2);
-    float a = glm::dot(edge1, h);
-    if (a > -EPSILON && a < EPSILON)
-        return false; // Ray is parallel to triangle
-
-    float f = 1.0f / a;
-    glm::vec3 s = rayOrigin - v0;
-    float u = f * glm::dot(s, h);
-    if (u < 0.0f || u > 1.0f)
-        return false;
-
-    glm::vec3 q = glm::cross(s, edge1);
-    float v = f * glm::dot(rayDir, q);
-    if (v < 0.0f || u + v > 1.0f)
-        return false;
-
-    // At this stage we can compute t to find out where the intersection point is on the line
-    float t = f * glm::dot(edge2, q);
-    if (t > EPSILON) // Ray intersection
-    {
-        outT = t;
-        return true;
-    }
-    else // No ray intersection
-        return false;
-}
-
 glm::vec3 Application::getRaycastHitPosition(float mouseX, float mouseY, const glm::vec3& rayOrigin) {
     glm::vec3 rayDir = screenPosToWorldRayDir(mouseX, mouseY);
     m_ray->m_origin = rayOrigin;
     m_ray->m_direction = rayDir;
-    glm::vec3 hitPosition;
-    float closestT = std::numeric_limits<float>::max();
-    bool hit = false;
-    for (const auto& entries : m_loadedModel->entries) {
-        auto& mesh = entries.mesh;
-        for (size_t i = 0; i < mesh->indices.size(); i += 3) {
-            glm::vec3 v0 = mesh->vertices[mesh->indices[i]].position;
-            glm::vec3 v1 = mesh->vertices[mesh->indices[i+1]].position;
-            glm::vec3 v2 = mesh->vertices[mesh->indices[i+2]].position;
-            float t;
-            if (rayIntersectsTriangle(rayOrigin, rayDir, v0, v1, v2, t)) {
-                if (t < closestT) {
-                    closestT = t;
-                    hitPosition = rayOrigin + t * rayDir;
-                    hit = true;
-                }
-            }
-        }
-    }
-    if (hit) return hitPosition;
+    auto start = std::chrono::steady_clock::now();
+    RayHit closest;
+    m_sceneBVH->intersect(rayOrigin, rayDir, closest);
+    auto end = std::chrono::steady_clock::now();
+    m_lastPickMs = std::chrono::duration<double, std::milli>(end - start).count();
+    m_lastHit = closest;
+    m_lastHitEntry = closest.hit() ? static_cast<int>(closest.instance) : -1;
+    if (closest.hit()) return rayOrigin + closest.t * rayDir;
     else return glm::vec3(std::numeric_limits<float>::quiet_NaN());
 }
 
@@ -223,10 +504,18 @@ void Application::mouseButtonCallback(GLFWwindow* window, int button, int action
             glfwGetCursorPos(window, &mouseX, &mouseY);
             app->m_ray->m_hitPosition = app->getRaycastHitPosition(mouseX, mouseY, app->m_camera->getPosition());
             std::cout << glm::to_string(app->m_ray->m_hitPosition) << std::endl;
+            if (app->m_sculptMode && !std::isnan(app->m_ray->m_hitPosition.x)) {
+                app->m_stroking = true;
+                app->m_strokeInstance = app->m_lastHit.instance;
+                app->m_strokeAnchor = app->m_ray->m_hitPosition;
+                app->m_strokeLast = app->m_strokeAnchor;
+                app->m_strokeTarget = app->m_strokeAnchor;
+            }
         }
     }
     if(button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
         app->m_camera->m_isDragging = false;
+        app->m_stroking = false;
     }
     if(button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse) {
         app->m_camera->m_isPanning = true;
@@ -241,6 +530,9 @@ void Application::cursorPosCallback(GLFWwindow* window, double xpos, double ypos
     auto app = static_cast<Application*>(glfwGetWindowUserPointer(window));
     app->m_camera->processDrag(xpos, ypos);
     app->m_camera->processPan(xpos, ypos);
+    if (app->m_stroking) {
+        app->updateStroke(xpos, ypos);
+    }
 }
 
 void Application::scrollCallback(GLFWwindow* window, [[maybe_unused]] double xoffset, double yoffset) {
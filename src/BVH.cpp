@@ -0,0 +1,352 @@
+#include <BVH.hpp>
+#include <ThreadPool.hpp>
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+
+namespace {
+    constexpr int MAX_DEPTH = 64;
+    constexpr float TRAVERSAL_COST = 1.0f;
+    constexpr size_t REFIT_GRAIN = 1024;
+}
+
+BVH::BVH() {}
+
+BVH::BVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    build(positions, indices);
+}
+
+void BVH::build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    m_nodes.clear();
+    m_bounds = AABB();
+    m_triangleIds.resize(triangleCount);
+    std::iota(m_triangleIds.begin(), m_triangleIds.end(), 0u);
+    m_triangleCount = triangleCount;
+    if (triangleCount == 0) {
+        m_packets.clear();
+        m_packetCorners.clear();
+        m_leaves.clear();
+        m_levels.clear();
+        m_buildCost = 0.0f;
+        m_cost = 0.0;
+        return;
+    }
+
+    std::vector<BuildTriangle> triangles(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; ++i) {
+        BuildTriangle& triangle = triangles[i];
+        for (int c = 0; c < 3; ++c) {
+            triangle.bounds.grow(positions[indices[3 * i + c]]);
+        }
+        triangle.centroid = 0.5f * (triangle.bounds.min + triangle.bounds.max);
+    }
+    m_nodes.reserve(2 * triangleCount / MAX_LEAF_TRIANGLES + 1);
+    buildRecursive(triangles, 0, triangleCount, 0);
+    m_bounds.min = m_nodes[0].boundsMin;
+    m_bounds.max = m_nodes[0].boundsMax;
+
+    buildPackets(positions, indices);
+    collectLevels();
+    m_cost = computeCost();
+    m_buildCost = getCost();
+}
+
+uint32_t BVH::packetCount(const BVHNode& leaf) const {
+    return (leaf.count + TrianglePacket::WIDTH - 1) / TrianglePacket::WIDTH;
+}
+
+// Leaves are visited in node order so packets follow the depth-first layout
+void BVH::buildPackets(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    m_packets.clear();
+    m_packetCorners.clear();
+    for (BVHNode& node : m_nodes) {
+        if (!node.isLeaf()) continue;
+        const uint32_t firstSlot = node.leftFirst;
+        node.leftFirst = static_cast<uint32_t>(m_packets.size());
+        for (uint32_t i = 0; i < node.count; ++i) {
+            const int lane = i % TrianglePacket::WIDTH;
+            if (lane == 0) {
+                m_packets.emplace_back();
+                m_packetCorners.resize(m_packetCorners.size() + 3 * TrianglePacket::WIDTH, TrianglePacket::INVALID_ID);
+            }
+            const uint32_t id = m_triangleIds[firstSlot + i];
+            uint32_t* corners = &m_packetCorners[3 * TrianglePacket::WIDTH * (m_packets.size() - 1) + 3 * lane];
+            for (int c = 0; c < 3; ++c) {
+                corners[c] = indices[3 * id + c];
+            }
+            m_packets.back().set(lane, positions[corners[0]], positions[corners[1]], positions[corners[2]], id);
+        }
+    }
+    m_triangleIds.clear();
+    m_triangleIds.shrink_to_fit();
+}
+
+void BVH::collectLevels() {
+    m_leaves.clear();
+    m_levels.clear();
+    m_refitted.assign(m_nodes.size(), 0);
+    std::vector<std::pair<uint32_t, uint32_t>> stack = {{0u, 0u}};
+    while (!stack.empty()) {
+        auto [nodeIndex, depth] = stack.back();
+        stack.pop_back();
+        const BVHNode& node = m_nodes[nodeIndex];
+        if (node.isLeaf()) {
+            m_leaves.push_back(nodeIndex);
+            continue;
+        }
+        if (m_levels.size() <= depth) m_levels.resize(depth + 1);
+        m_levels[depth].push_back(nodeIndex);
+        stack.push_back({nodeIndex + 1, depth + 1});
+        stack.push_back({node.leftFirst, depth + 1});
+    }
+}
+
+double BVH::nodeCost(const BVHNode& node) const {
+    AABB box;
+    box.min = node.boundsMin;
+    box.max = node.boundsMax;
+    return box.surfaceArea() * (node.isLeaf() ? static_cast<double>(node.count) : TRAVERSAL_COST);
+}
+
+double BVH::computeCost() const {
+    double cost = 0.0;
+    for (const BVHNode& node : m_nodes) {
+        cost += nodeCost(node);
+    }
+    return cost;
+}
+
+size_t BVH::refit(const PositionsSoA& positions, const AABB& region, ThreadPool& pool) {
+    if (m_nodes.empty()) return 0;
+    std::mutex costMutex;
+    double costDelta = 0.0;
+    std::atomic<size_t> refittedLeaves{0};
+
+    pool.parallelFor(0, m_leaves.size(), REFIT_GRAIN, [&](size_t first, size_t last) {
+        double localDelta = 0.0;
+        size_t localCount = 0;
+        for (size_t l = first; l < last; ++l) {
+            BVHNode& node = m_nodes[m_leaves[l]];
+            AABB old;
+            old.min = node.boundsMin;
+            old.max = node.boundsMax;
+            if (!old.overlaps(region)) {
+                m_refitted[m_leaves[l]] = 0;
+                continue;
+            }
+            AABB bounds;
+            for (uint32_t p = node.leftFirst; p < node.leftFirst + packetCount(node); ++p) {
+                const uint32_t* corners = &m_packetCorners[3 * TrianglePacket::WIDTH * p];
+                for (int lane = 0; lane < TrianglePacket::WIDTH; ++lane) {
+                    if (corners[3 * lane] == TrianglePacket::INVALID_ID) continue;
+                    const glm::vec3 p0 = positions.get(corners[3 * lane]);
+                    const glm::vec3 p1 = positions.get(corners[3 * lane + 1]);
+                    const glm::vec3 p2 = positions.get(corners[3 * lane + 2]);
+                    m_packets[p].set(lane, p0, p1, p2, m_packets[p].ids[lane]);
+                    bounds.grow(p0);
+                    bounds.grow(p1);
+                    bounds.grow(p2);
+                }
+            }
+            const double before = nodeCost(node);
+            node.boundsMin = bounds.min;
+            node.boundsMax = bounds.max;
+            localDelta += nodeCost(node) - before;
+            m_refitted[m_leaves[l]] = 1;
+            localCount++;
+        }
+        refittedLeaves.fetch_add(localCount, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(costMutex);
+        costDelta += localDelta;
+    });
+
+    for (size_t level = m_levels.size(); level-- > 0;) {
+        const std::vector<uint32_t>& nodes = m_levels[level];
+        pool.parallelFor(0, nodes.size(), REFIT_GRAIN, [&](size_t first, size_t last) {
+            double localDelta = 0.0;
+            for (size_t n = first; n < last; ++n) {
+                const uint32_t nodeIndex = nodes[n];
+                BVHNode& node = m_nodes[nodeIndex];
+                const uint32_t left = nodeIndex + 1;
+                const uint32_t right = node.leftFirst;
+                m_refitted[nodeIndex] = m_refitted[left] | m_refitted[right];
+                if (!m_refitted[nodeIndex]) continue;
+                const double before = nodeCost(node);
+                node.boundsMin = glm::min(m_nodes[left].boundsMin, m_nodes[right].boundsMin);
+                node.boundsMax = glm::max(m_nodes[left].boundsMax, m_nodes[right].boundsMax);
+                localDelta += nodeCost(node) - before;
+            }
+            std::lock_guard<std::mutex> lock(costMutex);
+            costDelta += localDelta;
+        });
+    }
+
+    m_cost += costDelta;
+    m_bounds.min = m_nodes[0].boundsMin;
+    m_bounds.max = m_nodes[0].boundsMax;
+    return refittedLeaves.load();
+}
+
+float BVH::getCost() const {
+    const float rootArea = m_bounds.surfaceArea();
+    return rootArea > 0.0f ? static_cast<float>(m_cost / rootArea) : 0.0f;
+}
+
+float BVH::getDegradation() const {
+    return m_buildCost > 0.0f ? getCost() / m_buildCost : 1.0f;
+}
+
+uint32_t BVH::buildRecursive(std::vector<BuildTriangle>& triangles, uint32_t first, uint32_t count, int depth) {
+    const uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    AABB bounds;
+    AABB centroidBounds;
+    for (uint32_t i = first; i < first + count; ++i) {
+        const BuildTriangle& triangle = triangles[m_triangleIds[i]];
+        bounds.grow(triangle.bounds);
+        centroidBounds.grow(triangle.centroid);
+    }
+    m_nodes[nodeIndex].boundsMin = bounds.min;
+    m_nodes[nodeIndex].boundsMax = bounds.max;
+
+    auto makeLeaf = [&]() {
+        m_nodes[nodeIndex].leftFirst = first;
+        m_nodes[nodeIndex].count = count;
+        return nodeIndex;
+    };
+    if (count <= MAX_LEAF_TRIANGLES || depth >= MAX_DEPTH) return makeLeaf();
+
+    int axis;
+    float position;
+    float splitCost;
+    uint32_t middle = first;
+    if (findSplit(triangles, first, count, centroidBounds, axis, position, splitCost)) {
+        const float leafCost = count * bounds.surfaceArea();
+        if (splitCost + TRAVERSAL_COST * bounds.surfaceArea() >= leafCost && count <= 4 * MAX_LEAF_TRIANGLES) return makeLeaf();
+        auto it = std::partition(m_triangleIds.begin() + first, m_triangleIds.begin() + first + count, [&](uint32_t id) {
+            return triangles[id].centroid[axis] < position;
+        });
+        middle = static_cast<uint32_t>(it - m_triangleIds.begin());
+    }
+    if (middle == first || middle == first + count) {
+        // Degenerate centroids, fall back to an object median split
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        middle = first + count / 2;
+        std::nth_element(m_triangleIds.begin() + first, m_triangleIds.begin() + middle, m_triangleIds.begin() + first + count, [&](uint32_t lhs, uint32_t rhs) {
+            return triangles[lhs].centroid[axis] < triangles[rhs].centroid[axis];
+        });
+    }
+
+    buildRecursive(triangles, first, middle - first, depth + 1);
+    const uint32_t right = buildRecursive(triangles, middle, first + count - middle, depth + 1);
+    m_nodes[nodeIndex].leftFirst = right;
+    m_nodes[nodeIndex].count = 0;
+    return nodeIndex;
+}
+
+bool BVH::findSplit(const std::vector<BuildTriangle>& triangles, uint32_t first, uint32_t count, const AABB& centroidBounds, int& axis, float& position, float& cost) const {
+    struct Bin {
+        AABB bounds;
+        uint32_t count = 0;
+    };
+    bool found = false;
+    cost = std::numeric_limits<float>::max();
+    for (int a = 0; a < 3; ++a) {
+        const float lo = centroidBounds.min[a];
+        const float hi = centroidBounds.max[a];
+        if (hi <= lo) continue;
+        Bin bins[SAH_BINS];
+        const float scale = SAH_BINS / (hi - lo);
+        for (uint32_t i = first; i < first + count; ++i) {
+            const BuildTriangle& triangle = triangles[m_triangleIds[i]];
+            int b = std::min(SAH_BINS - 1, static_cast<int>((triangle.centroid[a] - lo) * scale));
+            bins[b].count++;
+            bins[b].bounds.grow(triangle.bounds);
+        }
+        // Sweep from both sides to evaluate the SAH at every bin boundary
+        float leftArea[SAH_BINS - 1];
+        uint32_t leftCount[SAH_BINS - 1];
+        AABB leftBox;
+        uint32_t leftSum = 0;
+        for (int b = 0; b < SAH_BINS - 1; ++b) {
+            leftSum += bins[b].count;
+            leftBox.grow(bins[b].bounds);
+            leftCount[b] = leftSum;
+            leftArea[b] = leftBox.surfaceArea();
+        }
+        AABB rightBox;
+        uint32_t rightSum = 0;
+        for (int b = SAH_BINS - 1; b > 0; --b) {
+            rightSum += bins[b].count;
+            rightBox.grow(bins[b].bounds);
+            const float planeCost = leftCount[b - 1] * leftArea[b - 1] + rightSum * rightBox.surfaceArea();
+            if (leftCount[b - 1] > 0 && rightSum > 0 && planeCost < cost) {
+                cost = planeCost;
+                axis = a;
+                position = lo + b / scale;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool BVH::intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const {
+    if (m_nodes.empty()) return false;
+    const glm::vec3 invDirection = 1.0f / direction;
+    bool found = false;
+    uint32_t stack[MAX_DEPTH + 1];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    if (intersectNode(m_nodes[0], origin, invDirection, hit.t) == std::numeric_limits<float>::infinity()) return false;
+    while (true) {
+        const BVHNode& node = m_nodes[nodeIndex];
+        if (node.isLeaf()) {
+            for (uint32_t p = node.leftFirst; p < node.leftFirst + packetCount(node); ++p) {
+                found |= intersectTrianglePacket(m_packets[p], origin, direction, hit);
+            }
+        }
+        else {
+            uint32_t near = nodeIndex + 1;
+            uint32_t far = node.leftFirst;
+            float tNear = intersectNode(m_nodes[near], origin, invDirection, hit.t);
+            float tFar = intersectNode(m_nodes[far], origin, invDirection, hit.t);
+            if (tFar < tNear) {
+                std::swap(near, far);
+                std::swap(tNear, tFar);
+            }
+            if (tNear != std::numeric_limits<float>::infinity()) {
+                if (tFar != std::numeric_limits<float>::infinity()) {
+                    stack[stackSize++] = far;
+                }
+                nodeIndex = near;
+                continue;
+            }
+        }
+        // Pop the next node that can still beat the current closest hit
+        bool popped = false;
+        while (stackSize > 0) {
+            nodeIndex = stack[--stackSize];
+            if (intersectNode(m_nodes[nodeIndex], origin, invDirection, hit.t) != std::numeric_limits<float>::infinity()) {
+                popped = true;
+                break;
+            }
+        }
+        if (!popped) break;
+    }
+    return found;
+}
+
+const AABB& BVH::getBounds() const {
+    return m_bounds;
+}
+
+size_t BVH::getNodeCount() const {
+    return m_nodes.size();
+}
+
+size_t BVH::getTriangleCount() const {
+    return m_triangleCount;
+}
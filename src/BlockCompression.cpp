@@ -0,0 +1,274 @@
+#include <BlockCompression.hpp>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+namespace {
+    // Any channel count to RGBA8, grey stays grey
+    std::vector<uint8_t> expandToRGBA(const uint8_t* pixels, size_t texels, int channels) {
+        std::vector<uint8_t> rgba(texels * 4);
+        for (size_t i = 0; i < texels; ++i) {
+            const uint8_t* in = pixels + i * channels;
+            uint8_t* out = &rgba[i * 4];
+            switch (channels) {
+                case 1: out[0] = out[1] = out[2] = in[0]; out[3] = 255; break;
+                case 2: out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+                case 3: out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255; break;
+                default: out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = in[3]; break;
+            }
+        }
+        return rgba;
+    }
+
+    std::vector<uint8_t> downsample(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height, bool normalMap) {
+        const uint32_t w = std::max(1u, width / 2);
+        const uint32_t h = std::max(1u, height / 2);
+        std::vector<uint8_t> next(static_cast<size_t>(w) * h * 4);
+        for (uint32_t y = 0; y < h; ++y) {
+            const uint32_t y0 = std::min(2 * y, height - 1);
+            const uint32_t y1 = std::min(2 * y + 1, height - 1);
+            for (uint32_t x = 0; x < w; ++x) {
+                const uint32_t x0 = std::min(2 * x, width - 1);
+                const uint32_t x1 = std::min(2 * x + 1, width - 1);
+                const uint8_t* texels[4] = {
+                    &rgba[(static_cast<size_t>(y0) * width + x0) * 4], &rgba[(static_cast<size_t>(y0) * width + x1) * 4],
+                    &rgba[(static_cast<size_t>(y1) * width + x0) * 4], &rgba[(static_cast<size_t>(y1) * width + x1) * 4]
+                };
+                uint8_t* out = &next[(static_cast<size_t>(y) * w + x) * 4];
+                if (normalMap) {
+                    // Averaged normals get shorter, the filtered one is renormalized
+                    glm::vec3 sum(0.0f);
+                    for (const uint8_t* t : texels) {
+                        sum += glm::vec3(t[0], t[1], t[2]) / 127.5f - 1.0f;
+                    }
+                    const float length = glm::length(sum);
+                    const glm::vec3 n = length > 0.0f ? sum / length : glm::vec3(0.0f, 0.0f, 1.0f);
+                    for (int c = 0; c < 3; ++c) {
+                        out[c] = static_cast<uint8_t>(std::lround((n[c] + 1.0f) * 127.5f));
+                    }
+                    out[3] = 255;
+                }
+                else {
+                    for (int c = 0; c < 4; ++c) {
+                        out[c] = static_cast<uint8_t>((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+                    }
+                }
+            }
+        }
+        return next;
+    }
+
+    uint16_t packRGB565(const glm::vec3& color) {
+        const glm::vec3 c = glm::clamp(color, 0.0f, 255.0f);
+        const uint16_t r = static_cast<uint16_t>(std::lround(c.r * 31.0f / 255.0f));
+        const uint16_t g = static_cast<uint16_t>(std::lround(c.g * 63.0f / 255.0f));
+        const uint16_t b = static_cast<uint16_t>(std::lround(c.b * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    glm::vec3 unpackRGB565(uint16_t packed) {
+        const int r = (packed >> 11) & 31;
+        const int g = (packed >> 5) & 63;
+        const int b = packed & 31;
+        return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+    }
+
+    // Nearest palette entry per texel, returns the squared error
+    float selectIndices(const glm::vec3* colors, uint16_t c0, uint16_t c1, uint32_t& indices) {
+        const glm::vec3 e0 = unpackRGB565(c0);
+        const glm::vec3 e1 = unpackRGB565(c1);
+        const glm::vec3 palette[4] = {e0, e1, (2.0f * e0 + e1) / 3.0f, (e0 + 2.0f * e1) / 3.0f};
+        indices = 0;
+        float error = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            uint32_t best = 0;
+            float bestDistance = INFINITY;
+            for (uint32_t p = 0; p < 4; ++p) {
+                const glm::vec3 d = colors[i] - palette[p];
+                const float distance = glm::dot(d, d);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (2 * i);
+            error += bestDistance;
+        }
+        return error;
+    }
+
+    // Least squares endpoints for fixed indices, false when they are degenerate
+    bool refitEndpoints(const glm::vec3* colors, uint32_t indices, glm::vec3& e0, glm::vec3& e1) {
+        static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        glm::vec3 ac(0.0f), bc(0.0f);
+        for (int i = 0; i < 16; ++i) {
+            const float a = weights[(indices >> (2 * i)) & 3];
+            const float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            ac += a * colors[i];
+            bc += b * colors[i];
+        }
+        const float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f) return false;
+        e0 = (ac * bb - bc * ab) / determinant;
+        e1 = (bc * aa - ac * ab) / determinant;
+        return true;
+    }
+
+    void writeLE16(uint8_t* out, uint16_t value) {
+        out[0] = static_cast<uint8_t>(value);
+        out[1] = static_cast<uint8_t>(value >> 8);
+    }
+}
+
+size_t blockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t compressedLevelSize(BlockFormat format, uint32_t width, uint32_t height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+BlockFormat chooseBlockFormat(int channels, bool normalMap) {
+    if (normalMap) return BlockFormat::BC5;
+    if (channels == 1) return BlockFormat::BC4;
+    if (channels == 3) return BlockFormat::BC1;
+    return BlockFormat::BC3;
+}
+
+void encodeBC1Block(const uint8_t* rgba, uint8_t* out) {
+    // Endpoints on the principal axis of the colors
+    glm::vec3 colors[16];
+    glm::vec3 mean(0.0f);
+    for (int i = 0; i < 16; ++i) {
+        colors[i] = glm::vec3(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]);
+        mean += colors[i];
+    }
+    mean /= 16.0f;
+    glm::mat3 covariance(0.0f);
+    for (const glm::vec3& color : colors) {
+        const glm::vec3 d = color - mean;
+        covariance += glm::outerProduct(d, d);
+    }
+    glm::vec3 axis(1.0f);
+    for (int i = 0; i < 8; ++i) {
+        const glm::vec3 next = covariance * axis;
+        const float length = glm::length(next);
+        if (length < 1e-6f) break;
+        axis = next / length;
+    }
+    if (glm::length(covariance * axis) < 1e-6f) axis = glm::vec3(0.0f);
+    float tMin = 0.0f;
+    float tMax = 0.0f;
+    for (const glm::vec3& color : colors) {
+        const float t = glm::dot(color - mean, axis);
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    uint16_t c0 = packRGB565(mean + axis * tMax);
+    uint16_t c1 = packRGB565(mean + axis * tMin);
+    // c0 > c1 selects the four color mode, BC3 assumes it anyway
+    if (c0 < c1) std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        float error = selectIndices(colors, c0, c1, indices);
+        // One refinement pass, kept only if it lowers the error
+        glm::vec3 e0, e1;
+        if (refitEndpoints(colors, indices, e0, e1)) {
+            uint16_t r0 = packRGB565(e0);
+            uint16_t r1 = packRGB565(e1);
+            if (r0 < r1) std::swap(r0, r1);
+            uint32_t refitIndices;
+            if (r0 != r1 && selectIndices(colors, r0, r1, refitIndices) < error) {
+                c0 = r0;
+                c1 = r1;
+                indices = refitIndices;
+            }
+        }
+    }
+    writeLE16(out, c0);
+    writeLE16(out + 2, c1);
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+void encodeBC4Block(const uint8_t* rgba, int channel, uint8_t* out) {
+    int lo = 255;
+    int hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, static_cast<int>(rgba[i * 4 + channel]));
+        hi = std::max(hi, static_cast<int>(rgba[i * 4 + channel]));
+    }
+    // hi > lo selects the eight value mode: hi, lo, then six steps from hi to lo
+    out[0] = static_cast<uint8_t>(hi);
+    out[1] = static_cast<uint8_t>(lo);
+    uint64_t indices = 0;
+    if (hi != lo) {
+        for (int i = 0; i < 16; ++i) {
+            const int step = (2 * 7 * (rgba[i * 4 + channel] - lo) + (hi - lo)) / (2 * (hi - lo));
+            const uint64_t index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+            indices |= index << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+void encodeBC3Block(const uint8_t* rgba, uint8_t* out) {
+    encodeBC4Block(rgba, 3, out);
+    encodeBC1Block(rgba, out + 8);
+}
+
+void encodeBC5Block(const uint8_t* rgba, uint8_t* out) {
+    encodeBC4Block(rgba, 0, out);
+    encodeBC4Block(rgba, 1, out + 8);
+}
+
+CompressedImage compressImage(const uint8_t* pixels, uint32_t width, uint32_t height, int channels, BlockFormat format, bool normalMap) {
+    CompressedImage image;
+    image.format = format;
+    std::vector<uint8_t> level = expandToRGBA(pixels, static_cast<size_t>(width) * height, channels);
+    uint32_t w = width;
+    uint32_t h = height;
+    while (true) {
+        CompressedLevel info;
+        info.offset = image.data.size();
+        info.size = compressedLevelSize(format, w, h);
+        info.width = w;
+        info.height = h;
+        image.levels.push_back(info);
+        image.data.resize(info.offset + info.size);
+
+        uint8_t* block = image.data.data() + info.offset;
+        uint8_t texels[16 * 4];
+        for (uint32_t by = 0; by < h; by += 4) {
+            for (uint32_t bx = 0; bx < w; bx += 4) {
+                // Edge blocks repeat the last row and column
+                for (uint32_t y = 0; y < 4; ++y) {
+                    for (uint32_t x = 0; x < 4; ++x) {
+                        const size_t source = static_cast<size_t>(std::min(by + y, h - 1)) * w + std::min(bx + x, w - 1);
+                        std::copy_n(&level[source * 4], 4, &texels[(y * 4 + x) * 4]);
+                    }
+                }
+                switch (format) {
+                    case BlockFormat::BC1: encodeBC1Block(texels, block); break;
+                    case BlockFormat::BC3: encodeBC3Block(texels, block); break;
+                    case BlockFormat::BC4: encodeBC4Block(texels, 0, block); break;
+                    case BlockFormat::BC5: encodeBC5Block(texels, block); break;
+                }
+                block += blockBytes(format);
+            }
+        }
+        if (w == 1 && h == 1) break;
+        level = downsample(level, w, h, normalMap);
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+    }
+    return image;
+}
@@ -1,5 +1,7 @@
 #define _USE_MATH_DEFINES
 #include <Kelvinlet.hpp>
+#include <algorithm>
+#include <cmath>
 
 Kelvinlet::Kelvinlet() {
     m_brush = Brush();
@@ -15,4 +17,178 @@ Kelvinlet::~Kelvinlet() {}
 void Kelvinlet::computeConstants() {
     m_a = 1.0f / (4.0f * M_PI * m_brush.mu);
     m_b = m_a / (4.0f * (1.0f - m_brush.nu));
-}
\ No newline at end of file
+    const float e1 = m_brush.epsilon;
+    const float e2 = m_brush.epsilon2;
+    const float e3 = m_brush.epsilon3;
+    m_scaleEpsilons = glm::vec3(e1, e2, e3);
+    m_scaleWeights = glm::vec3(1.0f, 0.0f, 0.0f);
+    const float denominator = e3 * e3 - e2 * e2;
+    if (scaleCount() == 3 && std::fabs(denominator) > 1e-12f) {
+        // Cancels the 1/r and 1/r^3 far field terms, the bi-scale only the 1/r one
+        m_scaleWeights = glm::vec3(1.0f, -(e3 * e3 - e1 * e1) / denominator, (e2 * e2 - e1 * e1) / denominator);
+    }
+    else if (scaleCount() >= 2) {
+        m_scaleWeights = glm::vec3(1.0f, -1.0f, 0.0f);
+    }
+}
+
+int Kelvinlet::scaleCount() const {
+    return std::clamp(m_brush.scales, 1, MAX_BRUSH_SCALES);
+}
+
+glm::vec3 Kelvinlet::force() const {
+    return m_brush.f * m_brush.direction;
+}
+
+glm::mat3 Kelvinlet::affineLoad() const {
+    const glm::vec3 q = m_brush.f * m_brush.direction;
+    switch (m_brush.type) {
+        case BrushType::Twist:
+            // Columns of [q]x, so that F r = q x r
+            return glm::mat3(0.0f, q.z, -q.y, -q.z, 0.0f, q.x, q.y, -q.x, 0.0f);
+        case BrushType::Scale:
+            return glm::mat3(m_brush.f);
+        case BrushType::Pinch: {
+            const float length = glm::length(m_brush.direction);
+            const glm::vec3 d = length > 0.0f ? m_brush.direction / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            return m_brush.f * (glm::outerProduct(d, d) - glm::mat3(1.0f / 3.0f));
+        }
+        default:
+            return glm::mat3(0.0f);
+    }
+}
+
+glm::vec3 Kelvinlet::displacement(const glm::vec3& r) const {
+    glm::vec3 u(0.0f);
+    for (int s = 0; s < scaleCount(); ++s) {
+        u += m_scaleWeights[s] * singleScaleDisplacement(r, m_scaleEpsilons[s]);
+    }
+    return u;
+}
+
+glm::vec3 Kelvinlet::singleScaleDisplacement(const glm::vec3& r, float epsilon) const {
+    const float a = static_cast<float>(m_a);
+    const float b = static_cast<float>(m_b);
+    const float eps2 = epsilon * epsilon;
+    const float rEpsilon = std::max(std::sqrt(glm::dot(r, r) + eps2), 0.0001f);
+    const float invR = 1.0f / rEpsilon;
+    const float invR3 = invR * invR * invR;
+    if (m_brush.type == BrushType::Grab) {
+        const glm::vec3 F = force();
+        // u = [(a - b)/re I + b/re^3 r r^T + a/2 eps^2/re^3 I] F
+        const float A = (a - b) * invR + 0.5f * a * eps2 * invR3;
+        const float B = b * invR3;
+        return A * F + (B * glm::dot(r, F)) * r;
+    }
+    // Affine load F: u = -a (1/re^3 + 3/2 eps^2/re^5) F r
+    //                    + b [1/re^3 (F + F^T + tr(F) I) r - 3/re^5 (r^T F r) r]
+    const glm::mat3 F = affineLoad();
+    const float invR5 = invR3 * invR * invR;
+    const float w = invR3 + 1.5f * eps2 * invR5;
+    const glm::mat3 symmetric = F + glm::transpose(F) + glm::mat3(F[0][0] + F[1][1] + F[2][2]);
+    return -a * w * (F * r) + b * (invR3 * (symmetric * r) - 3.0f * invR5 * glm::dot(r, F * r) * r);
+}
+
+glm::mat3 Kelvinlet::gradient(const glm::vec3& r) const {
+    glm::mat3 g(0.0f);
+    for (int s = 0; s < scaleCount(); ++s) {
+        g += m_scaleWeights[s] * singleScaleGradient(r, m_scaleEpsilons[s]);
+    }
+    return g;
+}
+
+// Same terms as singleScaleDisplacement(), with d(1/re^n)/dr = -n/re^(n+2) r
+glm::mat3 Kelvinlet::singleScaleGradient(const glm::vec3& r, float epsilon) const {
+    const float a = static_cast<float>(m_a);
+    const float b = static_cast<float>(m_b);
+    const float eps2 = epsilon * epsilon;
+    const float rEpsilon = std::max(std::sqrt(glm::dot(r, r) + eps2), 0.0001f);
+    const float invR = 1.0f / rEpsilon;
+    const float invR3 = invR * invR * invR;
+    const float invR5 = invR3 * invR * invR;
+    const float invR7 = invR5 * invR * invR;
+    if (m_brush.type == BrushType::Grab) {
+        const glm::vec3 F = force();
+        const float rF = glm::dot(r, F);
+        const float B = b * invR3;
+        const glm::vec3 gradA = (-(a - b) * invR3 - 1.5f * a * eps2 * invR5) * r;
+        const glm::vec3 gradB = -3.0f * b * invR5 * r;
+        return glm::outerProduct(F, gradA) + glm::outerProduct(r, rF * gradB + B * F) + glm::mat3(B * rF);
+    }
+    const glm::mat3 F = affineLoad();
+    const glm::vec3 Fr = F * r;
+    const float rFr = glm::dot(r, Fr);
+    const float w = invR3 + 1.5f * eps2 * invR5;
+    const glm::vec3 gradW = (-3.0f * invR5 - 7.5f * eps2 * invR7) * r;
+    const glm::mat3 symmetric = F + glm::transpose(F) + glm::mat3(F[0][0] + F[1][1] + F[2][2]);
+    const glm::vec3 gradQ = -5.0f * invR7 * rFr * r + invR5 * ((F + glm::transpose(F)) * r);
+    return -a * (glm::outerProduct(Fr, gradW) + w * F)
+        + b * (glm::outerProduct(symmetric * r, -3.0f * invR5 * r) + invR3 * symmetric
+               - 3.0f * (glm::outerProduct(r, gradQ) + glm::mat3(invR5 * rFr)));
+}
+
+float Kelvinlet::boundNumerator() const {
+    const float a = static_cast<float>(m_a);
+    const float b = static_cast<float>(m_b);
+    const float f = std::fabs(m_brush.f);
+    // With r <= r_eps and eps <= r_eps, r (1/re^3 + 3/2 eps^2/re^5) <= 2.5 / re^2
+    switch (m_brush.type) {
+        case BrushType::Twist:
+            return 2.5f * a * f * glm::length(m_brush.direction);
+        case BrushType::Scale:
+            return 2.5f * std::fabs(2.0f * b - a) * f;
+        case BrushType::Pinch:
+            // ||F|| = 2/3 |f|, the two b terms add at most 5 b ||F|| / r_eps^2
+            return (2.5f * a + 5.0f * b) * (2.0f / 3.0f) * f;
+        default:
+            return 1.5f * a * glm::length(force());
+    }
+}
+
+// With a - b >= 0, b <= a and eps <= r_eps every term of u is bounded by a
+// multiple of |F| / r_eps (grab) or ||F|| / r_eps^2 (affine brushes). Scales
+// add up with the magnitude of their weight.
+float Kelvinlet::maxDisplacement() const {
+    float bound = 0.0f;
+    for (int s = 0; s < scaleCount(); ++s) {
+        const float epsilon = std::max(m_scaleEpsilons[s], 0.0001f);
+        const float scale = boundNumerator() / epsilon;
+        bound += std::fabs(m_scaleWeights[s]) * (m_brush.type == BrushType::Grab ? scale : scale / epsilon);
+    }
+    return bound;
+}
+
+// Every r_eps is at least the one of the smallest epsilon
+float Kelvinlet::influenceRadius(float tolerance) const {
+    float weights = 0.0f;
+    float epsilon = m_scaleEpsilons[0];
+    for (int s = 0; s < scaleCount(); ++s) {
+        weights += std::fabs(m_scaleWeights[s]);
+        epsilon = std::min(epsilon, m_scaleEpsilons[s]);
+    }
+    float rEpsilon = weights * boundNumerator() / tolerance;
+    if (m_brush.type != BrushType::Grab) rEpsilon = std::sqrt(rEpsilon);
+    return std::sqrt(std::max(rEpsilon * rEpsilon - epsilon * epsilon, 0.0f));
+}
+
+// At r = 0, u = sum of w ((a - b)/eps + a/(2 eps)) F = sum of w (3/2 a - b)/eps F
+float Kelvinlet::grabForce(float distance) const {
+    const float a = static_cast<float>(m_a);
+    const float b = static_cast<float>(m_b);
+    float perForce = 0.0f;
+    for (int s = 0; s < scaleCount(); ++s) {
+        perForce += m_scaleWeights[s] * (1.5f * a - b) / std::max(m_scaleEpsilons[s], 0.0001f);
+    }
+    if (std::fabs(perForce) < 1e-12f) return 0.0f;
+    return distance / perForce;
+}
+
+const char* Kelvinlet::typeName(BrushType type) {
+    switch (type) {
+        case BrushType::Grab: return "Grab";
+        case BrushType::Twist: return "Twist";
+        case BrushType::Scale: return "Scale";
+        case BrushType::Pinch: return "Pinch";
+    }
+    return "Unknown";
+}
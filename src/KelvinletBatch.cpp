@@ -0,0 +1,104 @@
+#include <KelvinletBatch.hpp>
+
+KelvinletBatch::KelvinletBatch() {}
+
+KelvinletBatch::KelvinletBatch(const Kelvinlet& shape) : m_shape(shape) {}
+
+void KelvinletBatch::setShape(const Kelvinlet& shape) {
+    m_shape = shape;
+    const std::vector<BrushInstance> instances = std::move(m_instances);
+    clear();
+    for (const BrushInstance& instance : instances) {
+        add(instance.x0, instance.direction, instance.f);
+    }
+}
+
+void KelvinletBatch::clear() {
+    m_instances.clear();
+    m_streams = BrushStreams();
+}
+
+void KelvinletBatch::add(const glm::vec3& x0) {
+    add(x0, m_shape.m_brush.direction, m_shape.m_brush.f);
+}
+
+void KelvinletBatch::add(const glm::vec3& x0, const glm::vec3& direction, float f) {
+    m_instances.push_back(BrushInstance{x0, direction, f});
+    pushLoad(m_instances.back());
+}
+
+glm::vec4 KelvinletBatch::computeLoad(const BrushInstance& instance) const {
+    const float a = static_cast<float>(m_shape.m_a);
+    const float b = static_cast<float>(m_shape.m_b);
+    switch (m_shape.m_brush.type) {
+        case BrushType::Twist:
+            return glm::vec4(-a * instance.f * instance.direction, 0.0f);
+        case BrushType::Scale:
+            return glm::vec4(0.0f, 0.0f, 0.0f, (2.0f * b - a) * instance.f);
+        case BrushType::Pinch: {
+            const float length = glm::length(instance.direction);
+            const glm::vec3 d = length > 0.0f ? instance.direction / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            return glm::vec4(d, instance.f);
+        }
+        default:
+            return glm::vec4(instance.f * instance.direction, 0.0f);
+    }
+}
+
+void KelvinletBatch::pushLoad(const BrushInstance& instance) {
+    const glm::vec4 load = computeLoad(instance);
+    m_streams.x0.push_back(instance.x0.x);
+    m_streams.y0.push_back(instance.x0.y);
+    m_streams.z0.push_back(instance.x0.z);
+    m_streams.lx.push_back(load.x);
+    m_streams.ly.push_back(load.y);
+    m_streams.lz.push_back(load.z);
+    m_streams.lw.push_back(load.w);
+}
+
+size_t KelvinletBatch::size() const {
+    return m_instances.size();
+}
+
+bool KelvinletBatch::empty() const {
+    return m_instances.empty();
+}
+
+const Kelvinlet& KelvinletBatch::getShape() const {
+    return m_shape;
+}
+
+const BrushInstance& KelvinletBatch::getInstance(size_t i) const {
+    return m_instances[i];
+}
+
+Kelvinlet KelvinletBatch::getKelvinlet(size_t i) const {
+    Kelvinlet kelvinlet = m_shape;
+    kelvinlet.m_brush.direction = m_instances[i].direction;
+    kelvinlet.m_brush.f = m_instances[i].f;
+    return kelvinlet;
+}
+
+glm::vec4 KelvinletBatch::getLoad(size_t i) const {
+    return glm::vec4(m_streams.lx[i], m_streams.ly[i], m_streams.lz[i], m_streams.lw[i]);
+}
+
+const BrushStreams& KelvinletBatch::getStreams() const {
+    return m_streams;
+}
+
+glm::vec3 KelvinletBatch::displacement(const glm::vec3& p) const {
+    glm::vec3 u(0.0f);
+    for (size_t i = 0; i < size(); ++i) {
+        u += getKelvinlet(i).displacement(p - m_instances[i].x0);
+    }
+    return u;
+}
+
+glm::mat3 KelvinletBatch::gradient(const glm::vec3& p) const {
+    glm::mat3 g(0.0f);
+    for (size_t i = 0; i < size(); ++i) {
+        g += getKelvinlet(i).gradient(p - m_instances[i].x0);
+    }
+    return g;
+}
@@ -0,0 +1,1025 @@
+#include <KelvinletDeformer.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include <Simd.hpp>
+
+namespace {
+
+// Shape constants shared by every instance and lane, precomputed once per
+// call. Per scale values are premultiplied by the weight of their scale.
+struct KernelParams {
+    float eps2[MAX_BRUSH_SCALES];
+    float weight[MAX_BRUSH_SCALES];
+    // Grab brush: u = [(a - b)/re + a/2 eps^2/re^3] F + b/re^3 (r.F) r
+    float aMinusB[MAX_BRUSH_SCALES];
+    float halfAEps2[MAX_BRUSH_SCALES];
+    float b[MAX_BRUSH_SCALES];
+    // Affine brushes: w = 1/re^3 + 3/2 eps^2/re^5
+    float threeHalfEps2[MAX_BRUSH_SCALES];
+    float a;
+    float twoB;
+    float threeB;
+};
+
+KernelParams makeParams(const Kelvinlet& kelvinlet) {
+    const float a = static_cast<float>(kelvinlet.m_a);
+    const float b = static_cast<float>(kelvinlet.m_b);
+    KernelParams k = {};
+    for (int s = 0; s < MAX_BRUSH_SCALES; ++s) {
+        const float eps2 = kelvinlet.m_scaleEpsilons[s] * kelvinlet.m_scaleEpsilons[s];
+        const float weight = kelvinlet.m_scaleWeights[s];
+        k.eps2[s] = eps2;
+        k.weight[s] = weight;
+        k.aMinusB[s] = weight * (a - b);
+        k.halfAEps2[s] = weight * 0.5f * a * eps2;
+        k.b[s] = weight * b;
+        k.threeHalfEps2[s] = weight * 1.5f * eps2;
+    }
+    k.a = a;
+    k.twoB = 2.0f * b;
+    k.threeB = 3.0f * b;
+    return k;
+}
+
+constexpr float MIN_R_EPSILON = 0.0001f;
+
+// Every kernel is instantiated per brush type and scale count. Scales only
+// add radial terms: r, |r|^2 and the r.F / F r products are computed once.
+// Instances are streamed over a block of vertices held in registers and
+// their displacements accumulated.
+template <BrushType T, int Scales>
+void accumulateScalar(const KernelParams& k, const BrushStreams& brushes, uint32_t j, float x, float y, float z, float& ux, float& uy, float& uz) {
+    const float rx = x - brushes.x0[j];
+    const float ry = y - brushes.y0[j];
+    const float rz = z - brushes.z0[j];
+    const float r2 = rx * rx + ry * ry + rz * rz;
+    // Grab: A and B, affine: w, sum of 1/re^3 and sum of 1/re^5
+    float A = 0.0f, B = 0.0f;
+    float w = 0.0f, s3 = 0.0f, s5 = 0.0f;
+    for (int s = 0; s < Scales; ++s) {
+        const float re = std::max(std::sqrt(r2 + k.eps2[s]), MIN_R_EPSILON);
+        const float invR = 1.0f / re;
+        const float invR3 = invR * invR * invR;
+        if constexpr (T == BrushType::Grab) {
+            A += k.aMinusB[s] * invR + k.halfAEps2[s] * invR3;
+            B += k.b[s] * invR3;
+        }
+        else {
+            const float invR5 = invR3 * invR * invR;
+            w += k.weight[s] * invR3 + k.threeHalfEps2[s] * invR5;
+            if constexpr (T == BrushType::Pinch) {
+                s3 += k.weight[s] * invR3;
+                s5 += k.weight[s] * invR5;
+            }
+        }
+    }
+    const float lx = brushes.lx[j];
+    const float ly = brushes.ly[j];
+    const float lz = brushes.lz[j];
+    if constexpr (T == BrushType::Grab) {
+        const float BrF = B * (rx * lx + ry * ly + rz * lz);
+        ux += A * lx + BrF * rx;
+        uy += A * ly + BrF * ry;
+        uz += A * lz + BrF * rz;
+    }
+    else if constexpr (T == BrushType::Twist) {
+        ux += w * (ly * rz - lz * ry);
+        uy += w * (lz * rx - lx * rz);
+        uz += w * (lx * ry - ly * rx);
+    }
+    else if constexpr (T == BrushType::Scale) {
+        const float c = w * brushes.lw[j];
+        ux += c * rx;
+        uy += c * ry;
+        uz += c * rz;
+    }
+    else {
+        // F r = f ((d.r) d - r/3)
+        const float f = brushes.lw[j];
+        const float dr = lx * rx + ly * ry + lz * rz;
+        const float Frx = f * (dr * lx - rx * (1.0f / 3.0f));
+        const float Fry = f * (dr * ly - ry * (1.0f / 3.0f));
+        const float Frz = f * (dr * lz - rz * (1.0f / 3.0f));
+        const float P = k.twoB * s3 - k.a * w;
+        const float Q = -k.threeB * s5 * (rx * Frx + ry * Fry + rz * Frz);
+        ux += P * Frx + Q * rx;
+        uy += P * Fry + Q * ry;
+        uz += P * Frz + Q * rz;
+    }
+}
+
+template <BrushType T, int Scales>
+void displaceScalar(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        float ux = 0.0f, uy = 0.0f, uz = 0.0f;
+        for (size_t j = 0; j < activeCount; ++j) {
+            accumulateScalar<T, Scales>(k, brushes, active[j], px[i], py[i], pz[i], ux, uy, uz);
+        }
+        ox[i] = px[i] + ux;
+        oy[i] = py[i] + uy;
+        oz[i] = pz[i] + uz;
+    }
+}
+
+template <BrushType T, int Scales>
+void displaceIndexedScalar(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, const uint32_t* indices, size_t begin, size_t end) {
+    for (size_t n = begin; n < end; ++n) {
+        const uint32_t i = indices[n];
+        displaceScalar<T, Scales>(k, brushes, active, activeCount, px, py, pz, ox, oy, oz, i, i + 1);
+    }
+}
+
+// Rest and deformed tangent frames of the frame kernels: normal, tangent and
+// bitangent, x, y and z each
+struct FrameStreams {
+    const float* rest[9];
+    float* deformed[9];
+};
+
+FrameStreams frameStreams(const FramesSoA& rest, FramesSoA& deformed) {
+    const PositionsSoA* in[3] = {&rest.normal, &rest.tangent, &rest.bitangent};
+    PositionsSoA* out[3] = {&deformed.normal, &deformed.tangent, &deformed.bitangent};
+    FrameStreams streams;
+    for (int v = 0; v < 3; ++v) {
+        streams.rest[3 * v] = in[v]->x.data();
+        streams.rest[3 * v + 1] = in[v]->y.data();
+        streams.rest[3 * v + 2] = in[v]->z.data();
+        streams.deformed[3 * v] = out[v]->x.data();
+        streams.deformed[3 * v + 1] = out[v]->y.data();
+        streams.deformed[3 * v + 2] = out[v]->z.data();
+    }
+    return streams;
+}
+
+// Same as accumulateScalar() plus the gradient, g[3 * i + k] += du_i/dr_k.
+// Radial coefficients are differentiated through re: d(1/re^n)/dr = -n/re^(n+2) r.
+template <BrushType T, int Scales>
+void accumulateFrameScalar(const KernelParams& k, const BrushStreams& brushes, uint32_t j, const float p[3], float u[3], float g[9]) {
+    const float r[3] = {p[0] - brushes.x0[j], p[1] - brushes.y0[j], p[2] - brushes.z0[j]};
+    const float r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+    float A = 0.0f, B = 0.0f, Ag = 0.0f, Bg = 0.0f;
+    float w = 0.0f, wg = 0.0f, s3 = 0.0f, s3g = 0.0f, s5 = 0.0f, s5g = 0.0f;
+    for (int s = 0; s < Scales; ++s) {
+        const float invR = 1.0f / std::max(std::sqrt(r2 + k.eps2[s]), MIN_R_EPSILON);
+        const float invR3 = invR * invR * invR;
+        const float invR5 = invR3 * invR * invR;
+        const float invR7 = invR5 * invR * invR;
+        if constexpr (T == BrushType::Grab) {
+            A += k.aMinusB[s] * invR + k.halfAEps2[s] * invR3;
+            B += k.b[s] * invR3;
+            Ag -= k.aMinusB[s] * invR3 + 3.0f * k.halfAEps2[s] * invR5;
+            Bg -= 3.0f * k.b[s] * invR5;
+        }
+        else {
+            w += k.weight[s] * invR3 + k.threeHalfEps2[s] * invR5;
+            wg -= 3.0f * k.weight[s] * invR5 + 5.0f * k.threeHalfEps2[s] * invR7;
+            s3 += k.weight[s] * invR3;
+            s3g -= 3.0f * k.weight[s] * invR5;
+            s5 += k.weight[s] * invR5;
+            s5g -= 5.0f * k.weight[s] * invR7;
+        }
+    }
+    const float l[3] = {brushes.lx[j], brushes.ly[j], brushes.lz[j]};
+    const float lw = brushes.lw[j];
+    if constexpr (T == BrushType::Grab) {
+        const float rF = r[0] * l[0] + r[1] * l[1] + r[2] * l[2];
+        for (int i = 0; i < 3; ++i) {
+            u[i] += A * l[i] + B * rF * r[i];
+            for (int c = 0; c < 3; ++c) {
+                g[3 * i + c] += l[i] * Ag * r[c] + r[i] * (Bg * rF * r[c] + B * l[c]);
+            }
+            g[4 * i] += B * rF;
+        }
+    }
+    else if constexpr (T == BrushType::Twist) {
+        const float v[3] = {l[1] * r[2] - l[2] * r[1], l[2] * r[0] - l[0] * r[2], l[0] * r[1] - l[1] * r[0]};
+        const float cross[9] = {0.0f, -l[2], l[1], l[2], 0.0f, -l[0], -l[1], l[0], 0.0f};
+        for (int i = 0; i < 3; ++i) {
+            u[i] += w * v[i];
+            for (int c = 0; c < 3; ++c) {
+                g[3 * i + c] += v[i] * wg * r[c] + w * cross[3 * i + c];
+            }
+        }
+    }
+    else if constexpr (T == BrushType::Scale) {
+        for (int i = 0; i < 3; ++i) {
+            u[i] += lw * w * r[i];
+            for (int c = 0; c < 3; ++c) {
+                g[3 * i + c] += lw * wg * r[i] * r[c];
+            }
+            g[4 * i] += lw * w;
+        }
+    }
+    else {
+        const float dr = l[0] * r[0] + l[1] * r[1] + l[2] * r[2];
+        float Fr[3];
+        for (int i = 0; i < 3; ++i) Fr[i] = lw * (dr * l[i] - r[i] * (1.0f / 3.0f));
+        const float rFr = r[0] * Fr[0] + r[1] * Fr[1] + r[2] * Fr[2];
+        const float P = k.twoB * s3 - k.a * w;
+        const float Pg = k.twoB * s3g - k.a * wg;
+        const float Q = k.threeB * s5 * rFr;
+        const float Qg = k.threeB * s5g * rFr;
+        for (int i = 0; i < 3; ++i) {
+            u[i] += P * Fr[i] - Q * r[i];
+            for (int c = 0; c < 3; ++c) {
+                g[3 * i + c] += P * lw * l[i] * l[c] + Fr[i] * Pg * r[c] - r[i] * (Qg * r[c] + 2.0f * k.threeB * s5 * Fr[c]);
+            }
+            g[4 * i] -= P * lw * (1.0f / 3.0f) + Q;
+        }
+    }
+}
+
+// Scalar counterpart of KernelAVX2::transformFrames()
+void transformFrameScalar(const float g[9], const FrameStreams& frames, size_t i) {
+    float J[9];
+    for (int e = 0; e < 9; ++e) J[e] = e % 4 == 0 ? g[e] + 1.0f : g[e];
+    float cofactor[9];
+    for (int c = 0; c < 3; ++c) {
+        for (int row = 0; row < 3; ++row) {
+            const int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+            const int i1 = (row + 1) % 3, i2 = (row + 2) % 3;
+            cofactor[3 * row + c] = J[3 * i1 + c1] * J[3 * i2 + c2] - J[3 * i2 + c1] * J[3 * i1 + c2];
+        }
+    }
+    for (int v = 0; v < 3; ++v) {
+        const float* M = v == 0 ? cofactor : J;
+        float result[3];
+        for (int row = 0; row < 3; ++row) {
+            result[row] = M[3 * row] * frames.rest[3 * v][i] + M[3 * row + 1] * frames.rest[3 * v + 1][i] + M[3 * row + 2] * frames.rest[3 * v + 2][i];
+        }
+        const float invLength = 1.0f / std::max(std::sqrt(result[0] * result[0] + result[1] * result[1] + result[2] * result[2]), MIN_R_EPSILON);
+        for (int row = 0; row < 3; ++row) frames.deformed[3 * v + row][i] = result[row] * invLength;
+    }
+}
+
+template <BrushType T, int Scales>
+void displaceFramesScalar(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, const FrameStreams& frames, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        const float p[3] = {px[i], py[i], pz[i]};
+        float u[3] = {};
+        float g[9] = {};
+        for (size_t j = 0; j < activeCount; ++j) {
+            accumulateFrameScalar<T, Scales>(k, brushes, active[j], p, u, g);
+        }
+        ox[i] = p[0] + u[0];
+        oy[i] = p[1] + u[1];
+        oz[i] = p[2] + u[2];
+        transformFrameScalar(g, frames, i);
+    }
+}
+
+template <BrushType T, int Scales>
+void displaceFramesIndexedScalar(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, const FrameStreams& frames, const uint32_t* indices, size_t begin, size_t end) {
+    for (size_t n = begin; n < end; ++n) {
+        const uint32_t i = indices[n];
+        displaceFramesScalar<T, Scales>(k, brushes, active, activeCount, px, py, pz, ox, oy, oz, frames, i, i + 1);
+    }
+}
+
+#ifdef KELVINLET_KERNEL_AVX2
+// Broadcast shape constants of the AVX2 kernels
+struct KernelAVX2 {
+    __m256 eps2[MAX_BRUSH_SCALES], weight[MAX_BRUSH_SCALES];
+    __m256 aMinusB[MAX_BRUSH_SCALES], halfAEps2[MAX_BRUSH_SCALES], b[MAX_BRUSH_SCALES], threeHalfEps2[MAX_BRUSH_SCALES];
+    __m256 a, twoB, threeB;
+    __m256 minR, one, third;
+    // Gradient terms of the frame kernels
+    __m256 sixB, minusThree, minusFive;
+
+    explicit KernelAVX2(const KernelParams& k)
+        : a(_mm256_set1_ps(k.a)), twoB(_mm256_set1_ps(k.twoB)), threeB(_mm256_set1_ps(k.threeB)),
+          minR(_mm256_set1_ps(MIN_R_EPSILON)), one(_mm256_set1_ps(1.0f)), third(_mm256_set1_ps(1.0f / 3.0f)),
+          sixB(_mm256_set1_ps(2.0f * k.threeB)), minusThree(_mm256_set1_ps(-3.0f)), minusFive(_mm256_set1_ps(-5.0f)) {
+        for (int s = 0; s < MAX_BRUSH_SCALES; ++s) {
+            eps2[s] = _mm256_set1_ps(k.eps2[s]);
+            weight[s] = _mm256_set1_ps(k.weight[s]);
+            aMinusB[s] = _mm256_set1_ps(k.aMinusB[s]);
+            halfAEps2[s] = _mm256_set1_ps(k.halfAEps2[s]);
+            b[s] = _mm256_set1_ps(k.b[s]);
+            threeHalfEps2[s] = _mm256_set1_ps(k.threeHalfEps2[s]);
+        }
+    }
+
+    // Adds the displacement of instance j to 8 vertices
+    template <BrushType T, int Scales>
+    void accumulate(const BrushStreams& brushes, uint32_t j, __m256 x, __m256 y, __m256 z, __m256& ux, __m256& uy, __m256& uz) const {
+        const __m256 rx = _mm256_sub_ps(x, _mm256_broadcast_ss(&brushes.x0[j]));
+        const __m256 ry = _mm256_sub_ps(y, _mm256_broadcast_ss(&brushes.y0[j]));
+        const __m256 rz = _mm256_sub_ps(z, _mm256_broadcast_ss(&brushes.z0[j]));
+        __m256 r2 = _mm256_mul_ps(rx, rx);
+        r2 = _mm256_fmadd_ps(ry, ry, r2);
+        r2 = _mm256_fmadd_ps(rz, rz, r2);
+        __m256 A = _mm256_setzero_ps(), B = _mm256_setzero_ps();
+        __m256 w = _mm256_setzero_ps(), s3 = _mm256_setzero_ps(), s5 = _mm256_setzero_ps();
+        for (int s = 0; s < Scales; ++s) {
+            const __m256 re = _mm256_max_ps(_mm256_sqrt_ps(_mm256_add_ps(r2, eps2[s])), minR);
+            const __m256 invR = _mm256_div_ps(one, re);
+            const __m256 invR2 = _mm256_mul_ps(invR, invR);
+            const __m256 invR3 = _mm256_mul_ps(invR2, invR);
+            if constexpr (T == BrushType::Grab) {
+                A = _mm256_add_ps(A, _mm256_fmadd_ps(aMinusB[s], invR, _mm256_mul_ps(halfAEps2[s], invR3)));
+                B = _mm256_fmadd_ps(b[s], invR3, B);
+            }
+            else {
+                const __m256 invR5 = _mm256_mul_ps(invR3, invR2);
+                w = _mm256_add_ps(w, _mm256_fmadd_ps(threeHalfEps2[s], invR5, _mm256_mul_ps(weight[s], invR3)));
+                if constexpr (T == BrushType::Pinch) {
+                    s3 = _mm256_fmadd_ps(weight[s], invR3, s3);
+                    s5 = _mm256_fmadd_ps(weight[s], invR5, s5);
+                }
+            }
+        }
+        if constexpr (T == BrushType::Scale) {
+            const __m256 c = _mm256_mul_ps(w, _mm256_broadcast_ss(&brushes.lw[j]));
+            ux = _mm256_fmadd_ps(c, rx, ux);
+            uy = _mm256_fmadd_ps(c, ry, uy);
+            uz = _mm256_fmadd_ps(c, rz, uz);
+            return;
+        }
+        const __m256 lx = _mm256_broadcast_ss(&brushes.lx[j]);
+        const __m256 ly = _mm256_broadcast_ss(&brushes.ly[j]);
+        const __m256 lz = _mm256_broadcast_ss(&brushes.lz[j]);
+        if constexpr (T == BrushType::Grab) {
+            __m256 rF = _mm256_mul_ps(rx, lx);
+            rF = _mm256_fmadd_ps(ry, ly, rF);
+            rF = _mm256_fmadd_ps(rz, lz, rF);
+            const __m256 BrF = _mm256_mul_ps(B, rF);
+            ux = _mm256_fmadd_ps(BrF, rx, _mm256_fmadd_ps(A, lx, ux));
+            uy = _mm256_fmadd_ps(BrF, ry, _mm256_fmadd_ps(A, ly, uy));
+            uz = _mm256_fmadd_ps(BrF, rz, _mm256_fmadd_ps(A, lz, uz));
+        }
+        else if constexpr (T == BrushType::Twist) {
+            ux = _mm256_fmadd_ps(w, _mm256_fmsub_ps(ly, rz, _mm256_mul_ps(lz, ry)), ux);
+            uy = _mm256_fmadd_ps(w, _mm256_fmsub_ps(lz, rx, _mm256_mul_ps(lx, rz)), uy);
+            uz = _mm256_fmadd_ps(w, _mm256_fmsub_ps(lx, ry, _mm256_mul_ps(ly, rx)), uz);
+        }
+        else if constexpr (T == BrushType::Pinch) {
+            const __m256 f = _mm256_broadcast_ss(&brushes.lw[j]);
+            const __m256 dr = _mm256_fmadd_ps(rz, lz, _mm256_fmadd_ps(ry, ly, _mm256_mul_ps(rx, lx)));
+            const __m256 Frx = _mm256_mul_ps(f, _mm256_fmsub_ps(dr, lx, _mm256_mul_ps(rx, third)));
+            const __m256 Fry = _mm256_mul_ps(f, _mm256_fmsub_ps(dr, ly, _mm256_mul_ps(ry, third)));
+            const __m256 Frz = _mm256_mul_ps(f, _mm256_fmsub_ps(dr, lz, _mm256_mul_ps(rz, third)));
+            const __m256 rFr = _mm256_fmadd_ps(rz, Frz, _mm256_fmadd_ps(ry, Fry, _mm256_mul_ps(rx, Frx)));
+            const __m256 P = _mm256_fmsub_ps(twoB, s3, _mm256_mul_ps(a, w));
+            const __m256 Q = _mm256_mul_ps(_mm256_mul_ps(threeB, s5), rFr);
+            ux = _mm256_fnmadd_ps(Q, rx, _mm256_fmadd_ps(P, Frx, ux));
+            uy = _mm256_fnmadd_ps(Q, ry, _mm256_fmadd_ps(P, Fry, uy));
+            uz = _mm256_fnmadd_ps(Q, rz, _mm256_fmadd_ps(P, Frz, uz));
+        }
+    }
+    // Same as accumulate() plus the gradient, g[3 * i + k] += du_i/dr_k
+    template <BrushType T, int Scales>
+    void accumulateFrame(const BrushStreams& brushes, uint32_t j, __m256 x, __m256 y, __m256 z, __m256 u[3], __m256 g[9]) const {
+        const __m256 r[3] = {
+            _mm256_sub_ps(x, _mm256_broadcast_ss(&brushes.x0[j])),
+            _mm256_sub_ps(y, _mm256_broadcast_ss(&brushes.y0[j])),
+            _mm256_sub_ps(z, _mm256_broadcast_ss(&brushes.z0[j]))
+        };
+        const __m256 r2 = _mm256_fmadd_ps(r[2], r[2], _mm256_fmadd_ps(r[1], r[1], _mm256_mul_ps(r[0], r[0])));
+        // Coefficients of u and their radial derivatives divided by re: d(1/re^n)/dr = -n/re^(n+2) r
+        __m256 A = _mm256_setzero_ps(), B = _mm256_setzero_ps(), Ag = _mm256_setzero_ps(), Bg = _mm256_setzero_ps();
+        __m256 w = _mm256_setzero_ps(), wg = _mm256_setzero_ps();
+        __m256 s3 = _mm256_setzero_ps(), s3g = _mm256_setzero_ps(), s5 = _mm256_setzero_ps(), s5g = _mm256_setzero_ps();
+        for (int s = 0; s < Scales; ++s) {
+            const __m256 re = _mm256_max_ps(_mm256_sqrt_ps(_mm256_add_ps(r2, eps2[s])), minR);
+            const __m256 invR = _mm256_div_ps(one, re);
+            const __m256 invR2 = _mm256_mul_ps(invR, invR);
+            const __m256 invR3 = _mm256_mul_ps(invR2, invR);
+            const __m256 invR5 = _mm256_mul_ps(invR3, invR2);
+            if constexpr (T == BrushType::Grab) {
+                A = _mm256_add_ps(A, _mm256_fmadd_ps(aMinusB[s], invR, _mm256_mul_ps(halfAEps2[s], invR3)));
+                B = _mm256_fmadd_ps(b[s], invR3, B);
+                Ag = _mm256_fnmadd_ps(aMinusB[s], invR3, Ag);
+                Ag = _mm256_fmadd_ps(_mm256_mul_ps(minusThree, halfAEps2[s]), invR5, Ag);
+                Bg = _mm256_fmadd_ps(_mm256_mul_ps(minusThree, b[s]), invR5, Bg);
+            }
+            else {
+                const __m256 invR7 = _mm256_mul_ps(invR5, invR2);
+                w = _mm256_add_ps(w, _mm256_fmadd_ps(threeHalfEps2[s], invR5, _mm256_mul_ps(weight[s], invR3)));
+                const __m256 g3 = _mm256_mul_ps(_mm256_mul_ps(minusThree, weight[s]), invR5);
+                wg = _mm256_add_ps(wg, _mm256_fmadd_ps(_mm256_mul_ps(minusFive, threeHalfEps2[s]), invR7, g3));
+                if constexpr (T == BrushType::Pinch) {
+                    s3 = _mm256_fmadd_ps(weight[s], invR3, s3);
+                    s3g = _mm256_add_ps(s3g, g3);
+                    s5 = _mm256_fmadd_ps(weight[s], invR5, s5);
+                    s5g = _mm256_fmadd_ps(_mm256_mul_ps(minusFive, weight[s]), invR7, s5g);
+                }
+            }
+        }
+        const __m256 l[3] = {_mm256_broadcast_ss(&brushes.lx[j]), _mm256_broadcast_ss(&brushes.ly[j]), _mm256_broadcast_ss(&brushes.lz[j])};
+        const __m256 lw = _mm256_broadcast_ss(&brushes.lw[j]);
+        if constexpr (T == BrushType::Grab) {
+            // g = l (Ag r)^T + r (Bg (r.l) r + B l)^T + B (r.l) I
+            const __m256 rF = _mm256_fmadd_ps(r[2], l[2], _mm256_fmadd_ps(r[1], l[1], _mm256_mul_ps(r[0], l[0])));
+            const __m256 BrF = _mm256_mul_ps(B, rF);
+            const __m256 BgrF = _mm256_mul_ps(Bg, rF);
+            for (int i = 0; i < 3; ++i) {
+                u[i] = _mm256_fmadd_ps(BrF, r[i], _mm256_fmadd_ps(A, l[i], u[i]));
+                const __m256 c = _mm256_mul_ps(Ag, r[i]);
+                const __m256 e = _mm256_fmadd_ps(BgrF, r[i], _mm256_mul_ps(B, l[i]));
+                for (int k = 0; k < 3; ++k) {
+                    g[3 * k + i] = _mm256_fmadd_ps(l[k], c, _mm256_fmadd_ps(r[k], e, g[3 * k + i]));
+                }
+                g[4 * i] = _mm256_add_ps(g[4 * i], BrF);
+            }
+        }
+        else if constexpr (T == BrushType::Twist) {
+            // g = w [l]x + (l x r) (wg r)^T
+            const __m256 v[3] = {
+                _mm256_fmsub_ps(l[1], r[2], _mm256_mul_ps(l[2], r[1])),
+                _mm256_fmsub_ps(l[2], r[0], _mm256_mul_ps(l[0], r[2])),
+                _mm256_fmsub_ps(l[0], r[1], _mm256_mul_ps(l[1], r[0]))
+            };
+            for (int i = 0; i < 3; ++i) {
+                u[i] = _mm256_fmadd_ps(w, v[i], u[i]);
+                const __m256 c = _mm256_mul_ps(wg, r[i]);
+                for (int k = 0; k < 3; ++k) {
+                    g[3 * k + i] = _mm256_fmadd_ps(v[k], c, g[3 * k + i]);
+                }
+            }
+            const __m256 wl[3] = {_mm256_mul_ps(w, l[0]), _mm256_mul_ps(w, l[1]), _mm256_mul_ps(w, l[2])};
+            g[1] = _mm256_sub_ps(g[1], wl[2]);
+            g[2] = _mm256_add_ps(g[2], wl[1]);
+            g[3] = _mm256_add_ps(g[3], wl[2]);
+            g[5] = _mm256_sub_ps(g[5], wl[0]);
+            g[6] = _mm256_sub_ps(g[6], wl[1]);
+            g[7] = _mm256_add_ps(g[7], wl[0]);
+        }
+        else if constexpr (T == BrushType::Scale) {
+            // g = lw (w I + wg r r^T)
+            const __m256 cw = _mm256_mul_ps(lw, w);
+            const __m256 cwg = _mm256_mul_ps(lw, wg);
+            for (int i = 0; i < 3; ++i) {
+                u[i] = _mm256_fmadd_ps(cw, r[i], u[i]);
+                const __m256 c = _mm256_mul_ps(cwg, r[i]);
+                for (int k = 0; k < 3; ++k) {
+                    g[3 * k + i] = _mm256_fmadd_ps(r[k], c, g[3 * k + i]);
+                }
+                g[4 * i] = _mm256_add_ps(g[4 * i], cw);
+            }
+        }
+        else if constexpr (T == BrushType::Pinch) {
+            // u = P F r - Q r with P = 2b s3 - a w and Q = 3b s5 (r.F r), F = f (d d^T - I/3)
+            // g = P F + F r (Pg r)^T - Q I - r (Qg r + 6b s5 F r)^T
+            const __m256 dr = _mm256_fmadd_ps(r[2], l[2], _mm256_fmadd_ps(r[1], l[1], _mm256_mul_ps(r[0], l[0])));
+            __m256 Fr[3];
+            for (int i = 0; i < 3; ++i) {
+                Fr[i] = _mm256_mul_ps(lw, _mm256_fmsub_ps(dr, l[i], _mm256_mul_ps(r[i], third)));
+            }
+            const __m256 rFr = _mm256_fmadd_ps(r[2], Fr[2], _mm256_fmadd_ps(r[1], Fr[1], _mm256_mul_ps(r[0], Fr[0])));
+            const __m256 P = _mm256_fmsub_ps(twoB, s3, _mm256_mul_ps(a, w));
+            const __m256 Pg = _mm256_fmsub_ps(twoB, s3g, _mm256_mul_ps(a, wg));
+            const __m256 Q = _mm256_mul_ps(_mm256_mul_ps(threeB, s5), rFr);
+            const __m256 Qg = _mm256_mul_ps(_mm256_mul_ps(threeB, s5g), rFr);
+            const __m256 sixBs5 = _mm256_mul_ps(sixB, s5);
+            const __m256 Pf = _mm256_mul_ps(P, lw);
+            const __m256 diagonal = _mm256_fmadd_ps(Pf, third, Q);
+            for (int i = 0; i < 3; ++i) {
+                u[i] = _mm256_fnmadd_ps(Q, r[i], _mm256_fmadd_ps(P, Fr[i], u[i]));
+                const __m256 Pfd = _mm256_mul_ps(Pf, l[i]);
+                const __m256 c = _mm256_mul_ps(Pg, r[i]);
+                const __m256 e = _mm256_fmadd_ps(Qg, r[i], _mm256_mul_ps(sixBs5, Fr[i]));
+                for (int k = 0; k < 3; ++k) {
+                    __m256 gki = _mm256_fmadd_ps(l[k], Pfd, g[3 * k + i]);
+                    gki = _mm256_fmadd_ps(Fr[k], c, gki);
+                    g[3 * k + i] = _mm256_fnmadd_ps(r[k], e, gki);
+                }
+                g[4 * i] = _mm256_sub_ps(g[4 * i], diagonal);
+            }
+        }
+    }
+
+    // Deformed frames of 8 vertices from J = I + g: the tangent and bitangent
+    // follow J, the normal its cofactor matrix det(J) J^-T. All are normalized.
+    void transformFrames(const __m256 g[9], const __m256 rest[9], __m256 out[9]) const {
+        __m256 J[9];
+        for (int e = 0; e < 9; ++e) J[e] = e % 4 == 0 ? _mm256_add_ps(g[e], one) : g[e];
+        // Column c of J is (J[c], J[3 + c], J[6 + c]), column c of the cofactor
+        // matrix the cross product of the two others
+        __m256 cofactor[9];
+        for (int c = 0; c < 3; ++c) {
+            const int c1 = (c + 1) % 3;
+            const int c2 = (c + 2) % 3;
+            for (int i = 0; i < 3; ++i) {
+                const int i1 = (i + 1) % 3;
+                const int i2 = (i + 2) % 3;
+                cofactor[3 * i + c] = _mm256_fmsub_ps(J[3 * i1 + c1], J[3 * i2 + c2], _mm256_mul_ps(J[3 * i2 + c1], J[3 * i1 + c2]));
+            }
+        }
+        for (int v = 0; v < 3; ++v) {
+            const __m256* M = v == 0 ? cofactor : J;
+            const __m256* in = rest + 3 * v;
+            __m256* result = out + 3 * v;
+            for (int i = 0; i < 3; ++i) {
+                result[i] = _mm256_fmadd_ps(M[3 * i + 2], in[2], _mm256_fmadd_ps(M[3 * i + 1], in[1], _mm256_mul_ps(M[3 * i], in[0])));
+            }
+            const __m256 length2 = _mm256_fmadd_ps(result[2], result[2], _mm256_fmadd_ps(result[1], result[1], _mm256_mul_ps(result[0], result[0])));
+            const __m256 invLength = _mm256_div_ps(one, _mm256_max_ps(_mm256_sqrt_ps(length2), minR));
+            for (int i = 0; i < 3; ++i) result[i] = _mm256_mul_ps(result[i], invLength);
+        }
+    }
+};
+
+template <BrushType T, int Scales>
+size_t displaceAVX2(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, size_t begin, size_t end) {
+    const KernelAVX2 kernel(k);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(px + i);
+        const __m256 y = _mm256_loadu_ps(py + i);
+        const __m256 z = _mm256_loadu_ps(pz + i);
+        __m256 ux = _mm256_setzero_ps(), uy = _mm256_setzero_ps(), uz = _mm256_setzero_ps();
+        for (size_t j = 0; j < activeCount; ++j) {
+            kernel.accumulate<T, Scales>(brushes, active[j], x, y, z, ux, uy, uz);
+        }
+        _mm256_storeu_ps(ox + i, _mm256_add_ps(x, ux));
+        _mm256_storeu_ps(oy + i, _mm256_add_ps(y, uy));
+        _mm256_storeu_ps(oz + i, _mm256_add_ps(z, uz));
+    }
+    return i;
+}
+
+// Gathers the rest positions, AVX2 has no scatter so results are stored lane by lane
+template <BrushType T, int Scales>
+size_t displaceIndexedAVX2(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, const uint32_t* indices, size_t begin, size_t end) {
+    const KernelAVX2 kernel(k);
+    alignas(32) float results[3][8];
+    size_t n = begin;
+    for (; n + 8 <= end; n += 8) {
+        const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + n));
+        const __m256 x = _mm256_i32gather_ps(px, index, 4);
+        const __m256 y = _mm256_i32gather_ps(py, index, 4);
+        const __m256 z = _mm256_i32gather_ps(pz, index, 4);
+        __m256 ux = _mm256_setzero_ps(), uy = _mm256_setzero_ps(), uz = _mm256_setzero_ps();
+        for (size_t j = 0; j < activeCount; ++j) {
+            kernel.accumulate<T, Scales>(brushes, active[j], x, y, z, ux, uy, uz);
+        }
+        _mm256_store_ps(results[0], _mm256_add_ps(x, ux));
+        _mm256_store_ps(results[1], _mm256_add_ps(y, uy));
+        _mm256_store_ps(results[2], _mm256_add_ps(z, uz));
+        for (int lane = 0; lane < 8; ++lane) {
+            const uint32_t i = indices[n + lane];
+            ox[i] = results[0][lane];
+            oy[i] = results[1][lane];
+            oz[i] = results[2][lane];
+        }
+    }
+    return n;
+}
+
+template <BrushType T, int Scales>
+size_t displaceFramesAVX2(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, const FrameStreams& frames, size_t begin, size_t end) {
+    const KernelAVX2 kernel(k);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(px + i);
+        const __m256 y = _mm256_loadu_ps(py + i);
+        const __m256 z = _mm256_loadu_ps(pz + i);
+        __m256 u[3] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        __m256 g[9];
+        for (__m256& e : g) e = _mm256_setzero_ps();
+        for (size_t j = 0; j < activeCount; ++j) {
+            kernel.accumulateFrame<T, Scales>(brushes, active[j], x, y, z, u, g);
+        }
+        _mm256_storeu_ps(ox + i, _mm256_add_ps(x, u[0]));
+        _mm256_storeu_ps(oy + i, _mm256_add_ps(y, u[1]));
+        _mm256_storeu_ps(oz + i, _mm256_add_ps(z, u[2]));
+        __m256 rest[9], deformed[9];
+        for (int e = 0; e < 9; ++e) rest[e] = _mm256_loadu_ps(frames.rest[e] + i);
+        kernel.transformFrames(g, rest, deformed);
+        for (int e = 0; e < 9; ++e) _mm256_storeu_ps(frames.deformed[e] + i, deformed[e]);
+    }
+    return i;
+}
+
+template <BrushType T, int Scales>
+size_t displaceFramesIndexedAVX2(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, const FrameStreams& frames, const uint32_t* indices, size_t begin, size_t end) {
+    const KernelAVX2 kernel(k);
+    alignas(32) float results[12][8];
+    size_t n = begin;
+    for (; n + 8 <= end; n += 8) {
+        const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + n));
+        const __m256 x = _mm256_i32gather_ps(px, index, 4);
+        const __m256 y = _mm256_i32gather_ps(py, index, 4);
+        const __m256 z = _mm256_i32gather_ps(pz, index, 4);
+        __m256 u[3] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        __m256 g[9];
+        for (__m256& e : g) e = _mm256_setzero_ps();
+        for (size_t j = 0; j < activeCount; ++j) {
+            kernel.accumulateFrame<T, Scales>(brushes, active[j], x, y, z, u, g);
+        }
+        _mm256_store_ps(results[0], _mm256_add_ps(x, u[0]));
+        _mm256_store_ps(results[1], _mm256_add_ps(y, u[1]));
+        _mm256_store_ps(results[2], _mm256_add_ps(z, u[2]));
+        __m256 rest[9], deformed[9];
+        for (int e = 0; e < 9; ++e) rest[e] = _mm256_i32gather_ps(frames.rest[e], index, 4);
+        kernel.transformFrames(g, rest, deformed);
+        for (int e = 0; e < 9; ++e) _mm256_store_ps(results[3 + e], deformed[e]);
+        for (int lane = 0; lane < 8; ++lane) {
+            const uint32_t i = indices[n + lane];
+            ox[i] = results[0][lane];
+            oy[i] = results[1][lane];
+            oz[i] = results[2][lane];
+            for (int e = 0; e < 9; ++e) frames.deformed[e][i] = results[3 + e][lane];
+        }
+    }
+    return n;
+}
+#endif
+
+#ifdef KELVINLET_KERNEL_SSE
+// Broadcast shape constants of the SSE kernel
+struct KernelSSE {
+    __m128 eps2[MAX_BRUSH_SCALES], weight[MAX_BRUSH_SCALES];
+    __m128 aMinusB[MAX_BRUSH_SCALES], halfAEps2[MAX_BRUSH_SCALES], b[MAX_BRUSH_SCALES], threeHalfEps2[MAX_BRUSH_SCALES];
+    __m128 a, twoB, threeB;
+    __m128 minR, one, third;
+
+    explicit KernelSSE(const KernelParams& k)
+        : a(_mm_set1_ps(k.a)), twoB(_mm_set1_ps(k.twoB)), threeB(_mm_set1_ps(k.threeB)),
+          minR(_mm_set1_ps(MIN_R_EPSILON)), one(_mm_set1_ps(1.0f)), third(_mm_set1_ps(1.0f / 3.0f)) {
+        for (int s = 0; s < MAX_BRUSH_SCALES; ++s) {
+            eps2[s] = _mm_set1_ps(k.eps2[s]);
+            weight[s] = _mm_set1_ps(k.weight[s]);
+            aMinusB[s] = _mm_set1_ps(k.aMinusB[s]);
+            halfAEps2[s] = _mm_set1_ps(k.halfAEps2[s]);
+            b[s] = _mm_set1_ps(k.b[s]);
+            threeHalfEps2[s] = _mm_set1_ps(k.threeHalfEps2[s]);
+        }
+    }
+
+    // Adds the displacement of instance j to 4 vertices
+    template <BrushType T, int Scales>
+    void accumulate(const BrushStreams& brushes, uint32_t j, __m128 x, __m128 y, __m128 z, __m128& ux, __m128& uy, __m128& uz) const {
+        const __m128 rx = _mm_sub_ps(x, _mm_set1_ps(brushes.x0[j]));
+        const __m128 ry = _mm_sub_ps(y, _mm_set1_ps(brushes.y0[j]));
+        const __m128 rz = _mm_sub_ps(z, _mm_set1_ps(brushes.z0[j]));
+        const __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_mul_ps(rz, rz));
+        __m128 A = _mm_setzero_ps(), B = _mm_setzero_ps();
+        __m128 w = _mm_setzero_ps(), s3 = _mm_setzero_ps(), s5 = _mm_setzero_ps();
+        for (int s = 0; s < Scales; ++s) {
+            const __m128 re = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(r2, eps2[s])), minR);
+            const __m128 invR = _mm_div_ps(one, re);
+            const __m128 invR2 = _mm_mul_ps(invR, invR);
+            const __m128 invR3 = _mm_mul_ps(invR2, invR);
+            if constexpr (T == BrushType::Grab) {
+                A = _mm_add_ps(A, _mm_add_ps(_mm_mul_ps(aMinusB[s], invR), _mm_mul_ps(halfAEps2[s], invR3)));
+                B = _mm_add_ps(B, _mm_mul_ps(b[s], invR3));
+            }
+            else {
+                const __m128 invR5 = _mm_mul_ps(invR3, invR2);
+                w = _mm_add_ps(w, _mm_add_ps(_mm_mul_ps(weight[s], invR3), _mm_mul_ps(threeHalfEps2[s], invR5)));
+                if constexpr (T == BrushType::Pinch) {
+                    s3 = _mm_add_ps(s3, _mm_mul_ps(weight[s], invR3));
+                    s5 = _mm_add_ps(s5, _mm_mul_ps(weight[s], invR5));
+                }
+            }
+        }
+        if constexpr (T == BrushType::Scale) {
+            const __m128 c = _mm_mul_ps(w, _mm_set1_ps(brushes.lw[j]));
+            ux = _mm_add_ps(ux, _mm_mul_ps(c, rx));
+            uy = _mm_add_ps(uy, _mm_mul_ps(c, ry));
+            uz = _mm_add_ps(uz, _mm_mul_ps(c, rz));
+            return;
+        }
+        const __m128 lx = _mm_set1_ps(brushes.lx[j]);
+        const __m128 ly = _mm_set1_ps(brushes.ly[j]);
+        const __m128 lz = _mm_set1_ps(brushes.lz[j]);
+        if constexpr (T == BrushType::Grab) {
+            const __m128 rF = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, lx), _mm_mul_ps(ry, ly)), _mm_mul_ps(rz, lz));
+            const __m128 BrF = _mm_mul_ps(B, rF);
+            ux = _mm_add_ps(ux, _mm_add_ps(_mm_mul_ps(A, lx), _mm_mul_ps(BrF, rx)));
+            uy = _mm_add_ps(uy, _mm_add_ps(_mm_mul_ps(A, ly), _mm_mul_ps(BrF, ry)));
+            uz = _mm_add_ps(uz, _mm_add_ps(_mm_mul_ps(A, lz), _mm_mul_ps(BrF, rz)));
+        }
+        else if constexpr (T == BrushType::Twist) {
+            ux = _mm_add_ps(ux, _mm_mul_ps(w, _mm_sub_ps(_mm_mul_ps(ly, rz), _mm_mul_ps(lz, ry))));
+            uy = _mm_add_ps(uy, _mm_mul_ps(w, _mm_sub_ps(_mm_mul_ps(lz, rx), _mm_mul_ps(lx, rz))));
+            uz = _mm_add_ps(uz, _mm_mul_ps(w, _mm_sub_ps(_mm_mul_ps(lx, ry), _mm_mul_ps(ly, rx))));
+        }
+        else if constexpr (T == BrushType::Pinch) {
+            const __m128 f = _mm_set1_ps(brushes.lw[j]);
+            const __m128 dr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, lx), _mm_mul_ps(ry, ly)), _mm_mul_ps(rz, lz));
+            const __m128 Frx = _mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(dr, lx), _mm_mul_ps(rx, third)));
+            const __m128 Fry = _mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(dr, ly), _mm_mul_ps(ry, third)));
+            const __m128 Frz = _mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(dr, lz), _mm_mul_ps(rz, third)));
+            const __m128 rFr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, Frx), _mm_mul_ps(ry, Fry)), _mm_mul_ps(rz, Frz));
+            const __m128 P = _mm_sub_ps(_mm_mul_ps(twoB, s3), _mm_mul_ps(a, w));
+            const __m128 Q = _mm_mul_ps(_mm_mul_ps(threeB, s5), rFr);
+            ux = _mm_add_ps(ux, _mm_sub_ps(_mm_mul_ps(P, Frx), _mm_mul_ps(Q, rx)));
+            uy = _mm_add_ps(uy, _mm_sub_ps(_mm_mul_ps(P, Fry), _mm_mul_ps(Q, ry)));
+            uz = _mm_add_ps(uz, _mm_sub_ps(_mm_mul_ps(P, Frz), _mm_mul_ps(Q, rz)));
+        }
+    }
+};
+
+template <BrushType T, int Scales>
+size_t displaceSSE(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const float* px, const float* py, const float* pz, float* ox, float* oy, float* oz, size_t begin, size_t end) {
+    const KernelSSE kernel(k);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 x = _mm_loadu_ps(px + i);
+        const __m128 y = _mm_loadu_ps(py + i);
+        const __m128 z = _mm_loadu_ps(pz + i);
+        __m128 ux = _mm_setzero_ps(), uy = _mm_setzero_ps(), uz = _mm_setzero_ps();
+        for (size_t j = 0; j < activeCount; ++j) {
+            kernel.accumulate<T, Scales>(brushes, active[j], x, y, z, ux, uy, uz);
+        }
+        _mm_storeu_ps(ox + i, _mm_add_ps(x, ux));
+        _mm_storeu_ps(oy + i, _mm_add_ps(y, uy));
+        _mm_storeu_ps(oz + i, _mm_add_ps(z, uz));
+    }
+    return i;
+}
+#endif
+
+template <BrushType T, int Scales>
+void displaceRange(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const PositionsSoA& rest, PositionsSoA& deformed, size_t begin, size_t end) {
+    const float* px = rest.x.data();
+    const float* py = rest.y.data();
+    const float* pz = rest.z.data();
+    float* ox = deformed.x.data();
+    float* oy = deformed.y.data();
+    float* oz = deformed.z.data();
+    size_t i = begin;
+#ifdef KELVINLET_KERNEL_AVX2
+    i = displaceAVX2<T, Scales>(k, brushes, active, activeCount, px, py, pz, ox, oy, oz, i, end);
+#endif
+#ifdef KELVINLET_KERNEL_SSE
+    i = displaceSSE<T, Scales>(k, brushes, active, activeCount, px, py, pz, ox, oy, oz, i, end);
+#endif
+    displaceScalar<T, Scales>(k, brushes, active, activeCount, px, py, pz, ox, oy, oz, i, end);
+}
+
+template <BrushType T, int Scales>
+void displaceIndices(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const PositionsSoA& rest, PositionsSoA& deformed, const uint32_t* indices, size_t count) {
+    const float* px = rest.x.data();
+    const float* py = rest.y.data();
+    const float* pz = rest.z.data();
+    float* ox = deformed.x.data();
+    float* oy = deformed.y.data();
+    float* oz = deformed.z.data();
+    size_t n = 0;
+#ifdef KELVINLET_KERNEL_AVX2
+    n = displaceIndexedAVX2<T, Scales>(k, brushes, active, activeCount, px, py, pz, ox, oy, oz, indices, n, count);
+#endif
+    displaceIndexedScalar<T, Scales>(k, brushes, active, activeCount, px, py, pz, ox, oy, oz, indices, n, count);
+}
+
+// The frame kernels have no SSE variant, SSE builds run them in scalar
+template <BrushType T, int Scales>
+void displaceFramesRange(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const PositionsSoA& rest, PositionsSoA& deformed, const FrameStreams& frames, size_t begin, size_t end) {
+    size_t i = begin;
+#ifdef KELVINLET_KERNEL_AVX2
+    i = displaceFramesAVX2<T, Scales>(k, brushes, active, activeCount, rest.x.data(), rest.y.data(), rest.z.data(), deformed.x.data(), deformed.y.data(), deformed.z.data(), frames, i, end);
+#endif
+    displaceFramesScalar<T, Scales>(k, brushes, active, activeCount, rest.x.data(), rest.y.data(), rest.z.data(), deformed.x.data(), deformed.y.data(), deformed.z.data(), frames, i, end);
+}
+
+template <BrushType T, int Scales>
+void displaceFramesIndices(const KernelParams& k, const BrushStreams& brushes, const uint32_t* active, size_t activeCount, const PositionsSoA& rest, PositionsSoA& deformed, const FrameStreams& frames, const uint32_t* indices, size_t count) {
+    size_t n = 0;
+#ifdef KELVINLET_KERNEL_AVX2
+    n = displaceFramesIndexedAVX2<T, Scales>(k, brushes, active, activeCount, rest.x.data(), rest.y.data(), rest.z.data(), deformed.x.data(), deformed.y.data(), deformed.z.data(), frames, indices, n, count);
+#endif
+    displaceFramesIndexedScalar<T, Scales>(k, brushes, active, activeCount, rest.x.data(), rest.y.data(), rest.z.data(), deformed.x.data(), deformed.y.data(), deformed.z.data(), frames, indices, n, count);
+}
+
+template <BrushType T, typename Fn>
+void dispatchScales(int scales, Fn&& fn) {
+    switch (scales) {
+        case 2: fn(std::integral_constant<BrushType, T>(), std::integral_constant<int, 2>()); break;
+        case 3: fn(std::integral_constant<BrushType, T>(), std::integral_constant<int, 3>()); break;
+        default: fn(std::integral_constant<BrushType, T>(), std::integral_constant<int, 1>()); break;
+    }
+}
+
+// Calls fn with the brush type and scale count as compile-time constants
+template <typename Fn>
+void dispatchBrush(const Kelvinlet& kelvinlet, Fn&& fn) {
+    const int scales = kelvinlet.scaleCount();
+    switch (kelvinlet.m_brush.type) {
+        case BrushType::Grab: dispatchScales<BrushType::Grab>(scales, fn); break;
+        case BrushType::Twist: dispatchScales<BrushType::Twist>(scales, fn); break;
+        case BrushType::Scale: dispatchScales<BrushType::Scale>(scales, fn); break;
+        case BrushType::Pinch: dispatchScales<BrushType::Pinch>(scales, fn); break;
+    }
+}
+
+}
+
+KelvinletDeformer::KelvinletDeformer() {}
+
+KelvinletDeformer::KelvinletDeformer(const Mesh& mesh) {
+    setRestPose(mesh.get_positions());
+}
+
+KelvinletDeformer::KelvinletDeformer(const std::vector<Vertex>& vertices) {
+    setRestPose(vertices);
+}
+
+void KelvinletDeformer::setRestPose(const std::vector<Vertex>& vertices) {
+    m_rest.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        m_rest.set(i, vertices[i].position);
+    }
+    m_deformed = m_rest;
+    m_displacement.clear();
+    m_displacement.resize(vertices.size());
+    clearFrames();
+}
+
+void KelvinletDeformer::setRestPose(const std::vector<glm::vec3>& positions) {
+    m_rest.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        m_rest.set(i, positions[i]);
+    }
+    m_deformed = m_rest;
+    m_displacement.clear();
+    m_displacement.resize(positions.size());
+    clearFrames();
+}
+
+void KelvinletDeformer::resetToRestPose() {
+    m_deformed = m_rest;
+    m_deformedFrames = m_restFrames;
+}
+
+void KelvinletDeformer::setRestFrames(const FramesSoA& frames) {
+    if (frames.size() != size()) {
+        std::cout << "KelvinletDeformer::setRestFrames: " << frames.size() << " frames for " << size() << " vertices" << std::endl;
+        return;
+    }
+    m_restFrames = frames;
+    m_deformedFrames = frames;
+}
+
+void KelvinletDeformer::clearFrames() {
+    m_restFrames.clear();
+    m_deformedFrames.clear();
+}
+
+bool KelvinletDeformer::hasFrames() const {
+    return m_restFrames.size() != 0 && m_restFrames.size() == size();
+}
+
+void KelvinletDeformer::sculptIndices(const uint32_t* indices, size_t count, const PositionsSoA& positions) {
+    for (size_t n = 0; n < count; ++n) {
+        const uint32_t i = indices[n];
+        const glm::vec3 p = positions.get(n);
+        m_displacement.set(i, m_displacement.get(i) + p - m_rest.get(i));
+        m_rest.set(i, p);
+        m_deformed.set(i, p);
+    }
+    if (hasFrames()) {
+        const FrameStreams frames = frameStreams(m_restFrames, m_deformedFrames);
+        for (int e = 0; e < 9; ++e) {
+            for (size_t n = 0; n < count; ++n) {
+                frames.deformed[e][indices[n]] = frames.rest[e][indices[n]];
+            }
+        }
+    }
+}
+
+void KelvinletDeformer::clearSculpt() {
+    for (size_t i = 0; i < size(); ++i) {
+        m_rest.set(i, m_rest.get(i) - m_displacement.get(i));
+    }
+    m_deformed = m_rest;
+    m_deformedFrames = m_restFrames;
+    m_displacement.clear();
+    m_displacement.resize(m_rest.size());
+}
+
+void KelvinletDeformer::resetRange(size_t begin, size_t end) {
+    end = std::min(end, size());
+    if (begin >= end) return;
+    std::copy(m_rest.x.begin() + begin, m_rest.x.begin() + end, m_deformed.x.begin() + begin);
+    std::copy(m_rest.y.begin() + begin, m_rest.y.begin() + end, m_deformed.y.begin() + begin);
+    std::copy(m_rest.z.begin() + begin, m_rest.z.begin() + end, m_deformed.z.begin() + begin);
+    if (hasFrames()) {
+        const FrameStreams frames = frameStreams(m_restFrames, m_deformedFrames);
+        for (int e = 0; e < 9; ++e) {
+            std::copy(frames.rest[e] + begin, frames.rest[e] + end, frames.deformed[e] + begin);
+        }
+    }
+}
+
+void KelvinletDeformer::resetIndices(const uint32_t* indices, size_t count) {
+    for (size_t n = 0; n < count; ++n) {
+        const uint32_t i = indices[n];
+        m_deformed.x[i] = m_rest.x[i];
+        m_deformed.y[i] = m_rest.y[i];
+        m_deformed.z[i] = m_rest.z[i];
+    }
+    if (hasFrames()) {
+        const FrameStreams frames = frameStreams(m_restFrames, m_deformedFrames);
+        for (int e = 0; e < 9; ++e) {
+            for (size_t n = 0; n < count; ++n) {
+                frames.deformed[e][indices[n]] = frames.rest[e][indices[n]];
+            }
+        }
+    }
+}
+
+void KelvinletDeformer::apply(const Kelvinlet& kelvinlet, const glm::vec3& x0) {
+    applyRange(kelvinlet, x0, 0, size());
+}
+
+void KelvinletDeformer::applyRange(const Kelvinlet& kelvinlet, const glm::vec3& x0, size_t begin, size_t end) {
+    KelvinletBatch batch(kelvinlet);
+    batch.add(x0);
+    const uint32_t all = 0;
+    applyRange(batch, &all, 1, begin, end);
+}
+
+void KelvinletDeformer::applyIndices(const Kelvinlet& kelvinlet, const glm::vec3& x0, const uint32_t* indices, size_t count) {
+    KelvinletBatch batch(kelvinlet);
+    batch.add(x0);
+    const uint32_t all = 0;
+    applyIndices(batch, &all, 1, indices, count);
+}
+
+void KelvinletDeformer::applyRange(const KelvinletBatch& batch, const uint32_t* active, size_t activeCount, size_t begin, size_t end) {
+    end = std::min(end, size());
+    if (!hasFrames()) {
+        evaluate(batch, active, activeCount, m_rest, m_deformed, begin, end);
+        return;
+    }
+    if (begin >= end) return;
+    const KernelParams k = makeParams(batch.getShape());
+    const FrameStreams frames = frameStreams(m_restFrames, m_deformedFrames);
+    dispatchBrush(batch.getShape(), [&](auto type, auto scales) {
+        displaceFramesRange<decltype(type)::value, decltype(scales)::value>(k, batch.getStreams(), active, activeCount, m_rest, m_deformed, frames, begin, end);
+    });
+}
+
+void KelvinletDeformer::evaluate(const KelvinletBatch& batch, const uint32_t* active, size_t activeCount, const PositionsSoA& positions, PositionsSoA& out, size_t begin, size_t end) {
+    if (begin >= end) return;
+    const KernelParams k = makeParams(batch.getShape());
+    dispatchBrush(batch.getShape(), [&](auto type, auto scales) {
+        displaceRange<decltype(type)::value, decltype(scales)::value>(k, batch.getStreams(), active, activeCount, positions, out, begin, end);
+    });
+}
+
+void KelvinletDeformer::applyIndices(const KelvinletBatch& batch, const uint32_t* active, size_t activeCount, const uint32_t* indices, size_t count) {
+    if (count == 0) return;
+    const KernelParams k = makeParams(batch.getShape());
+    if (hasFrames()) {
+        const FrameStreams frames = frameStreams(m_restFrames, m_deformedFrames);
+        dispatchBrush(batch.getShape(), [&](auto type, auto scales) {
+            displaceFramesIndices<decltype(type)::value, decltype(scales)::value>(k, batch.getStreams(), active, activeCount, m_rest, m_deformed, frames, indices, count);
+        });
+        return;
+    }
+    dispatchBrush(batch.getShape(), [&](auto type, auto scales) {
+        displaceIndices<decltype(type)::value, decltype(scales)::value>(k, batch.getStreams(), active, activeCount, m_rest, m_deformed, indices, count);
+    });
+}
+
+size_t KelvinletDeformer::size() const {
+    return m_rest.size();
+}
+
+const PositionsSoA& KelvinletDeformer::getRestPositions() const {
+    return m_rest;
+}
+
+const PositionsSoA& KelvinletDeformer::getDeformedPositions() const {
+    return m_deformed;
+}
+
+const PositionsSoA& KelvinletDeformer::getDisplacement() const {
+    return m_displacement;
+}
+
+const FramesSoA& KelvinletDeformer::getRestFrames() const {
+    return m_restFrames;
+}
+
+const FramesSoA& KelvinletDeformer::getDeformedFrames() const {
+    return m_deformedFrames;
+}
+
+glm::vec3 KelvinletDeformer::getDeformedPosition(size_t i) const {
+    return m_deformed.get(i);
+}
+
+void KelvinletDeformer::copyDeformedPositions(std::vector<glm::vec3>& out) const {
+    out.resize(size());
+    for (size_t i = 0; i < size(); ++i) {
+        out[i] = m_deformed.get(i);
+    }
+}
+
+const char* KelvinletDeformer::kernelName() {
+#ifdef KELVINLET_KERNEL_AVX2
+    return "AVX2";
+#elif defined(KELVINLET_KERNEL_SSE)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,184 @@
+#include <Ktx2Cache.hpp>
+#include <MappedFile.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+    constexpr uint8_t IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    constexpr char SOURCE_KEY[] = "KelvinletsSource";
+    // Levels are aligned to the block size, 16 covers every format
+    constexpr uint64_t LEVEL_ALIGNMENT = 16;
+
+    static_assert(sizeof(Ktx2Header) == 80, "Ktx2Header must match the KTX2 layout");
+    static_assert(sizeof(Ktx2Level) == 24, "Ktx2Level must match the KTX2 layout");
+
+    // Value of the source key/value entry
+    struct SourceInfo {
+        uint64_t hash;
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    struct FormatInfo {
+        uint32_t vkFormat;
+        uint32_t colorModel;
+        // Channel ids of the 64-bit samples, the second one is unused by 8 byte blocks
+        uint32_t channels[2];
+    };
+
+    FormatInfo formatInfo(BlockFormat format) {
+        // VK_FORMAT_*_UNORM_BLOCK and KHR_DF_MODEL_BC*
+        switch (format) {
+            case BlockFormat::BC1: return {131, 128, {0, 0}};
+            case BlockFormat::BC3: return {137, 130, {15, 0}};
+            case BlockFormat::BC4: return {139, 131, {0, 0}};
+            case BlockFormat::BC5: return {141, 132, {0, 1}};
+        }
+        return {0, 0, {0, 0}};
+    }
+
+    // Basic data format descriptor, mandatory in KTX2
+    std::vector<uint32_t> dataFormatDescriptor(BlockFormat format) {
+        const FormatInfo info = formatInfo(format);
+        const uint32_t bytes = static_cast<uint32_t>(blockBytes(format));
+        const uint32_t samples = bytes / 8;
+        const uint32_t blockSize = 24 + 16 * samples;
+        std::vector<uint32_t> dfd;
+        dfd.push_back(4 + blockSize);
+        dfd.push_back(0);
+        dfd.push_back(2 | (blockSize << 16));
+        // Linear transfer and BT.709 primaries, like the uncompressed GL_RGBA path
+        dfd.push_back(info.colorModel | (1 << 8) | (1 << 16));
+        dfd.push_back(3 | (3 << 8));
+        dfd.push_back(bytes);
+        dfd.push_back(0);
+        for (uint32_t s = 0; s < samples; ++s) {
+            dfd.push_back((s * 64) | (63 << 16) | (info.channels[s] << 24));
+            dfd.push_back(0);
+            dfd.push_back(0);
+            dfd.push_back(0xFFFFFFFFu);
+        }
+        return dfd;
+    }
+
+    uint64_t align(uint64_t offset, uint64_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    bool findSourceInfo(const uint8_t* kvd, uint32_t length, SourceInfo& info) {
+        uint32_t offset = 0;
+        while (offset + 4 <= length) {
+            uint32_t entryLength;
+            std::memcpy(&entryLength, kvd + offset, 4);
+            if (entryLength > length - offset - 4) return false;
+            const uint8_t* entry = kvd + offset + 4;
+            if (entryLength == sizeof(SOURCE_KEY) + sizeof(SourceInfo) && std::memcmp(entry, SOURCE_KEY, sizeof(SOURCE_KEY)) == 0) {
+                std::memcpy(&info, entry + sizeof(SOURCE_KEY), sizeof(SourceInfo));
+                return true;
+            }
+            offset += static_cast<uint32_t>(align(4 + entryLength, 4));
+        }
+        return false;
+    }
+}
+
+std::string Ktx2Cache::cachePath(const std::string& sourcePath) {
+    return sourcePath + ".ktx2";
+}
+
+bool Ktx2Cache::read(const std::string& path, uint64_t sourceHash, BlockFormat format, CompressedImage& image) {
+    MappedFile file(path);
+    if (!file.isOpen() || file.size() < sizeof(Ktx2Header)) return false;
+    Ktx2Header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0) return false;
+    if (header.vkFormat != formatInfo(format).vkFormat || header.supercompressionScheme != 0) return false;
+    if (header.pixelDepth != 0 || header.layerCount > 1 || header.faceCount != 1) return false;
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.levelCount == 0 || header.levelCount > 32) return false;
+
+    const uint64_t size = file.size();
+    if (static_cast<uint64_t>(header.kvdByteOffset) + header.kvdByteLength > size) return false;
+    SourceInfo info;
+    if (!findSourceInfo(file.data() + header.kvdByteOffset, header.kvdByteLength, info)) return false;
+    if (info.hash != sourceHash || info.version != VERSION) return false;
+
+    if (sizeof(Ktx2Header) + header.levelCount * sizeof(Ktx2Level) > size) return false;
+    const uint8_t* levelIndex = file.data() + sizeof(Ktx2Header);
+    CompressedImage loaded;
+    loaded.format = format;
+    for (uint32_t i = 0; i < header.levelCount; ++i) {
+        Ktx2Level level;
+        std::memcpy(&level, levelIndex + i * sizeof(Ktx2Level), sizeof(level));
+        CompressedLevel entry;
+        entry.width = std::max(1u, header.pixelWidth >> i);
+        entry.height = std::max(1u, header.pixelHeight >> i);
+        entry.size = compressedLevelSize(format, entry.width, entry.height);
+        entry.offset = loaded.data.size();
+        if (level.byteLength != entry.size || level.byteOffset > size || level.byteLength > size - level.byteOffset) return false;
+        loaded.data.insert(loaded.data.end(), file.data() + level.byteOffset, file.data() + level.byteOffset + level.byteLength);
+        loaded.levels.push_back(entry);
+    }
+    image = std::move(loaded);
+    return true;
+}
+
+bool Ktx2Cache::write(const std::string& path, uint64_t sourceHash, const CompressedImage& image) {
+    if (image.levels.empty()) return false;
+    const std::vector<uint32_t> dfd = dataFormatDescriptor(image.format);
+    const SourceInfo info = {sourceHash, VERSION, 0};
+    std::vector<uint8_t> kvd(4 + sizeof(SOURCE_KEY) + sizeof(SourceInfo));
+    const uint32_t entryLength = static_cast<uint32_t>(kvd.size() - 4);
+    std::memcpy(kvd.data(), &entryLength, 4);
+    std::memcpy(kvd.data() + 4, SOURCE_KEY, sizeof(SOURCE_KEY));
+    std::memcpy(kvd.data() + 4 + sizeof(SOURCE_KEY), &info, sizeof(info));
+    kvd.resize(align(kvd.size(), 4), 0);
+
+    const uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+    Ktx2Header header = {};
+    std::memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+    header.vkFormat = formatInfo(image.format).vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = image.width();
+    header.pixelHeight = image.height();
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+    header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level));
+    header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+
+    // KTX2 stores the smallest level first
+    std::vector<Ktx2Level> levels(levelCount);
+    uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+    for (uint32_t i = levelCount; i-- > 0;) {
+        offset = align(offset, LEVEL_ALIGNMENT);
+        levels[i] = {offset, image.levels[i].size, image.levels[i].size};
+        offset += image.levels[i].size;
+    }
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size() * sizeof(Ktx2Level)));
+        out.write(reinterpret_cast<const char*>(dfd.data()), header.dfdByteLength);
+        out.write(reinterpret_cast<const char*>(kvd.data()), header.kvdByteLength);
+        static const char zeros[LEVEL_ALIGNMENT] = {};
+        for (uint32_t i = levelCount; i-- > 0;) {
+            const uint64_t position = static_cast<uint64_t>(out.tellp());
+            out.write(zeros, static_cast<std::streamsize>(levels[i].byteOffset - position));
+            out.write(reinterpret_cast<const char*>(image.data.data() + image.levels[i].offset), static_cast<std::streamsize>(image.levels[i].size));
+        }
+        if (!out) {
+            out.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
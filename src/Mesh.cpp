@@ -1,21 +1,56 @@
 #include <Mesh.hpp>
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <memory>
 #include <string>
 
-void Mesh::setup_mesh() {
+namespace {
+    // glBufferData on the bound buffer, without the contents when they are deferred
+    void buffer_data(GLenum target, GLuint buffer, size_t size, const void* data, GLenum usage, std::vector<BufferUpload>* deferred) {
+        glBufferData(target, static_cast<GLsizeiptr>(size), deferred ? nullptr : data, usage);
+        if (deferred && size > 0) deferred->push_back(BufferUpload{buffer, data, size});
+    }
+}
+
+void Mesh::setup_mesh(std::vector<BufferUpload>* deferred) {
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ebo);
   
-    // Vertices
     glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW); 
+    if (layout == VertexLayout::Separate) {
+        setup_separate(deferred);
+    }
+    else if (layout == VertexLayout::Quantized) {
+        setup_quantized(deferred);
+    }
+    else {
+        setup_interleaved(deferred);
+    }
 
     // Indices
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    buffer_data(GL_ELEMENT_ARRAY_BUFFER, ebo, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW, deferred);
+
+    glBindVertexArray(0);
+}
+
+void Mesh::upload_buffer_range(const BufferUpload& upload, size_t offset, size_t size) {
+    // The copy target keeps the element buffer binding of the bound VAO
+    glBindBuffer(GL_COPY_WRITE_BUFFER, upload.buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), static_cast<const char*>(upload.data) + offset);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+bool Mesh::is_uploaded() const {
+    return vao != 0;
+}
+
+void Mesh::setup_interleaved(std::vector<BufferUpload>* deferred) {
+    // Vertices
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    buffer_data(GL_ARRAY_BUFFER, vbo, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW, deferred);
 
     // Vertex position
     glEnableVertexAttribArray(0);
@@ -36,8 +71,78 @@ void Mesh::setup_mesh() {
     // Vertex uv
     glEnableVertexAttribArray(4);
     glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+}
 
-    glBindVertexArray(0);
+void Mesh::setup_separate(std::vector<BufferUpload>* deferred) {
+    // Vertex position, the only stream rewritten by CPU deformation
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    buffer_data(GL_ARRAY_BUFFER, vbo, positions.size() * sizeof(glm::vec3), positions.data(), GL_DYNAMIC_DRAW, deferred);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+    // Normal, tangent, bitangent and uv, each in its own buffer
+    glGenBuffers(ATTRIBUTE_STREAMS, attribute_vbos);
+    const void* data[ATTRIBUTE_STREAMS] = {normals.data(), tangents.data(), bitangents.data(), uvs.data()};
+    const size_t sizes[ATTRIBUTE_STREAMS] = {
+        normals.size() * sizeof(glm::vec3),
+        tangents.size() * sizeof(glm::vec3),
+        bitangents.size() * sizeof(glm::vec3),
+        uvs.size() * sizeof(glm::vec2)
+    };
+    const GLint components[ATTRIBUTE_STREAMS] = {3, 3, 3, 2};
+    for (int stream = 0; stream < ATTRIBUTE_STREAMS; ++stream) {
+        glBindBuffer(GL_ARRAY_BUFFER, attribute_vbos[stream]);
+        buffer_data(GL_ARRAY_BUFFER, attribute_vbos[stream], sizes[stream], data[stream], GL_STATIC_DRAW, deferred);
+        glEnableVertexAttribArray(stream + 1);
+        glVertexAttribPointer(stream + 1, components[stream], GL_FLOAT, GL_FALSE, 0, (void*)0);
+    }
+}
+
+void Mesh::setup_quantized(std::vector<BufferUpload>* deferred) {
+    // Vertex position, kept in floats for CPU deformation
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    buffer_data(GL_ARRAY_BUFFER, vbo, positions.size() * sizeof(glm::vec3), positions.data(), GL_DYNAMIC_DRAW, deferred);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+    glGenBuffers(1, &attribute_vbos[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, attribute_vbos[0]);
+    buffer_data(GL_ARRAY_BUFFER, attribute_vbos[0], packed_attributes.size() * sizeof(PackedAttributes), packed_attributes.data(), GL_STATIC_DRAW, deferred);
+
+    // Tangent frame quaternion, decoded by the vertex shader
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_SHORT, GL_TRUE, sizeof(PackedAttributes), (void*)offsetof(PackedAttributes, tangent_frame));
+
+    // Vertex uv, half floats are converted by the vertex fetch
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedAttributes), (void*)offsetof(PackedAttributes, uv));
+}
+
+void Mesh::split_streams() {
+    const size_t count = vertices.size();
+    positions.resize(count);
+    normals.resize(count);
+    tangents.resize(count);
+    bitangents.resize(count);
+    uvs.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        positions[i] = vertices[i].position;
+        normals[i] = vertices[i].normal;
+        tangents[i] = vertices[i].tangent;
+        bitangents[i] = vertices[i].bitangent;
+        uvs[i] = vertices[i].uv;
+    }
+    vertices.clear();
+    vertices.shrink_to_fit();
+}
+
+void Mesh::pack_streams() {
+    quantization_error = QuantizationError();
+    packed_attributes = packAttributes(normals, tangents, bitangents, uvs, quantization_error);
+    normals = std::vector<glm::vec3>();
+    tangents = std::vector<glm::vec3>();
+    bitangents = std::vector<glm::vec3>();
+    uvs = std::vector<glm::vec2>();
 }
 
 void Mesh::add_texture(std::shared_ptr<Texture> texture) {
@@ -111,5 +216,245 @@ void Mesh::unbind_shader() {
 }
 
 glm::vec3 Mesh::getVerticeFromIndice(unsigned int indice) {
+    if (layout != VertexLayout::Interleaved) return this->positions[indice];
     return this->vertices[indice].position;
+}
+
+size_t Mesh::vertex_count() const {
+    return layout != VertexLayout::Interleaved ? positions.size() : vertices.size();
+}
+
+size_t Mesh::vertex_size() const {
+    switch (layout) {
+        case VertexLayout::Separate:
+            return 4 * sizeof(glm::vec3) + sizeof(glm::vec2);
+        case VertexLayout::Quantized:
+            return sizeof(glm::vec3) + sizeof(PackedAttributes);
+        default:
+            return sizeof(Vertex);
+    }
+}
+
+std::vector<glm::vec3> Mesh::get_positions() const {
+    if (layout != VertexLayout::Interleaved) return positions;
+    std::vector<glm::vec3> result(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        result[i] = vertices[i].position;
+    }
+    return result;
+}
+
+size_t Mesh::set_positions(const PositionsSoA& new_positions) {
+    return set_positions(new_positions, {VertexRange{0, vertex_count()}});
+}
+
+size_t Mesh::set_positions(const PositionsSoA& new_positions, const std::vector<VertexRange>& ranges) {
+    for (const VertexRange& range : ranges) {
+        if (layout != VertexLayout::Interleaved) {
+            for (size_t i = range.begin; i < range.end; ++i) {
+                positions[i] = new_positions.get(i);
+            }
+        }
+        else {
+            for (size_t i = range.begin; i < range.end; ++i) {
+                vertices[i].position = new_positions.get(i);
+            }
+        }
+        mark_positions_dirty(range);
+    }
+    return update_positions();
+}
+
+void Mesh::mark_positions_dirty(VertexRange range) {
+    range.end = std::min(range.end, vertex_count());
+    if (range.begin < range.end) dirty_ranges.push_back(range);
+}
+
+// Close ranges are merged, one larger copy beats many small calls
+std::vector<VertexRange> Mesh::merge_ranges(std::vector<VertexRange> ranges) {
+    std::sort(ranges.begin(), ranges.end(), [](const VertexRange& a, const VertexRange& b) { return a.begin < b.begin; });
+    std::vector<VertexRange> merged;
+    for (const VertexRange& range : ranges) {
+        if (!merged.empty() && range.begin <= merged.back().end + DIRTY_MERGE_GAP) {
+            merged.back().end = std::max(merged.back().end, range.end);
+        }
+        else {
+            merged.push_back(range);
+        }
+    }
+    return merged;
+}
+
+std::vector<glm::vec2> Mesh::get_uvs() const {
+    switch (layout) {
+        case VertexLayout::Separate:
+            return uvs;
+        case VertexLayout::Quantized: {
+            std::vector<glm::vec2> result(packed_attributes.size());
+            glm::vec3 normal, tangent, bitangent;
+            for (size_t i = 0; i < result.size(); ++i) {
+                unpackAttributes(packed_attributes[i], normal, tangent, bitangent, result[i]);
+            }
+            return result;
+        }
+        default: {
+            std::vector<glm::vec2> result(vertices.size());
+            for (size_t i = 0; i < vertices.size(); ++i) {
+                result[i] = vertices[i].uv;
+            }
+            return result;
+        }
+    }
+}
+
+FramesSoA Mesh::get_frames() const {
+    FramesSoA frames;
+    frames.resize(vertex_count());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        glm::vec3 normal, tangent, bitangent;
+        switch (layout) {
+            case VertexLayout::Separate:
+                normal = normals[i];
+                tangent = tangents[i];
+                bitangent = bitangents[i];
+                break;
+            case VertexLayout::Quantized: {
+                glm::vec2 uv;
+                unpackAttributes(packed_attributes[i], normal, tangent, bitangent, uv);
+                break;
+            }
+            default:
+                normal = vertices[i].normal;
+                tangent = vertices[i].tangent;
+                bitangent = vertices[i].bitangent;
+                break;
+        }
+        frames.normal.set(i, normal);
+        frames.tangent.set(i, tangent);
+        frames.bitangent.set(i, bitangent);
+    }
+    return frames;
+}
+
+size_t Mesh::set_frames(const FramesSoA& frames, const std::vector<VertexRange>& ranges) {
+    std::vector<VertexRange> clamped;
+    for (VertexRange range : ranges) {
+        range.end = std::min(range.end, std::min(vertex_count(), frames.size()));
+        if (range.begin < range.end) clamped.push_back(range);
+    }
+    if (layout == VertexLayout::Interleaved) {
+        for (const VertexRange& range : clamped) {
+            for (size_t i = range.begin; i < range.end; ++i) {
+                vertices[i].normal = frames.normal.get(i);
+                vertices[i].tangent = frames.tangent.get(i);
+                vertices[i].bitangent = frames.bitangent.get(i);
+            }
+            mark_positions_dirty(range);
+        }
+        return 0;
+    }
+    const std::vector<VertexRange> merged = merge_ranges(std::move(clamped));
+    size_t sent = 0;
+    if (layout == VertexLayout::Quantized) {
+        // The uv is kept, the frame is packed again
+        for (const VertexRange& range : merged) {
+            for (size_t i = range.begin; i < range.end; ++i) {
+                glm::vec3 normal, tangent, bitangent;
+                glm::vec2 uv;
+                unpackAttributes(packed_attributes[i], normal, tangent, bitangent, uv);
+                packed_attributes[i] = packAttributes(frames.normal.get(i), frames.tangent.get(i), frames.bitangent.get(i), uv);
+            }
+        }
+        if (attribute_vbos[0] == 0) return 0;
+        glBindBuffer(GL_ARRAY_BUFFER, attribute_vbos[0]);
+        for (const VertexRange& range : merged) {
+            const size_t size = (range.end - range.begin) * sizeof(PackedAttributes);
+            glBufferSubData(GL_ARRAY_BUFFER, range.begin * sizeof(PackedAttributes), size, packed_attributes.data() + range.begin);
+            sent += size;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return sent;
+    }
+    std::vector<glm::vec3>* streams[3] = {&normals, &tangents, &bitangents};
+    const PositionsSoA* sources[3] = {&frames.normal, &frames.tangent, &frames.bitangent};
+    for (int stream = 0; stream < 3; ++stream) {
+        std::vector<glm::vec3>& target = *streams[stream];
+        for (const VertexRange& range : merged) {
+            for (size_t i = range.begin; i < range.end; ++i) {
+                target[i] = sources[stream]->get(i);
+            }
+        }
+        if (attribute_vbos[stream] == 0) continue;
+        glBindBuffer(GL_ARRAY_BUFFER, attribute_vbos[stream]);
+        for (const VertexRange& range : merged) {
+            const size_t size = (range.end - range.begin) * sizeof(glm::vec3);
+            glBufferSubData(GL_ARRAY_BUFFER, range.begin * sizeof(glm::vec3), size, target.data() + range.begin);
+            sent += size;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return sent;
+}
+
+size_t Mesh::update_positions() {
+    if (dirty_ranges.empty()) return 0;
+    const std::vector<VertexRange> merged = merge_ranges(std::move(dirty_ranges));
+    dirty_ranges.clear();
+
+    // Interleaved vertices can only be sent whole
+    const bool interleaved = layout == VertexLayout::Interleaved;
+    const size_t stride = interleaved ? sizeof(Vertex) : sizeof(glm::vec3);
+    const unsigned char* data = interleaved ? reinterpret_cast<const unsigned char*>(vertices.data()) : reinterpret_cast<const unsigned char*>(positions.data());
+    size_t sent = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (const VertexRange& range : merged) {
+        const size_t size = (range.end - range.begin) * stride;
+        glBufferSubData(GL_ARRAY_BUFFER, range.begin * stride, size, data + range.begin * stride);
+        sent += size;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return sent;
+}
+
+void Mesh::build_bvh() {
+    this->bvh = std::make_shared<BVH>(get_positions(), indices);
+}
+
+void Mesh::build_adjacency() {
+    this->adjacency = std::make_shared<VertexAdjacency>(indices, get_positions());
+}
+
+void Mesh::refit_bvh(const PositionsSoA& positions, const AABB& region, ThreadPool& pool) {
+    if (!bvh) {
+        // Brute-force picking tests the flat packets, repacked from the new positions
+        pool.parallelFor(0, triangle_packets.size(), PACKET_REFIT_GRAIN, [&](size_t first, size_t last) {
+            for (size_t p = first; p < last; ++p) {
+                const size_t end = std::min((p + 1) * TrianglePacket::WIDTH, indices.size() / 3);
+                for (size_t t = p * TrianglePacket::WIDTH; t < end; ++t) {
+                    const unsigned int* corners = &indices[3 * t];
+                    triangle_packets[p].set(static_cast<int>(t % TrianglePacket::WIDTH), positions.get(corners[0]), positions.get(corners[1]), positions.get(corners[2]), static_cast<uint32_t>(t));
+                }
+            }
+        });
+        return;
+    }
+    if (bvh_rebuild && bvh_rebuild->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        // The new tree was built from a snapshot, catch up with later strokes
+        bvh = bvh_rebuild->result.get();
+        bvh_rebuild.reset();
+        bvh->refit(positions, AABB::infinite(), pool);
+        return;
+    }
+    bvh->refit(positions, region, pool);
+    if (!bvh_rebuild && bvh->getDegradation() > BVH_REBUILD_THRESHOLD) {
+        std::vector<glm::vec3> snapshot(positions.size());
+        for (size_t i = 0; i < snapshot.size(); ++i) {
+            snapshot[i] = positions.get(i);
+        }
+        auto job = std::make_shared<BVHRebuild>();
+        job->result = std::async(std::launch::async, [snapshot = std::move(snapshot), indices = this->indices]() {
+            return std::make_shared<BVH>(snapshot, indices);
+        });
+        bvh_rebuild = job;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include <MeshCache.hpp>
+#include <Hash.hpp>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr char MAGIC[4] = {'K', 'M', 'S', 'H'};
+    constexpr uint64_t ALIGNMENT = 16;
+
+    static_assert(sizeof(Vertex) == 14 * sizeof(float), "Vertex must stay tightly packed to be cached");
+    static_assert(sizeof(MeshCacheHeader) % ALIGNMENT == 0, "MeshCacheHeader must keep the sections aligned");
+    static_assert(sizeof(MeshCacheEntry) == 80, "MeshCacheEntry layout changed, bump MeshCache::VERSION");
+    static_assert(sizeof(MeshCacheMesh) == 64, "MeshCacheMesh layout changed, bump MeshCache::VERSION");
+
+    uint64_t align(uint64_t offset) {
+        return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    void copyVec3(float* to, const glm::vec3& from) {
+        to[0] = from.x;
+        to[1] = from.y;
+        to[2] = from.z;
+    }
+
+    // %XX escapes of a relative glTF uri
+    std::string decodeUri(const std::string& uri) {
+        std::string decoded;
+        for (size_t i = 0; i < uri.size(); ++i) {
+            if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit(static_cast<unsigned char>(uri[i + 1])) && std::isxdigit(static_cast<unsigned char>(uri[i + 2]))) {
+                decoded += static_cast<char>(std::stoi(uri.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            }
+            else {
+                decoded += uri[i];
+            }
+        }
+        return decoded;
+    }
+
+    // External files of the "buffers" array of a .gltf, embedded data: uris are skipped
+    std::vector<std::string> gltfBufferUris(const char* json, size_t size) {
+        std::vector<std::string> uris;
+        const std::string text(json, size);
+        size_t position = text.find("\"buffers\"");
+        if (position == std::string::npos) return uris;
+        position = text.find('[', position);
+        if (position == std::string::npos) return uris;
+        size_t end = position;
+        for (int depth = 0; end < text.size(); ++end) {
+            if (text[end] == '[') depth++;
+            if (text[end] == ']' && --depth == 0) break;
+        }
+        while ((position = text.find("\"uri\"", position)) != std::string::npos && position < end) {
+            const size_t open = text.find('"', text.find(':', position + 5));
+            const size_t close = open == std::string::npos ? std::string::npos : text.find('"', open + 1);
+            if (close == std::string::npos) break;
+            const std::string uri = text.substr(open + 1, close - open - 1);
+            if (uri.compare(0, 5, "data:") != 0) uris.push_back(decodeUri(uri));
+            position = close + 1;
+        }
+        return uris;
+    }
+
+    void writeSection(std::ofstream& out, const void* data, uint64_t size, uint64_t offset) {
+        // Zero padding up to the aligned section offset
+        static const char zeros[ALIGNMENT] = {};
+        const uint64_t position = static_cast<uint64_t>(out.tellp());
+        out.write(zeros, static_cast<std::streamsize>(offset - position));
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+}
+
+std::string MeshCache::cachePath(const std::string& sourcePath) {
+    return sourcePath + ".kmesh";
+}
+
+uint64_t MeshCache::hashSource(const std::string& path) {
+    MappedFile file(path);
+    if (!file.isOpen()) return 0;
+    uint64_t hash = fnv1a64(file.data(), file.size());
+    const std::string extension = path.size() >= 5 ? path.substr(path.size() - 5) : std::string();
+    if (extension != ".gltf") return hash;
+    // Edited .bin buffers must invalidate the cache as well
+    const size_t slash = path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    for (const std::string& uri : gltfBufferUris(reinterpret_cast<const char*>(file.data()), file.size())) {
+        MappedFile buffer(directory + uri);
+        if (!buffer.isOpen()) return 0;
+        hash = fnv1a64(uri.data(), uri.size(), hash);
+        hash = fnv1a64(buffer.data(), buffer.size(), hash);
+    }
+    return hash;
+}
+
+bool MeshCache::open(const std::string& path, uint64_t sourceHash, uint32_t importFlags) {
+    close();
+    if (!m_file.open(path)) return false;
+    if (m_file.size() < sizeof(MeshCacheHeader)) {
+        close();
+        return false;
+    }
+    m_header = section<MeshCacheHeader>(0);
+    if (!validate(sourceHash, importFlags)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MeshCache::close() {
+    m_file.close();
+    m_header = nullptr;
+}
+
+bool MeshCache::validate(uint64_t sourceHash, uint32_t importFlags) const {
+    const MeshCacheHeader& h = *m_header;
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION) return false;
+    if (h.sourceHash != sourceHash || h.importFlags != importFlags || h.vertexSize != sizeof(Vertex)) return false;
+    // Every section must lie inside the file
+    const uint64_t size = m_file.size();
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t stride) {
+        return offset <= size && count <= (size - offset) / stride;
+    };
+    const bool sections = fits(h.entriesOffset, h.entryCount, sizeof(MeshCacheEntry)) &&
+                          fits(h.meshesOffset, h.meshCount, sizeof(MeshCacheMesh)) &&
+                          fits(h.materialsOffset, h.materialCount, sizeof(MeshCacheMaterial)) &&
+                          fits(h.texturesOffset, h.textureCount, sizeof(MeshCacheTexture)) &&
+                          fits(h.stringsOffset, h.stringsSize, 1) &&
+                          fits(h.verticesOffset, h.vertexCount, sizeof(Vertex)) &&
+                          fits(h.indicesOffset, h.indexCount, sizeof(unsigned int));
+    if (!sections) return false;
+    // Every mesh must lie inside the streams and only index its own vertices
+    for (uint32_t i = 0; i < h.meshCount; ++i) {
+        const MeshCacheMesh& mesh = getMesh(i);
+        if (mesh.firstVertex > h.vertexCount || mesh.vertexCount > h.vertexCount - mesh.firstVertex) return false;
+        if (mesh.firstIndex > h.indexCount || mesh.indexCount > h.indexCount - mesh.firstIndex) return false;
+        const unsigned int* indices = getIndices(mesh);
+        for (uint32_t n = 0; n < mesh.indexCount; ++n) {
+            if (indices[n] >= mesh.vertexCount) return false;
+        }
+    }
+    return true;
+}
+
+const MeshCacheHeader& MeshCache::getHeader() const {
+    return *m_header;
+}
+
+const MeshCacheEntry& MeshCache::getEntry(size_t index) const {
+    return section<MeshCacheEntry>(m_header->entriesOffset)[index];
+}
+
+const MeshCacheMesh& MeshCache::getMesh(size_t index) const {
+    return section<MeshCacheMesh>(m_header->meshesOffset)[index];
+}
+
+const MeshCacheMaterial& MeshCache::getMaterial(size_t index) const {
+    return section<MeshCacheMaterial>(m_header->materialsOffset)[index];
+}
+
+const MeshCacheTexture& MeshCache::getTexture(size_t index) const {
+    return section<MeshCacheTexture>(m_header->texturesOffset)[index];
+}
+
+std::string MeshCache::getString(uint32_t offset, uint32_t length) const {
+    if (static_cast<uint64_t>(offset) + length > m_header->stringsSize) return std::string();
+    return std::string(section<char>(m_header->stringsOffset) + offset, length);
+}
+
+const Vertex* MeshCache::getVertices(const MeshCacheMesh& mesh) const {
+    return section<Vertex>(m_header->verticesOffset) + mesh.firstVertex;
+}
+
+const unsigned int* MeshCache::getIndices(const MeshCacheMesh& mesh) const {
+    return section<unsigned int>(m_header->indicesOffset) + mesh.firstIndex;
+}
+
+uint32_t MeshCacheWriter::addMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const Material* material) {
+    MeshCacheMesh record = {};
+    record.firstVertex = m_vertices.size();
+    record.firstIndex = m_indices.size();
+    record.vertexCount = static_cast<uint32_t>(vertices.size());
+    record.indexCount = static_cast<uint32_t>(indices.size());
+    record.material = MeshCache::NO_MATERIAL;
+    AABB bounds;
+    for (const auto& vertex : vertices) {
+        bounds.grow(vertex.position);
+    }
+    copyVec3(record.boundsMin, bounds.min);
+    copyVec3(record.boundsMax, bounds.max);
+    m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+
+    if (material) {
+        MeshCacheMaterial mat = {};
+        mat.nameLength = static_cast<uint32_t>(material->name.size());
+        mat.nameOffset = addString(material->name);
+        copyVec3(mat.ambient, material->ambient);
+        copyVec3(mat.diffuse, material->diffuse);
+        copyVec3(mat.specular, material->specular);
+        copyVec3(mat.emissive, material->emissive);
+        mat.shininess = material->shininess;
+        mat.firstTexture = static_cast<uint32_t>(m_textures.size());
+        mat.textureCount = static_cast<uint32_t>(material->textures.size());
+        for (const auto& texture : material->textures) {
+            MeshCacheTexture tex = {};
+            tex.pathLength = static_cast<uint32_t>(texture->path.size());
+            tex.pathOffset = addString(texture->path);
+            tex.typeLength = static_cast<uint32_t>(texture->type.size());
+            tex.typeOffset = addString(texture->type);
+            m_textures.push_back(tex);
+        }
+        record.material = static_cast<uint32_t>(m_materials.size());
+        m_materials.push_back(mat);
+    }
+    m_meshes.push_back(record);
+    return static_cast<uint32_t>(m_meshes.size() - 1);
+}
+
+void MeshCacheWriter::addEntry(uint32_t mesh, const glm::mat4& transform) {
+    MeshCacheEntry entry = {};
+    std::memcpy(entry.transform, &transform[0][0], sizeof(entry.transform));
+    entry.mesh = mesh;
+    m_entries.push_back(entry);
+}
+
+uint32_t MeshCacheWriter::addString(const std::string& value) {
+    const uint32_t offset = static_cast<uint32_t>(m_strings.size());
+    m_strings += value;
+    return offset;
+}
+
+bool MeshCacheWriter::write(const std::string& path, uint64_t sourceHash, uint32_t importFlags) const {
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = MeshCache::VERSION;
+    header.sourceHash = sourceHash;
+    header.importFlags = importFlags;
+    header.vertexSize = sizeof(Vertex);
+    header.entryCount = static_cast<uint32_t>(m_entries.size());
+    header.meshCount = static_cast<uint32_t>(m_meshes.size());
+    header.materialCount = static_cast<uint32_t>(m_materials.size());
+    header.textureCount = static_cast<uint32_t>(m_textures.size());
+    header.entriesOffset = align(sizeof(MeshCacheHeader));
+    header.meshesOffset = align(header.entriesOffset + m_entries.size() * sizeof(MeshCacheEntry));
+    header.materialsOffset = align(header.meshesOffset + m_meshes.size() * sizeof(MeshCacheMesh));
+    header.texturesOffset = align(header.materialsOffset + m_materials.size() * sizeof(MeshCacheMaterial));
+    header.stringsOffset = align(header.texturesOffset + m_textures.size() * sizeof(MeshCacheTexture));
+    header.stringsSize = m_strings.size();
+    header.verticesOffset = align(header.stringsOffset + m_strings.size());
+    header.vertexCount = m_vertices.size();
+    header.indicesOffset = align(header.verticesOffset + m_vertices.size() * sizeof(Vertex));
+    header.indexCount = m_indices.size();
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeSection(out, m_entries.data(), m_entries.size() * sizeof(MeshCacheEntry), header.entriesOffset);
+        writeSection(out, m_meshes.data(), m_meshes.size() * sizeof(MeshCacheMesh), header.meshesOffset);
+        writeSection(out, m_materials.data(), m_materials.size() * sizeof(MeshCacheMaterial), header.materialsOffset);
+        writeSection(out, m_textures.data(), m_textures.size() * sizeof(MeshCacheTexture), header.texturesOffset);
+        writeSection(out, m_strings.data(), m_strings.size(), header.stringsOffset);
+        writeSection(out, m_vertices.data(), m_vertices.size() * sizeof(Vertex), header.verticesOffset);
+        writeSection(out, m_indices.data(), m_indices.size() * sizeof(unsigned int), header.indicesOffset);
+        if (!out) {
+            out.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    // rename() does not replace an existing file everywhere
+    std::remove(path.c_str());
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,313 @@
+#include <MeshOptimization.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+namespace {
+    // Forsyth scoring parameters
+    constexpr int CACHE_SIZE = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+    // Cache size used to split clusters for overdraw ordering
+    constexpr unsigned int CLUSTER_CACHE_SIZE = 16;
+
+    float vertexScore(int cachePosition, unsigned int remaining) {
+        if (remaining == 0) return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // The last triangle's vertices get a fixed score so it is not reused right away
+                score = LAST_TRIANGLE_SCORE;
+            }
+            else {
+                const float scaler = 1.0f / (CACHE_SIZE - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+            }
+        }
+        // Favour vertices with few triangles left to get rid of lone ones
+        score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining), -VALENCE_BOOST_POWER);
+        return score;
+    }
+
+    // FIFO cache simulation: a vertex hits if it was transformed less than CLUSTER_CACHE_SIZE misses ago
+    struct FifoCache {
+        std::vector<unsigned int> timestamps;
+        unsigned int time = CLUSTER_CACHE_SIZE + 1;
+
+        explicit FifoCache(size_t vertexCount) : timestamps(vertexCount, 0) {}
+
+        int misses(const unsigned int* triangle) {
+            int count = 0;
+            for (int k = 0; k < 3; ++k) {
+                unsigned int& stamp = timestamps[triangle[k]];
+                if (time - stamp > CLUSTER_CACHE_SIZE) {
+                    stamp = time++;
+                    count++;
+                }
+            }
+            return count;
+        }
+
+        void reset() {
+            time += CLUSTER_CACHE_SIZE + 1;
+        }
+    };
+
+    // Triangles starting a cluster: the first one, whatever its misses, and the
+    // ones whose 3 vertices miss the cache
+    std::vector<size_t> hardBoundaries(const std::vector<unsigned int>& indices, size_t vertexCount) {
+        std::vector<size_t> boundaries;
+        FifoCache cache(vertexCount);
+        for (size_t t = 0; t < indices.size() / 3; ++t) {
+            if (cache.misses(&indices[3 * t]) == 3 || t == 0) boundaries.push_back(t);
+        }
+        return boundaries;
+    }
+
+    // Splits every hard cluster further wherever the ACMR of the part so far, starting
+    // from an empty cache, is already within threshold of the whole cluster's one.
+    // Reordering such parts costs at most threshold in ACMR.
+    std::vector<size_t> softBoundaries(const std::vector<unsigned int>& indices, size_t vertexCount, const std::vector<size_t>& hard, float threshold) {
+        std::vector<size_t> boundaries;
+        FifoCache cache(vertexCount);
+        for (size_t h = 0; h + 1 < hard.size(); ++h) {
+            const size_t begin = hard[h];
+            const size_t end = hard[h + 1];
+            cache.reset();
+            size_t clusterMisses = 0;
+            for (size_t t = begin; t < end; ++t) {
+                clusterMisses += cache.misses(&indices[3 * t]);
+            }
+            const float clusterThreshold = threshold * clusterMisses / (end - begin);
+
+            cache.reset();
+            boundaries.push_back(begin);
+            size_t start = begin;
+            size_t misses = 0;
+            for (size_t t = begin; t < end; ++t) {
+                misses += cache.misses(&indices[3 * t]);
+                if (t + 1 < end && static_cast<float>(misses) / (t + 1 - start) <= clusterThreshold) {
+                    boundaries.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    cache.reset();
+                }
+            }
+        }
+        return boundaries;
+    }
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indices.empty()) return stats;
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    std::vector<uint8_t> used(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    size_t misses = 0;
+    size_t usedCount = 0;
+    for (unsigned int index : indices) {
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time++;
+            misses++;
+        }
+        if (!used[index]) {
+            used[index] = 1;
+            usedCount++;
+        }
+    }
+    stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / usedCount;
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // Triangles of every vertex, the live ones are kept at the front of each list
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices) {
+        remaining[index]++;
+    }
+    std::vector<size_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<unsigned int> adjacency(offsets[vertexCount]);
+    {
+        std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                adjacency[cursor[indices[3 * t + k]]++] = static_cast<unsigned int>(t);
+            }
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        score[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> newCache;
+    cache.reserve(CACHE_SIZE + 3);
+    newCache.reserve(CACHE_SIZE + 3);
+    size_t cursor = 0;
+    int64_t best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left, restart from the next one in input order
+            while (emitted[cursor]) cursor++;
+            best = static_cast<int64_t>(cursor);
+        }
+        const size_t triangle = static_cast<size_t>(best);
+        emitted[triangle] = 1;
+
+        // Emit and move its vertices to the front of the cache
+        newCache.clear();
+        for (int k = 0; k < 3; ++k) {
+            const unsigned int v = indices[3 * triangle + k];
+            result.push_back(v);
+            newCache.push_back(v);
+            const size_t begin = offsets[v];
+            const size_t end = begin + remaining[v];
+            for (size_t a = begin; a < end; ++a) {
+                if (adjacency[a] == triangle) {
+                    std::swap(adjacency[a], adjacency[end - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+        for (unsigned int v : cache) {
+            if (v != newCache[0] && v != newCache[1] && v != newCache[2]) {
+                newCache.push_back(v);
+            }
+        }
+        for (size_t i = CACHE_SIZE; i < newCache.size(); ++i) {
+            cachePosition[newCache[i]] = -1;
+            score[newCache[i]] = vertexScore(-1, remaining[newCache[i]]);
+        }
+        if (newCache.size() > CACHE_SIZE) {
+            for (size_t i = CACHE_SIZE; i < newCache.size(); ++i) {
+                // Triangles of evicted vertices lose score too
+                const unsigned int v = newCache[i];
+                for (size_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+                    const unsigned int t = adjacency[a];
+                    triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+                }
+            }
+            newCache.resize(CACHE_SIZE);
+        }
+        cache.swap(newCache);
+
+        // Rescore the cached vertices and their live triangles, keep the best
+        for (size_t i = 0; i < cache.size(); ++i) {
+            cachePosition[cache[i]] = static_cast<int>(i);
+            score[cache[i]] = vertexScore(static_cast<int>(i), remaining[cache[i]]);
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (size_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+                const unsigned int t = adjacency[a];
+                triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2 || indices.size() % 3 != 0) return;
+    const VertexCacheStats before = analyzeVertexCache(indices, positions.size(), CLUSTER_CACHE_SIZE);
+
+    std::vector<size_t> hard = hardBoundaries(indices, positions.size());
+    hard.push_back(triangleCount);
+    std::vector<size_t> boundaries = softBoundaries(indices, positions.size(), hard, threshold);
+    boundaries.push_back(triangleCount);
+    const size_t clusterCount = boundaries.size() - 1;
+    if (clusterCount < 2) return;
+
+    // Area weighted centroid and normal of the mesh and of every cluster
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (size_t t = boundaries[c]; t < boundaries[c + 1]; ++t) {
+            const glm::vec3& p0 = positions[indices[3 * t]];
+            const glm::vec3& p1 = positions[indices[3 * t + 1]];
+            const glm::vec3& p2 = positions[indices[3 * t + 2]];
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float area = glm::length(normal);
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    // Clusters facing away from the center cover the others, draw them first
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        const glm::vec3 centroid = areas[c] > 0.0f ? centroids[c] / areas[c] : meshCentroid;
+        const float normalLength = glm::length(normals[c]);
+        const glm::vec3 normal = normalLength > 0.0f ? normals[c] / normalLength : glm::vec3(0.0f);
+        sortKeys[c] = glm::dot(centroid - meshCentroid, normal);
+    }
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        result.insert(result.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+    }
+    // Clusters must cover every triangle exactly once
+    assert(result.size() == indices.size());
+    if (result.size() != indices.size()) return;
+    const VertexCacheStats after = analyzeVertexCache(result, positions.size(), CLUSTER_CACHE_SIZE);
+    if (after.acmr <= before.acmr * threshold) {
+        indices.swap(result);
+    }
+}
+
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount) {
+    const unsigned int unassigned = static_cast<unsigned int>(-1);
+    std::vector<unsigned int> remap(vertexCount, unassigned);
+    unsigned int next = 0;
+    for (unsigned int& index : indices) {
+        if (remap[index] == unassigned) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    for (unsigned int& target : remap) {
+        if (target == unassigned) target = next++;
+    }
+    return remap;
+}
@@ -1,5 +1,8 @@
 #include <Model.hpp>
+#include <MeshOptimization.hpp>
+#include <TextureCache.hpp>
 #include <memory>
+#include <cstring>
 #include <string>
 #include <iostream>
 #include <assimp/postprocess.h>
@@ -8,7 +11,7 @@
 #endif
 
 // Static variable
-std::vector<std::shared_ptr<Texture>> Model::textures_loaded;
+const unsigned int Model::IMPORT_FLAGS = aiProcess_GenSmoothNormals | aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_GenBoundingBoxes;
 
 // Constructors
 Model::Model()  {}
@@ -17,6 +20,14 @@ Model::Model(const std::string& path) {
     load_model(path);
 }
 
+Model::Model(const std::string& path, VertexLayout layout) : layout(layout) {
+    load_model(path);
+}
+
+Model::Model(const std::string& path, VertexLayout layout, bool defer_upload) : layout(layout), defer_upload(defer_upload) {
+    load_model(path);
+}
+
 // Public methods
 void Model::draw() {
     for(const auto &entry : entries) {
@@ -24,6 +35,16 @@ void Model::draw() {
     }
 }
 
+void Model::draw(Shader& shader) {
+    const GLint modelMatrix = shader.getUniformLocation("u_modelMatrix");
+    const GLint quantizedAttributes = shader.getUniformLocation("u_quantizedAttributes");
+    for(const auto &entry : entries) {
+        shader.setMat4(modelMatrix, entry.transform);
+        shader.setBool(quantizedAttributes, entry.mesh->layout == VertexLayout::Quantized);
+        entry.mesh->draw();
+    }
+}
+
 void Model::bind_shader_to_meshes(std::shared_ptr<Shader> shader) {
     for(const auto &entry : entries) {
         entry.mesh->bind_shader(shader);
@@ -44,13 +65,35 @@ void Model::bind_texture_to_meshes(std::shared_ptr<Texture> texture) {
 
 // Private methods
 void Model::load_model(const std::string& path) {
-    Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(path, aiProcess_GenSmoothNormals | aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_GenBoundingBoxes);
-    if(!scene || (scene->mFlags && AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
-        std::cout<<"ERROR::ASSIMP"<<importer.GetErrorString()<<std::endl;
-    }
     directory = path.substr(0, path.find_last_of('/'));
-    process_node(scene->mRootNode, scene, glm::mat4(1.0f)); // -1 for root node
+    const std::string cache_path = MeshCache::cachePath(path);
+    const uint64_t source_hash = use_cache ? MeshCache::hashSource(path) : 0;
+    if (source_hash != 0) {
+        MeshCache cache;
+        if (cache.open(cache_path, source_hash, IMPORT_FLAGS)) {
+            load_from_cache(cache);
+        }
+    }
+    if (entries.empty()) {
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(path, IMPORT_FLAGS);
+        if(!scene || (scene->mFlags && AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
+            std::cout<<"ERROR::ASSIMP"<<importer.GetErrorString()<<std::endl;
+            return;
+        }
+        MeshCacheWriter writer;
+        cache_writer = source_hash != 0 ? &writer : nullptr;
+        process_node(scene->mRootNode, scene, glm::mat4(1.0f)); // -1 for root node
+        cache_writer = nullptr;
+        if (source_hash != 0 && !writer.write(cache_path, source_hash, IMPORT_FLAGS)) {
+            std::cout << "Failed to write mesh cache " << cache_path << std::endl;
+        }
+    }
+    if (layout == VertexLayout::Quantized) {
+        for (const auto& entry : entries) {
+            stats.quantization.grow(entry.mesh->quantization_error);
+        }
+    }
 }
 
 void Model::process_node(aiNode *node, const aiScene *scene, glm::mat4 parent_transform)  {
@@ -59,7 +102,14 @@ void Model::process_node(aiNode *node, const aiScene *scene, glm::mat4 parent_tr
     for(unsigned int i = 0; i < node->mNumMeshes; i++) {
         aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
         auto mesh_data = process_mesh(mesh, scene);
-        entries.push_back(MeshEntry{mesh_data, node_transform});
+        AABB bounds;
+        bounds.grow(glm::vec3(mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z));
+        bounds.grow(glm::vec3(mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z));
+        entries.push_back(MeshEntry{mesh_data, node_transform, bounds});
+        if (cache_writer) {
+            // process_mesh added one cached mesh per entry
+            cache_writer->addEntry(static_cast<uint32_t>(entries.size() - 1), node_transform);
+        }
     }
     for(unsigned int i = 0; i < node->mNumChildren; i++) {
         process_node(node->mChildren[i], scene, node_transform);
@@ -102,21 +152,52 @@ void Model::load_textures_from_material(aiMaterial *material, aiTextureType tex_
 
         // Full texture path
         std::string texture_path = directory + "/" + std::string(str.C_Str());
-        std::replace(texture_path.begin(), texture_path.end(), '\\', '/');
-
-        bool skip = false;
-        for (auto& loaded_tex : textures_loaded) {
-            if (loaded_tex->path == texture_path) {
-                mat->add_texture(loaded_tex);
-                skip = true;
-                break;
+
+        load_texture(texture_path, tex_type_name, mat);
+    }
+}
+
+void Model::load_texture(const std::string& texture_path, const std::string& tex_type_name, std::shared_ptr<Material> mat) {
+    auto texture = TextureCache::instance().acquire(texture_path, tex_type_name);
+    // A cached texture may come from a deferred load that has not been uploaded yet
+    if (!defer_upload) texture->upload();
+    mat->add_texture(texture);
+}
+
+void Model::load_from_cache(const MeshCache& cache) {
+    const MeshCacheHeader& header = cache.getHeader();
+    std::vector<std::shared_ptr<Mesh>> meshes(header.meshCount);
+    std::vector<AABB> bounds(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++) {
+        const MeshCacheMesh& record = cache.getMesh(i);
+        std::shared_ptr<Material> material;
+        if (record.material != MeshCache::NO_MATERIAL && record.material < header.materialCount) {
+            const MeshCacheMaterial& mat = cache.getMaterial(record.material);
+            material = std::make_shared<Material>();
+            material->name = cache.getString(mat.nameOffset, mat.nameLength);
+            material->ambient = glm::vec3(mat.ambient[0], mat.ambient[1], mat.ambient[2]);
+            material->diffuse = glm::vec3(mat.diffuse[0], mat.diffuse[1], mat.diffuse[2]);
+            material->specular = glm::vec3(mat.specular[0], mat.specular[1], mat.specular[2]);
+            material->emissive = glm::vec3(mat.emissive[0], mat.emissive[1], mat.emissive[2]);
+            material->shininess = mat.shininess;
+            for (uint32_t t = mat.firstTexture; t < mat.firstTexture + mat.textureCount && t < header.textureCount; t++) {
+                const MeshCacheTexture& tex = cache.getTexture(t);
+                load_texture(cache.getString(tex.pathOffset, tex.pathLength), cache.getString(tex.typeOffset, tex.typeLength), material);
             }
         }
-        if (!skip) {
-            auto texture = std::make_shared<Texture>(texture_path, tex_type_name);
-            textures_loaded.push_back(texture);
-            mat->add_texture(texture);
-        }
+        const Vertex* vertices = cache.getVertices(record);
+        const unsigned int* indices = cache.getIndices(record);
+        meshes[i] = std::make_shared<Mesh>(std::vector<Vertex>(vertices, vertices + record.vertexCount), std::vector<unsigned int>(indices, indices + record.indexCount), material, layout, !defer_upload);
+        meshes[i]->build_bvh();
+        bounds[i].grow(glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]));
+        bounds[i].grow(glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]));
+    }
+    for (uint32_t i = 0; i < header.entryCount; i++) {
+        const MeshCacheEntry& entry = cache.getEntry(i);
+        if (entry.mesh >= header.meshCount) continue;
+        glm::mat4 transform;
+        std::memcpy(&transform[0][0], entry.transform, sizeof(entry.transform));
+        entries.push_back(MeshEntry{meshes[entry.mesh], transform, bounds[entry.mesh]});
     }
 }
 
@@ -173,12 +254,27 @@ std::shared_ptr<Mesh> Model::process_mesh(aiMesh *mesh, const aiScene *scene) {
             indices.push_back(face.mIndices[j]);
         }
     }
+    // Triangle order for the post-transform cache and overdraw, then vertex order for fetch
+    const VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+    optimizeVertexCache(indices, vertices.size());
+    std::vector<glm::vec3> positions(vertices.size());
+    for(size_t i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].position;
+    }
+    optimizeOverdraw(indices, positions);
+    remapVertices(vertices, optimizeVertexFetch(indices, vertices.size()));
+    const VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+    stats.meshes.push_back(MeshImportStats{mesh->mName.C_Str(), before, after});
     // Textures data
     if(mesh->mMaterialIndex >= 0) {
         aiMaterial *mat = scene->mMaterials[mesh->mMaterialIndex];
         material = load_material_textures(mat);
     }
-    auto newMesh = std::make_shared<Mesh>(vertices, indices, material);
+    if (cache_writer) {
+        cache_writer->addMesh(vertices, indices, material.get());
+    }
+    auto newMesh = std::make_shared<Mesh>(vertices, indices, material, layout, !defer_upload);
+    newMesh->build_bvh();
     return newMesh;
 }
 
@@ -0,0 +1,590 @@
+#include <ModelDeformer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+
+namespace {
+    // Positions of the vertices of one sculpting task, in task order
+    struct SculptScratch {
+        PositionsSoA x;
+        PositionsSoA probe;
+        PositionsSoA out;
+        PositionsSoA sum;
+    };
+
+    // One RK4 stage: k = u(probe) over the substep, sum += weight k, probe = x + next k
+    void rk4Stage(const KelvinletBatch& batch, const std::vector<uint32_t>& active, SculptScratch& s, float weight, float next) {
+        const size_t count = s.x.size();
+        KelvinletDeformer::evaluate(batch, active.data(), active.size(), s.probe, s.out, 0, count);
+        for (size_t i = 0; i < count; ++i) {
+            const glm::vec3 k = s.out.get(i) - s.probe.get(i);
+            s.sum.set(i, s.sum.get(i) + weight * k);
+            s.probe.set(i, s.x.get(i) + next * k);
+        }
+    }
+}
+
+ModelDeformer::ModelDeformer() {}
+
+ModelDeformer::ModelDeformer(const Model& model) {
+    setModel(model);
+}
+
+void ModelDeformer::setModel(const Model& model) {
+    m_targets.clear();
+    for (const auto& entry : model.entries) {
+        // Several entries may instance the same mesh, deform it only once
+        bool known = std::any_of(m_targets.begin(), m_targets.end(), [&](const Target& target) { return target.mesh == entry.mesh; });
+        if (!known) {
+            Target target;
+            target.mesh = entry.mesh;
+            target.deformer = KelvinletDeformer(*entry.mesh);
+            if (m_normalUpdate == NormalUpdate::Analytic) target.deformer.setRestFrames(entry.mesh->get_frames());
+            // Assimp's bounds, or the rest pose's for models without them
+            target.bounds = entry.bounds;
+            if (target.bounds.empty()) {
+                const PositionsSoA& rest = target.deformer.getRestPositions();
+                for (size_t i = 0; i < rest.size(); ++i) target.bounds.grow(rest.get(i));
+            }
+            m_targets.push_back(std::move(target));
+        }
+    }
+    // An absolute tolerance only makes sense at the scale of the model
+    float diagonal = 0.0f;
+    for (const Target& target : m_targets) {
+        if (!target.bounds.empty()) diagonal = std::max(diagonal, glm::length(target.bounds.max - target.bounds.min));
+    }
+    if (diagonal > 0.0f) m_tolerance = TOLERANCE_FRACTION * diagonal;
+}
+
+void ModelDeformer::selectVertices(Target& target, ThreadPool& pool) {
+    target.previous.swap(target.displaced);
+    target.displaced.clear();
+    target.allPrevious = target.allDisplaced;
+    target.allDisplaced = false;
+    std::vector<uint32_t> reaching;
+    for (uint32_t j = 0; j < m_reach.size(); ++j) {
+        const glm::vec3 x0(m_reach[j]);
+        if (target.bounds.distanceSquared(x0) > m_reach[j].w) continue;
+        // The whole mesh is within reach of one instance
+        const glm::vec3 farthest = glm::max(glm::abs(target.bounds.min - x0), glm::abs(target.bounds.max - x0));
+        if (glm::dot(farthest, farthest) <= m_reach[j].w) {
+            target.allDisplaced = true;
+            return;
+        }
+        reaching.push_back(j);
+    }
+    if (reaching.empty()) return;
+
+    const PositionsSoA& rest = target.deformer.getRestPositions();
+    const size_t count = target.deformer.size();
+    const size_t denseCount = static_cast<size_t>(count * DENSE_FRACTION);
+    if (!target.grid.isBuilt()) {
+        target.grid.build(rest, SpatialGrid::suggestCellSize(rest, target.mesh->indices), pool);
+    }
+    // Spans of instance reaching[k] start at offsets[k]
+    std::vector<GridSpan> spans;
+    std::vector<size_t> offsets;
+    size_t candidates = 0;
+    for (uint32_t j : reaching) {
+        offsets.push_back(spans.size());
+        const size_t first = spans.size();
+        if (!target.grid.query(glm::vec3(m_reach[j]), std::sqrt(m_reach[j].w), spans)) {
+            target.allDisplaced = true;
+            return;
+        }
+        for (size_t s = first; s < spans.size(); ++s) candidates += spans[s].end - spans[s].begin;
+        if (candidates > denseCount) {
+            target.allDisplaced = true;
+            return;
+        }
+    }
+    offsets.push_back(spans.size());
+    for (size_t k = 0; k < reaching.size(); ++k) {
+        const glm::vec4 reach = m_reach[reaching[k]];
+        for (size_t s = offsets[k]; s < offsets[k + 1]; ++s) {
+            for (const uint32_t* i = spans[s].begin; i != spans[s].end; ++i) {
+                const glm::vec3 r = rest.get(*i) - glm::vec3(reach);
+                if (glm::dot(r, r) <= reach.w) target.displaced.push_back(*i);
+            }
+        }
+    }
+    // Vertex order keeps the kernel's accesses and the dirty ranges local.
+    // Overlapping instances select some vertices more than once.
+    std::sort(target.displaced.begin(), target.displaced.end());
+    target.displaced.erase(std::unique(target.displaced.begin(), target.displaced.end()), target.displaced.end());
+}
+
+void ModelDeformer::cullInstances(const AABB& bounds, std::vector<uint32_t>& active) const {
+    active.clear();
+    for (uint32_t j = 0; j < m_reach.size(); ++j) {
+        if (bounds.distanceSquared(glm::vec3(m_reach[j])) <= m_reach[j].w) active.push_back(j);
+    }
+}
+
+void ModelDeformer::addTasks(std::vector<Task>& tasks, size_t target, const uint32_t* indices, size_t count, size_t chunk) {
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        tasks.push_back(Task{target, indices, begin, std::min(begin + chunk, count)});
+    }
+}
+
+std::vector<VertexRange> ModelDeformer::dirtyRanges(const Target& target) {
+    std::vector<VertexRange> ranges;
+    if (target.allDisplaced || target.allPrevious || target.allSculpted) {
+        if (target.deformer.size() > 0) ranges.push_back(VertexRange{0, target.deformer.size()});
+        return ranges;
+    }
+    std::vector<uint32_t> moved;
+    moved.reserve(target.displaced.size() + target.previous.size());
+    std::set_union(target.displaced.begin(), target.displaced.end(), target.previous.begin(), target.previous.end(), std::back_inserter(moved));
+    std::vector<uint32_t> vertices;
+    vertices.reserve(moved.size() + target.sculpted.size());
+    std::set_union(moved.begin(), moved.end(), target.sculpted.begin(), target.sculpted.end(), std::back_inserter(vertices));
+    for (uint32_t i : vertices) {
+        if (!ranges.empty() && ranges.back().end == i) {
+            ranges.back().end = i + 1;
+        }
+        else {
+            ranges.push_back(VertexRange{i, i + 1});
+        }
+    }
+    return ranges;
+}
+
+void ModelDeformer::apply(const Kelvinlet& kelvinlet, const glm::vec3& x0, ThreadPool& pool) {
+    KelvinletBatch batch(kelvinlet);
+    batch.add(x0);
+    apply(batch, pool);
+}
+
+void ModelDeformer::apply(const KelvinletBatch& batch, ThreadPool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    // Rest positions within the influence radius of an instance move by at most
+    // its maxDisplacement, plus that of the other instances reaching them
+    AABB region;
+    float totalDisplacement = 0.0f;
+    m_reach.clear();
+    for (size_t j = 0; j < batch.size(); ++j) {
+        const Kelvinlet instance = batch.getKelvinlet(j);
+        const float influence = instance.influenceRadius(m_tolerance);
+        const glm::vec3& x0 = batch.getInstance(j).x0;
+        m_reach.push_back(glm::vec4(x0, influence * influence));
+        region.grow(x0 - glm::vec3(influence));
+        region.grow(x0 + glm::vec3(influence));
+        totalDisplacement += instance.maxDisplacement();
+    }
+    if (!region.empty()) {
+        region.min -= glm::vec3(totalDisplacement);
+        region.max += glm::vec3(totalDisplacement);
+    }
+
+    m_resets.clear();
+    m_evaluations.clear();
+    m_lastStats.vertices = 0;
+    m_lastStats.gridTargets = 0;
+    for (size_t t = 0; t < m_targets.size(); ++t) {
+        Target& target = m_targets[t];
+        selectVertices(target, pool);
+        const size_t count = target.deformer.size();
+        if (target.allDisplaced) {
+            if (target.chunkBounds.empty()) {
+                const PositionsSoA& rest = target.deformer.getRestPositions();
+                for (size_t begin = 0; begin < count; begin += CHUNK_VERTICES) {
+                    AABB bounds;
+                    for (size_t i = begin; i < std::min(begin + CHUNK_VERTICES, count); ++i) bounds.grow(rest.get(i));
+                    target.chunkBounds.push_back(bounds);
+                }
+            }
+            addTasks(m_evaluations, t, nullptr, count, CHUNK_VERTICES);
+            m_lastStats.vertices += count;
+            continue;
+        }
+        // Vertices left displaced by the previous sample go back to rest first
+        if (target.allPrevious) {
+            addTasks(m_resets, t, nullptr, count, CHUNK_VERTICES);
+        }
+        else {
+            addTasks(m_resets, t, target.previous.data(), target.previous.size(), CHUNK_INDICES);
+        }
+        addTasks(m_evaluations, t, target.displaced.data(), target.displaced.size(), CHUNK_INDICES);
+        m_lastStats.vertices += target.displaced.size();
+        if (!target.displaced.empty()) m_lastStats.gridTargets++;
+    }
+
+    pool.parallelFor(0, m_resets.size(), 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const Task& task = m_resets[i];
+            KelvinletDeformer& deformer = m_targets[task.target].deformer;
+            if (task.indices) {
+                deformer.resetIndices(task.indices + task.begin, task.end - task.begin);
+            }
+            else {
+                deformer.resetRange(task.begin, task.end);
+            }
+        }
+    });
+    std::atomic<size_t> evaluations(0);
+    pool.parallelFor(0, m_evaluations.size(), 1, [&](size_t first, size_t last) {
+        std::vector<uint32_t> active;
+        for (size_t i = first; i < last; ++i) {
+            const Task& task = m_evaluations[i];
+            Target& target = m_targets[task.target];
+            AABB bounds;
+            if (task.indices) {
+                const PositionsSoA& rest = target.deformer.getRestPositions();
+                for (size_t n = task.begin; n < task.end; ++n) bounds.grow(rest.get(task.indices[n]));
+            }
+            else {
+                bounds = target.chunkBounds[task.begin / CHUNK_VERTICES];
+            }
+            cullInstances(bounds, active);
+            // No instance left still resets the chunk to rest
+            if (task.indices) {
+                target.deformer.applyIndices(batch, active.data(), active.size(), task.indices + task.begin, task.end - task.begin);
+            }
+            else {
+                target.deformer.applyRange(batch, active.data(), active.size(), task.begin, task.end);
+            }
+            evaluations.fetch_add(active.size() * (task.end - task.begin), std::memory_order_relaxed);
+        }
+    });
+    auto end = std::chrono::steady_clock::now();
+
+    m_dirtyRegion = m_lastRegion;
+    m_dirtyRegion.grow(region);
+    m_lastRegion = region;
+
+    m_lastStats.wallMs = std::chrono::duration<double, std::milli>(end - start).count();
+    m_lastStats.chunks = m_resets.size() + m_evaluations.size();
+    m_lastStats.brushes = batch.size();
+    m_lastStats.brushEvaluations = evaluations.load();
+    m_lastStats.totalVertices = 0;
+    for (const auto& target : m_targets) {
+        m_lastStats.totalVertices += target.deformer.size();
+    }
+}
+
+void ModelDeformer::sculpt(const KelvinletBatch& from, const KelvinletBatch& to, float dt, const std::shared_ptr<Mesh>& mesh, ThreadPool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    m_lastStats.substeps = 0;
+    m_lastStats.sculptedVertices = 0;
+    const Kelvinlet& shape = to.getShape();
+    const bool grab = shape.m_brush.type == BrushType::Grab;
+    const size_t instances = std::min(from.size(), to.size());
+    float epsilon = shape.m_scaleEpsilons[0];
+    for (int s = 1; s < shape.scaleCount(); ++s) epsilon = std::min(epsilon, shape.m_scaleEpsilons[s]);
+    epsilon = std::max(epsilon, 1e-4f);
+
+    // Substeps follow the fastest instance: the distance its center travels, or
+    // the most an affine load moves a vertex over dt
+    float travel = 0.0f;
+    for (size_t j = 0; j < instances; ++j) {
+        travel = std::max(travel, grab ? glm::length(to.getInstance(j).x0 - from.getInstance(j).x0) : to.getKelvinlet(j).maxDisplacement() * dt);
+    }
+    if (instances == 0 || !(travel > 0.0f)) return;
+    const int substeps = std::clamp(static_cast<int>(std::ceil(travel / (MAX_SCULPT_STEP * epsilon))), 1, m_maxSubsteps);
+
+    // Centers at every half substep, loads are the same along the drag. A grab
+    // instance moves its center by its share of the drag per substep.
+    std::vector<KelvinletBatch> batches(2 * substeps + 1, KelvinletBatch(shape));
+    for (size_t j = 0; j < instances; ++j) {
+        const BrushInstance& a = from.getInstance(j);
+        const BrushInstance& b = to.getInstance(j);
+        glm::vec3 direction = b.direction;
+        float f = b.f * dt / substeps;
+        if (grab) {
+            const glm::vec3 delta = b.x0 - a.x0;
+            const float distance = glm::length(delta);
+            direction = distance > 0.0f ? delta / distance : glm::vec3(0.0f);
+            f = shape.grabForce(distance / substeps);
+        }
+        for (size_t k = 0; k < batches.size(); ++k) {
+            batches[k].add(glm::mix(a.x0, b.x0, static_cast<float>(k) / (2 * substeps)), direction, f);
+        }
+    }
+    // Instance j reaches the rest positions within m_reach[j].w of the middle of its path
+    m_reach.clear();
+    for (size_t j = 0; j < instances; ++j) {
+        const float halfPath = 0.5f * glm::length(to.getInstance(j).x0 - from.getInstance(j).x0);
+        const float radius = batches[0].getKelvinlet(j).influenceRadius(m_tolerance) + halfPath;
+        m_reach.push_back(glm::vec4(batches[substeps].getInstance(j).x0, radius * radius));
+    }
+
+    m_sculpts.clear();
+    for (size_t t = 0; t < m_targets.size(); ++t) {
+        Target& target = m_targets[t];
+        target.sculpting.clear();
+        if (target.mesh != mesh) continue;
+        const PositionsSoA& rest = target.deformer.getRestPositions();
+        for (const glm::vec4& reach : m_reach) {
+            if (target.bounds.distanceSquared(glm::vec3(reach)) > reach.w) continue;
+            if (!target.grid.isBuilt()) {
+                target.grid.build(rest, SpatialGrid::suggestCellSize(rest, target.mesh->indices), pool);
+            }
+            target.grid.gather(rest, glm::vec3(reach), std::sqrt(reach.w), target.sculpting);
+            // The old positions of the moved vertices
+            m_sculptRegion.grow(glm::vec3(reach) - glm::vec3(std::sqrt(reach.w)));
+            m_sculptRegion.grow(glm::vec3(reach) + glm::vec3(std::sqrt(reach.w)));
+        }
+        std::sort(target.sculpting.begin(), target.sculpting.end());
+        target.sculpting.erase(std::unique(target.sculpting.begin(), target.sculpting.end()), target.sculpting.end());
+        addTasks(m_sculpts, t, target.sculpting.data(), target.sculpting.size(), CHUNK_INDICES);
+        m_lastStats.sculptedVertices += target.sculpting.size();
+    }
+
+    // Vertices follow the brush flow independently, each task integrates the
+    // whole drag over its own vertices
+    pool.parallelFor(0, m_sculpts.size(), 1, [&](size_t first, size_t last) {
+        SculptScratch scratch;
+        std::vector<uint32_t> active;
+        for (size_t i = first; i < last; ++i) {
+            const Task& task = m_sculpts[i];
+            Target& target = m_targets[task.target];
+            const uint32_t* indices = task.indices + task.begin;
+            const size_t count = task.end - task.begin;
+            const PositionsSoA& rest = target.deformer.getRestPositions();
+            scratch.x.resize(count);
+            AABB bounds;
+            for (size_t n = 0; n < count; ++n) {
+                scratch.x.set(n, rest.get(indices[n]));
+                bounds.grow(scratch.x.get(n));
+            }
+            cullInstances(bounds, active);
+            if (active.empty()) continue;
+            for (int s = 0; s < substeps; ++s) {
+                const KelvinletBatch& begin = batches[2 * s];
+                if (m_integrator == Integrator::Euler) {
+                    KelvinletDeformer::evaluate(begin, active.data(), active.size(), scratch.x, scratch.x, 0, count);
+                    continue;
+                }
+                scratch.probe = scratch.x;
+                scratch.out.resize(count);
+                scratch.sum.clear();
+                scratch.sum.resize(count);
+                rk4Stage(begin, active, scratch, 1.0f / 6.0f, 0.5f);
+                rk4Stage(batches[2 * s + 1], active, scratch, 1.0f / 3.0f, 0.5f);
+                rk4Stage(batches[2 * s + 1], active, scratch, 1.0f / 3.0f, 1.0f);
+                rk4Stage(batches[2 * s + 2], active, scratch, 1.0f / 6.0f, 0.0f);
+                for (size_t n = 0; n < count; ++n) {
+                    scratch.x.set(n, scratch.x.get(n) + scratch.sum.get(n));
+                }
+            }
+            target.deformer.sculptIndices(indices, count, scratch.x);
+        }
+    });
+
+    for (Target& target : m_targets) {
+        if (target.sculpting.empty()) continue;
+        const PositionsSoA& rest = target.deformer.getRestPositions();
+        for (uint32_t i : target.sculpting) {
+            const glm::vec3 p = rest.get(i);
+            target.bounds.grow(p);
+            if (!target.chunkBounds.empty()) target.chunkBounds[i / CHUNK_VERTICES].grow(p);
+            m_sculptRegion.grow(p);
+        }
+        // The grid indexes the rest pose
+        target.grid.rebin(rest, target.sculpting.data(), target.sculpting.size(), pool);
+        if (!target.allSculpted) {
+            std::vector<uint32_t> merged;
+            merged.reserve(target.sculpted.size() + target.sculpting.size());
+            std::set_union(target.sculpted.begin(), target.sculpted.end(), target.sculpting.begin(), target.sculpting.end(), std::back_inserter(merged));
+            target.sculpted.swap(merged);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    m_lastStats.substeps = substeps;
+    m_lastStats.sculptMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void ModelDeformer::clearSculpt() {
+    for (auto& target : m_targets) {
+        target.deformer.clearSculpt();
+        // Rebuilt over the initial rest pose when next needed
+        target.grid = SpatialGrid();
+        target.chunkBounds.clear();
+        target.sculpted.clear();
+        target.allSculpted = true;
+        m_sculptRegion.grow(target.bounds);
+    }
+}
+
+void ModelDeformer::setIntegrator(Integrator integrator) {
+    m_integrator = integrator;
+}
+
+Integrator ModelDeformer::getIntegrator() const {
+    return m_integrator;
+}
+
+void ModelDeformer::setMaxSubsteps(int substeps) {
+    m_maxSubsteps = std::max(1, substeps);
+}
+
+int ModelDeformer::getMaxSubsteps() const {
+    return m_maxSubsteps;
+}
+
+void ModelDeformer::refitHierarchies(ThreadPool& pool) {
+    AABB region = m_dirtyRegion;
+    region.grow(m_sculptRegion);
+    m_sculptRegion = AABB();
+    for (auto& target : m_targets) {
+        target.mesh->refit_bvh(target.deformer.getDeformedPositions(), region, pool);
+    }
+}
+
+void ModelDeformer::uploadPositions(ThreadPool& pool) {
+    m_lastStats.uploadedVertices = 0;
+    m_lastStats.uploadedBytes = 0;
+    m_lastStats.recomputedFrames = 0;
+    m_lastStats.framesMs = 0.0;
+    for (auto& target : m_targets) {
+        target.dirty = dirtyRanges(target);
+        target.sculpted.clear();
+        target.allSculpted = false;
+        if (m_normalUpdate == NormalUpdate::Topology) {
+            const std::vector<VertexRange> frames = updateTopologyFrames(target, pool);
+            m_lastStats.uploadedBytes += target.mesh->set_frames(target.frames, frames);
+        }
+        else if (target.deformer.hasFrames() && !target.dirty.empty()) {
+            m_lastStats.uploadedBytes += target.mesh->set_frames(target.deformer.getDeformedFrames(), target.dirty);
+        }
+        for (const VertexRange& range : target.dirty) {
+            m_lastStats.uploadedVertices += range.end - range.begin;
+        }
+        if (target.dirty.empty()) {
+            // Interleaved frames are sent with the positions
+            m_lastStats.uploadedBytes += target.mesh->update_positions();
+            continue;
+        }
+        m_lastStats.uploadedBytes += target.mesh->set_positions(target.deformer.getDeformedPositions(), target.dirty);
+    }
+}
+
+std::vector<VertexRange> ModelDeformer::updateTopologyFrames(Target& target, ThreadPool& pool) {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t count = target.deformer.size();
+    const Mesh& mesh = *target.mesh;
+    std::vector<VertexRange> ranges;
+    if (count == 0) return ranges;
+    const bool initialize = target.frames.size() != count;
+    if (initialize) {
+        if (!mesh.adjacency) target.mesh->build_adjacency();
+        target.restFrames = mesh.get_frames();
+        target.frames = target.restFrames;
+        target.uvs = mesh.get_uvs();
+    }
+    const bool all = initialize || (target.dirty.size() == 1 && target.dirty[0].begin == 0 && target.dirty[0].end == count);
+    if (all) {
+        recomputeFrames(*mesh.adjacency, mesh.indices, target.deformer.getDeformedPositions(), target.uvs, target.restFrames, target.frames, pool);
+        m_lastStats.recomputedFrames += count;
+        ranges.push_back(VertexRange{0, count});
+    }
+    else if (!target.dirty.empty()) {
+        // The moved vertices change the triangles around them, and so the frames of their one-ring
+        std::vector<uint32_t> moved;
+        for (const VertexRange& range : target.dirty) {
+            for (size_t i = range.begin; i < range.end; ++i) moved.push_back(static_cast<uint32_t>(i));
+        }
+        target.ring.clear();
+        mesh.adjacency->oneRing(mesh.indices, moved.data(), moved.size(), target.ring);
+        recomputeFrames(*mesh.adjacency, mesh.indices, target.deformer.getDeformedPositions(), target.uvs, target.ring.data(), target.ring.size(), target.restFrames, target.frames, pool);
+        m_lastStats.recomputedFrames += target.ring.size();
+        for (uint32_t i : target.ring) {
+            if (!ranges.empty() && ranges.back().end == i) {
+                ranges.back().end = i + 1;
+            }
+            else {
+                ranges.push_back(VertexRange{i, i + 1});
+            }
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    m_lastStats.framesMs += std::chrono::duration<double, std::milli>(end - start).count();
+    return ranges;
+}
+
+void ModelDeformer::restoreFrames(Target& target) {
+    const std::vector<VertexRange> all = {VertexRange{0, target.deformer.size()}};
+    if (target.deformer.hasFrames()) {
+        target.mesh->set_frames(target.deformer.getRestFrames(), all);
+        target.deformer.clearFrames();
+    }
+    if (target.restFrames.size() == target.deformer.size() && target.frames.size() != 0) {
+        target.mesh->set_frames(target.restFrames, all);
+    }
+    target.restFrames.clear();
+    target.frames.clear();
+    target.uvs = std::vector<glm::vec2>();
+    target.ring = std::vector<uint32_t>();
+    target.mesh->update_positions();
+}
+
+void ModelDeformer::setNormalUpdate(NormalUpdate mode) {
+    if (mode == m_normalUpdate) return;
+    m_normalUpdate = mode;
+    for (auto& target : m_targets) {
+        restoreFrames(target);
+        // Frames of the vertices already displaced follow from the next apply().
+        // Topology ones are initialized by the next uploadPositions().
+        if (mode == NormalUpdate::Analytic) target.deformer.setRestFrames(target.mesh->get_frames());
+    }
+}
+
+NormalUpdate ModelDeformer::getNormalUpdate() const {
+    return m_normalUpdate;
+}
+
+void ModelDeformer::setTolerance(float tolerance) {
+    m_tolerance = tolerance;
+}
+
+float ModelDeformer::getTolerance() const {
+    return m_tolerance;
+}
+
+void ModelDeformer::resetToRestPose() {
+    for (auto& target : m_targets) {
+        target.deformer.resetToRestPose();
+        // Still uploaded by the next uploadPositions()
+        target.previous.swap(target.displaced);
+        target.displaced.clear();
+        target.allPrevious = target.allDisplaced;
+        target.allDisplaced = false;
+    }
+    m_dirtyRegion = m_lastRegion;
+    m_lastRegion = AABB();
+}
+
+size_t ModelDeformer::getTargetCount() const {
+    return m_targets.size();
+}
+
+std::shared_ptr<Mesh> ModelDeformer::getMesh(size_t target) const {
+    return m_targets[target].mesh;
+}
+
+KelvinletDeformer& ModelDeformer::getDeformer(size_t target) {
+    return m_targets[target].deformer;
+}
+
+KelvinletDeformer* ModelDeformer::findDeformer(const Mesh* mesh) {
+    for (auto& target : m_targets) {
+        if (target.mesh.get() == mesh) return &target.deformer;
+    }
+    return nullptr;
+}
+
+const SpatialGrid& ModelDeformer::getGrid(size_t target) const {
+    return m_targets[target].grid;
+}
+
+const std::vector<VertexRange>& ModelDeformer::getDirtyRanges(size_t target) const {
+    return m_targets[target].dirty;
+}
+
+const DeformStats& ModelDeformer::getLastStats() const {
+    return m_lastStats;
+}
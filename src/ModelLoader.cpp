@@ -0,0 +1,155 @@
+#include <ModelLoader.hpp>
+#include <TextureCache.hpp>
+#include <algorithm>
+#include <chrono>
+
+ModelLoader::ModelLoader(ThreadPool& pool) : m_pool(pool) {
+    m_thread = std::thread(&ModelLoader::loaderLoop, this);
+}
+
+ModelLoader::~ModelLoader() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_all();
+    m_thread.join();
+}
+
+void ModelLoader::load(const std::string& path, VertexLayout layout) {
+    m_path = path;
+    m_busy = true;
+    m_uploading.reset();
+    m_uploads.clear();
+    m_nextUpload = 0;
+    m_textureCount = 0;
+    m_textureUploader.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_request = Request{path, layout, ++m_generation};
+        m_hasRequest = true;
+        m_imported.reset();
+    }
+    m_wakeUp.notify_one();
+}
+
+std::unique_ptr<Model> ModelLoader::update(double budgetMs) {
+    if (!m_uploading) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_imported || m_importedGeneration != m_generation) return nullptr;
+            m_uploading = std::move(m_imported);
+        }
+        collectUploads(*m_uploading);
+    }
+    // At least one upload step per frame so that large objects still make progress
+    auto start = std::chrono::steady_clock::now();
+    m_textureUploader.update(TEXTURE_BYTES_PER_UPDATE);
+    while (m_nextUpload < m_uploads.size()) {
+        if (m_uploads[m_nextUpload]()) m_nextUpload++;
+        if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs) break;
+    }
+    if (m_nextUpload < m_uploads.size() || m_textureUploader.getPendingCount() > 0) return nullptr;
+    m_uploads.clear();
+    m_nextUpload = 0;
+    m_textureCount = 0;
+    m_busy = false;
+    return std::move(m_uploading);
+}
+
+void ModelLoader::collectUploads(const Model& model) {
+    std::vector<const Mesh*> seen;
+    for (const auto& entry : model.entries) {
+        std::shared_ptr<Mesh> mesh = entry.mesh;
+        if (std::find(seen.begin(), seen.end(), mesh.get()) != seen.end()) continue;
+        seen.push_back(mesh.get());
+        if (!mesh->is_uploaded()) {
+            m_uploads.push_back(meshUpload(mesh));
+        }
+    }
+    auto textures = collectTextures(model);
+    m_textureCount = textures.size();
+    for (auto& texture : textures) {
+        m_textureUploader.enqueue(std::move(texture));
+    }
+}
+
+std::function<bool()> ModelLoader::meshUpload(std::shared_ptr<Mesh> mesh) {
+    // First step allocates the buffers, the next ones fill them a chunk at a time
+    return [mesh, buffers = std::vector<BufferUpload>(), next = size_t(0), offset = size_t(0)]() mutable {
+        if (!mesh->is_uploaded()) {
+            mesh->setup_mesh(&buffers);
+            return buffers.empty();
+        }
+        const BufferUpload& upload = buffers[next];
+        const size_t size = std::min(MESH_UPLOAD_CHUNK, upload.size - offset);
+        Mesh::upload_buffer_range(upload, offset, size);
+        offset += size;
+        if (offset == upload.size) {
+            offset = 0;
+            ++next;
+        }
+        return next == buffers.size();
+    };
+}
+
+std::vector<std::shared_ptr<Texture>> ModelLoader::collectTextures(const Model& model) {
+    std::vector<std::shared_ptr<Texture>> textures;
+    for (const auto& entry : model.entries) {
+        if (!entry.mesh->material) continue;
+        for (const auto& texture : entry.mesh->material->textures) {
+            // Materials share cached textures
+            if (texture->is_uploaded() || std::find(textures.begin(), textures.end(), texture) != textures.end()) continue;
+            textures.push_back(texture);
+        }
+    }
+    return textures;
+}
+
+LoadState ModelLoader::getState() const {
+    if (m_uploading) return LoadState::Uploading;
+    return m_busy ? LoadState::Importing : LoadState::Idle;
+}
+
+const std::string& ModelLoader::getPath() const {
+    return m_path;
+}
+
+size_t ModelLoader::getUploadedCount() const {
+    return m_nextUpload + m_textureCount - m_textureUploader.getPendingCount();
+}
+
+size_t ModelLoader::getUploadCount() const {
+    return m_uploads.size() + m_textureCount;
+}
+
+double ModelLoader::getImportMs() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_importMs;
+}
+
+void ModelLoader::loaderLoop() {
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [this]() { return m_stopping || m_hasRequest; });
+            if (m_stopping) break;
+            request = m_request;
+            m_hasRequest = false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto model = std::make_unique<Model>(request.path, request.layout, true);
+        const auto textures = collectTextures(*model);
+        m_pool.parallelFor(0, textures.size(), 1, [&textures](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (!textures[i]->decode()) TextureCache::instance().evict(*textures[i]);
+            }
+        });
+        auto end = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_imported = std::move(model);
+        m_importedGeneration = request.generation;
+        m_importMs = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+}
@@ -0,0 +1,96 @@
+#include <ProgramBinaryCache.hpp>
+#include <GLExtensions.hpp>
+#include <Hash.hpp>
+#include <MappedFile.hpp>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace {
+    constexpr char MAGIC[4] = {'K', 'P', 'R', 'G'};
+
+    static_assert(sizeof(ProgramBinaryHeader) == 24, "ProgramBinaryHeader layout changed, bump ProgramBinaryCache::VERSION");
+
+    std::string glString(GLenum name) {
+        const GLubyte* value = glGetString(name);
+        return value ? reinterpret_cast<const char*>(value) : "";
+    }
+}
+
+bool ProgramBinaryCache::isSupported() {
+    static const bool supported = []() {
+        // glad only loads the entry points with the 4.1 core functions
+        if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri) return false;
+        if (!GLAD_GL_VERSION_4_1 && !hasGLExtension("GL_ARB_get_program_binary")) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return supported;
+}
+
+uint64_t ProgramBinaryCache::key(const std::string& vertexSource, const std::string& fragmentSource) {
+    // Null separators keep "ab" + "c" apart from "a" + "bc"
+    std::string material = vertexSource;
+    for (const std::string& part : {fragmentSource, glString(GL_VENDOR), glString(GL_RENDERER), glString(GL_VERSION)}) {
+        material += '\0';
+        material += part;
+    }
+    return fnv1a64(material.data(), material.size());
+}
+
+std::string ProgramBinaryCache::cachePath(const std::string& vertexPath, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016" PRIx64 ".glbin", key);
+    return (std::filesystem::path(vertexPath).parent_path() / "cache" / name).string();
+}
+
+bool ProgramBinaryCache::load(GLuint program, const std::string& path, uint64_t key) {
+    MappedFile file(path);
+    if (!file.isOpen() || file.size() < sizeof(ProgramBinaryHeader)) return false;
+    ProgramBinaryHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.key != key) return false;
+    if (header.binaryLength > file.size() - sizeof(header)) return false;
+    glProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), static_cast<GLsizei>(header.binaryLength));
+    // The driver may still reject a binary it produced, e.g. after a silent update
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+bool ProgramBinaryCache::store(GLuint program, const std::string& path, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    ProgramBinaryHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.key = key;
+    header.binaryFormat = format;
+    header.binaryLength = static_cast<uint32_t>(length);
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), length);
+        if (!out) {
+            out.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,195 @@
+#include <SceneBVH.hpp>
+#include <ThreadPool.hpp>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+    constexpr uint32_t MAX_LEAF_INSTANCES = 2;
+    constexpr int MAX_STACK = 64;
+    constexpr size_t RAY_BATCH_GRAIN = 64;
+}
+
+SceneBVH::SceneBVH() {}
+
+SceneBVH::SceneBVH(const Model& model) {
+    build(model);
+}
+
+void SceneBVH::build(const Model& model) {
+    m_instances.clear();
+    m_nodes.clear();
+    for (const auto& entry : model.entries) {
+        if (!entry.mesh->bvh && entry.mesh->triangle_packets.empty()) {
+            entry.mesh->triangle_packets = buildTrianglePackets(entry.mesh->get_positions(), entry.mesh->indices);
+        }
+        BVHInstance instance;
+        instance.mesh = entry.mesh;
+        instance.transform = entry.transform;
+        instance.inverseTransform = glm::inverse(entry.transform);
+        instance.worldBounds = transformBounds(localBounds(*entry.mesh), entry.transform);
+        m_instances.push_back(instance);
+    }
+    m_instanceOrder.resize(m_instances.size());
+    std::iota(m_instanceOrder.begin(), m_instanceOrder.end(), 0u);
+    if (!m_instances.empty()) {
+        buildRecursive(0, static_cast<uint32_t>(m_instances.size()));
+    }
+}
+
+AABB SceneBVH::localBounds(const Mesh& mesh) const {
+    if (mesh.bvh) return mesh.bvh->getBounds();
+    AABB bounds;
+    for (const auto& position : mesh.get_positions()) {
+        bounds.grow(position);
+    }
+    return bounds;
+}
+
+AABB SceneBVH::transformBounds(const AABB& bounds, const glm::mat4& transform) const {
+    AABB world;
+    if (bounds.empty()) return world;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 p((corner & 1) ? bounds.max.x : bounds.min.x,
+                    (corner & 2) ? bounds.max.y : bounds.min.y,
+                    (corner & 4) ? bounds.max.z : bounds.min.z);
+        world.grow(glm::vec3(transform * glm::vec4(p, 1.0f)));
+    }
+    return world;
+}
+
+// Instances are few, an object median split on the widest centroid axis is enough
+uint32_t SceneBVH::buildRecursive(uint32_t first, uint32_t count) {
+    const uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    if (count <= MAX_LEAF_INSTANCES) {
+        m_nodes[nodeIndex].leftFirst = first;
+        m_nodes[nodeIndex].count = count;
+        updateBounds(nodeIndex);
+        return nodeIndex;
+    }
+    AABB centroids;
+    for (uint32_t i = first; i < first + count; ++i) {
+        const AABB& bounds = m_instances[m_instanceOrder[i]].worldBounds;
+        centroids.grow(0.5f * (bounds.min + bounds.max));
+    }
+    glm::vec3 extent = centroids.max - centroids.min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    const uint32_t middle = first + count / 2;
+    std::nth_element(m_instanceOrder.begin() + first, m_instanceOrder.begin() + middle, m_instanceOrder.begin() + first + count, [&](uint32_t lhs, uint32_t rhs) {
+        const AABB& a = m_instances[lhs].worldBounds;
+        const AABB& b = m_instances[rhs].worldBounds;
+        return a.min[axis] + a.max[axis] < b.min[axis] + b.max[axis];
+    });
+    buildRecursive(first, middle - first);
+    const uint32_t right = buildRecursive(middle, first + count - middle);
+    m_nodes[nodeIndex].leftFirst = right;
+    m_nodes[nodeIndex].count = 0;
+    updateBounds(nodeIndex);
+    return nodeIndex;
+}
+
+void SceneBVH::updateBounds(uint32_t nodeIndex) {
+    BVHNode& node = m_nodes[nodeIndex];
+    AABB bounds;
+    if (node.isLeaf()) {
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+            bounds.grow(m_instances[m_instanceOrder[i]].worldBounds);
+        }
+    }
+    else {
+        const BVHNode& left = m_nodes[nodeIndex + 1];
+        const BVHNode& right = m_nodes[node.leftFirst];
+        bounds.grow(left.boundsMin);
+        bounds.grow(left.boundsMax);
+        bounds.grow(right.boundsMin);
+        bounds.grow(right.boundsMax);
+    }
+    node.boundsMin = bounds.min;
+    node.boundsMax = bounds.max;
+}
+
+void SceneBVH::refit() {
+    for (auto& instance : m_instances) {
+        instance.worldBounds = transformBounds(localBounds(*instance.mesh), instance.transform);
+    }
+    // Children always come after their parent
+    for (size_t i = m_nodes.size(); i-- > 0;) {
+        updateBounds(static_cast<uint32_t>(i));
+    }
+}
+
+bool SceneBVH::intersectInstance(uint32_t index, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const {
+    const BVHInstance& instance = m_instances[index];
+    const glm::vec3 localOrigin = glm::vec3(instance.inverseTransform * glm::vec4(origin, 1.0f));
+    const glm::vec3 localDirection = glm::vec3(instance.inverseTransform * glm::vec4(direction, 0.0f));
+    bool found;
+    if (instance.mesh->bvh) {
+        found = instance.mesh->bvh->intersect(localOrigin, localDirection, hit);
+    }
+    else {
+        found = intersectTrianglePackets(instance.mesh->triangle_packets, localOrigin, localDirection, hit);
+    }
+    if (found) hit.instance = index;
+    return found;
+}
+
+bool SceneBVH::intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const {
+    if (m_nodes.empty()) return false;
+    const glm::vec3 invDirection = 1.0f / direction;
+    if (intersectNode(m_nodes[0], origin, invDirection, hit.t) == std::numeric_limits<float>::infinity()) return false;
+    bool found = false;
+    uint32_t stack[MAX_STACK];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    while (true) {
+        const BVHNode& node = m_nodes[nodeIndex];
+        if (node.isLeaf()) {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                found |= intersectInstance(m_instanceOrder[i], origin, direction, hit);
+            }
+        }
+        else {
+            uint32_t near = nodeIndex + 1;
+            uint32_t far = node.leftFirst;
+            float tNear = intersectNode(m_nodes[near], origin, invDirection, hit.t);
+            float tFar = intersectNode(m_nodes[far], origin, invDirection, hit.t);
+            if (tFar < tNear) {
+                std::swap(near, far);
+                std::swap(tNear, tFar);
+            }
+            if (tNear != std::numeric_limits<float>::infinity()) {
+                if (tFar != std::numeric_limits<float>::infinity()) {
+                    stack[stackSize++] = far;
+                }
+                nodeIndex = near;
+                continue;
+            }
+        }
+        bool popped = false;
+        while (stackSize > 0) {
+            nodeIndex = stack[--stackSize];
+            if (intersectNode(m_nodes[nodeIndex], origin, invDirection, hit.t) != std::numeric_limits<float>::infinity()) {
+                popped = true;
+                break;
+            }
+        }
+        if (!popped) break;
+    }
+    return found;
+}
+
+void SceneBVH::intersect(RayBatch& batch, ThreadPool& pool) const {
+    pool.parallelFor(0, batch.size(), RAY_BATCH_GRAIN, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            intersect(batch.origins[i], batch.directions[i], batch.hits[i]);
+        }
+    });
+}
+
+size_t SceneBVH::getInstanceCount() const {
+    return m_instances.size();
+}
+
+const BVHInstance& SceneBVH::getInstance(size_t index) const {
+    return m_instances[index];
+}
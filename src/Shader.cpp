@@ -1,4 +1,5 @@
 #include <Shader.hpp>
+#include <ProgramBinaryCache.hpp>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -15,7 +16,40 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
     initFromPaths(vertexPath, fragmentPath);
 }
 
-void Shader::initFromPaths(const char* vertexPath, const char* fragmentPath) {
+Shader::Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines) {
+    initFromPaths(vertexPath.c_str(), fragmentPath.c_str(), defines);
+}
+
+namespace {
+    GLuint compileStage(GLenum type, const std::string& source, const char* path) {
+        const char* code = source.c_str();
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        int success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if(!success) {
+            char infoLog[512];
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            const char* stage = type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT";
+            std::cout<<"ERROR::SHADER::"<<stage<<"::"<<path<<"::COMPILATION_FAILED \n{}"<<infoLog<<std::endl;
+        }
+        return shader;
+    }
+
+    // #version must stay the first line
+    void insertDefines(std::string& code, const std::string& defines) {
+        if (defines.empty()) return;
+        size_t position = 0;
+        if (code.compare(0, 8, "#version") == 0) {
+            const size_t newline = code.find('\n');
+            position = newline == std::string::npos ? code.size() : newline + 1;
+        }
+        code.insert(position, defines);
+    }
+}
+
+void Shader::initFromPaths(const char* vertexPath, const char* fragmentPath, const std::string& defines) {
     // Reading shaders
     std::string vertexCode;
     std::string fragmentCode;
@@ -38,64 +72,91 @@ void Shader::initFromPaths(const char* vertexPath, const char* fragmentPath) {
     catch(std::ifstream::failure &e) {
         std::cout<<"ERROR::SHADER::"<<vertexPath<<" OR "<<fragmentPath<<"::FILE_NOT_SUCCESFULLY READ"<<std::endl;
     }
-    const char* vertex_shader_code = vertexCode.c_str();
-    const char* fragment_shader_code = fragmentCode.c_str();
-    
-    // Shaders compilation
-    unsigned int vertex;
-    unsigned int fragment;
-    int success;
-    char infoLog[512];
-
-    // Vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vertex_shader_code, NULL);
-    glCompileShader(vertex);
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if(!success) {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cout<<"ERROR::SHADER::VERTEX::"<<vertexPath<<"::COMPILATION_FAILED \n{}"<<infoLog<<std::endl;
-    }
-    else {
-        std::cout<<"SHADER::VERTEX::"<<vertexPath<<"::COMPILATION_COMPLETED"<<std::endl;
-    }
+    insertDefines(vertexCode, defines);
+    insertDefines(fragmentCode, defines);
 
-    // Fragment shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fragment_shader_code, NULL);
-    glCompileShader(fragment);
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if(!success) {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+    m_id = glCreateProgram();
+    initialized = true;
 
-        std::cout<<"ERROR::SHADER::FRAGMENT::"<<fragmentPath<<"::COMPILATION_FAILED \n{}"<<infoLog<<std::endl;
-    }
-    else {
-        std::cout<<"SHADER::FRAGMENT::"<<fragmentPath<<"::COMPILATION_COMPLETED"<<std::endl;
+    // Cached binary first, compiling only on a miss
+    const bool useBinaryCache = ProgramBinaryCache::isSupported();
+    uint64_t cacheKey = 0;
+    std::string cachePath;
+    if (useBinaryCache) {
+        cacheKey = ProgramBinaryCache::key(vertexCode, fragmentCode);
+        cachePath = ProgramBinaryCache::cachePath(vertexPath, cacheKey);
+        if (ProgramBinaryCache::load(m_id, cachePath, cacheKey)) {
+            cacheUniformLocations();
+            return;
+        }
+        // A rejected binary leaves the program unusable
+        glDeleteProgram(m_id);
+        m_id = glCreateProgram();
+        glProgramParameteri(m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     }
 
+    GLuint vertex = compileStage(GL_VERTEX_SHADER, vertexCode, vertexPath);
+    GLuint fragment = compileStage(GL_FRAGMENT_SHADER, fragmentCode, fragmentPath);
+
     // Shader program
-    m_id = glCreateProgram();
+    int success;
     glAttachShader(m_id, vertex);
     glAttachShader(m_id, fragment);
     glLinkProgram(m_id);
     glGetProgramiv(m_id, GL_LINK_STATUS, &success);
     if(!success) {
+        char infoLog[512];
         glGetProgramInfoLog(m_id, 512, NULL, infoLog);
         std::cout<<"ERROR::SHADER::PROGRAM::FROM::"<<vertexPath<<" OR "<<fragmentPath<<"::LINKING_FAILED\n{}"<<infoLog<<std::endl;
     }
-    else {
-        std::cout<<"SHADER::PROGRAM::FROM::"<<vertexPath<<" AND "<<fragmentPath<<"::LINKING_COMPLETED"<<std::endl;
+    else if (useBinaryCache && !ProgramBinaryCache::store(m_id, cachePath, cacheKey)) {
+        std::cout<<"Failed to write program cache "<<cachePath<<std::endl;
     }
-    initialized = true;
+    glDetachShader(m_id, vertex);
+    glDetachShader(m_id, fragment);
     glDeleteShader(vertex);
     glDeleteShader(fragment);
-    std::cout<<"==========================================="<<std::endl;
+    cacheUniformLocations();
+}
+
+void Shader::cacheUniformLocations() {
+    m_uniformLocations.clear();
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::string name(static_cast<size_t>(maxLength), '\0');
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_id, static_cast<GLuint>(i), maxLength, &length, &size, &type, &name[0]);
+        const std::string uniform = name.substr(0, static_cast<size_t>(length));
+        // Block members have no location
+        const GLint location = glGetUniformLocation(m_id, uniform.c_str());
+        if (location < 0) continue;
+        m_uniformLocations[uniform] = location;
+        // Arrays are reported as "name[0]", also answer to "name"
+        if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0) {
+            m_uniformLocations[uniform.substr(0, uniform.size() - 3)] = location;
+        }
+    }
+}
+
+GLint Shader::getUniformLocation(const char* name) const {
+    auto it = m_uniformLocations.find(name);
+    return it != m_uniformLocations.end() ? it->second : -1;
+}
+
+void Shader::bindUniformBlock(const char* blockName, GLuint binding) {
+    const GLuint index = glGetUniformBlockIndex(m_id, blockName);
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(m_id, index, binding);
+    }
 }
 
 Shader::~Shader() {
     if(initialized) {
-        std::cout<<"Deleting shader program"<<std::endl;
         glDeleteProgram(m_id);
         initialized = false;
     }
@@ -108,37 +169,57 @@ void Shader::use() {
 }
 
 void Shader::setVec2(const char* name, const float x, const float y) {
-    glUniform2f(glGetUniformLocation(m_id, name), x, y);
+    glUniform2f(getUniformLocation(name), x, y);
 }
 
 void Shader::setVec2(const char* name, const glm::vec2 v) {
-    glUniform2f(glGetUniformLocation(m_id, name), v.x, v.y);
+    glUniform2f(getUniformLocation(name), v.x, v.y);
 }
 
 void Shader::setVec3(const char* name, const glm::vec3 v) {
-    glUniform3f(glad_glGetUniformLocation(m_id, name), v.x, v.y, v.z);
+    glUniform3f(getUniformLocation(name), v.x, v.y, v.z);
 }
 
 void Shader::setVec4(const char* name, const glm::vec4 v) {
-    glUniform4f(glGetUniformLocation(m_id, name), v.x, v.y, v.z, v.w);
+    glUniform4f(getUniformLocation(name), v.x, v.y, v.z, v.w);
 }
 
 void Shader::setTexture2D(const char* name, const GLint textureUnit) {
-    glUniform1i(glGetUniformLocation(m_id, name), textureUnit);
+    glUniform1i(getUniformLocation(name), textureUnit);
 }
 
 void Shader::setInt(const char* name, const int val) {
-    glUniform1i(glGetUniformLocation(m_id, name), val);
+    glUniform1i(getUniformLocation(name), val);
 }
 
 void Shader::setFloat(const char* name, const float val) {
-    glUniform1f(glGetUniformLocation(m_id, name), val);
+    glUniform1f(getUniformLocation(name), val);
 }
 
 void Shader::setBool(const char* name, const bool val) {
-    glUniform1i(glGetUniformLocation(m_id, name), val);
+    glUniform1i(getUniformLocation(name), val);
 }
 
 void Shader::setMat4(const char* name, const glm::mat4& mat) {
-    glUniformMatrix4fv(glGetUniformLocation(m_id, name), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::setInt(GLint location, const int val) {
+    glUniform1i(location, val);
+}
+
+void Shader::setFloat(GLint location, const float val) {
+    glUniform1f(location, val);
+}
+
+void Shader::setBool(GLint location, const bool val) {
+    glUniform1i(location, val);
+}
+
+void Shader::setVec3(GLint location, const glm::vec3 v) {
+    glUniform3f(location, v.x, v.y, v.z);
+}
+
+void Shader::setMat4(GLint location, const glm::mat4& mat) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include <SpatialGrid.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+SpatialGrid::SpatialGrid() {}
+
+glm::ivec3 SpatialGrid::cellOf(const glm::vec3& p) const {
+    return glm::ivec3(glm::floor(p * m_invCellSize));
+}
+
+uint32_t SpatialGrid::bucketOf(const glm::ivec3& cell) const {
+    const uint32_t h = (static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u);
+    return h & m_mask;
+}
+
+void SpatialGrid::build(const PositionsSoA& positions, float cellSize, ThreadPool& pool) {
+    const size_t count = positions.size();
+    m_cellSize = std::max(cellSize, 1e-6f);
+    m_invCellSize = 1.0f / m_cellSize;
+    // About two buckets per point, collisions stay rare
+    size_t buckets = 64;
+    while (buckets < 2 * count) buckets *= 2;
+    m_mask = static_cast<uint32_t>(buckets - 1);
+
+    m_bucketOf.resize(count);
+    m_slotOf.resize(count);
+    std::unique_ptr<std::atomic<uint32_t>[]> counters(new std::atomic<uint32_t>[buckets]);
+    for (size_t b = 0; b < buckets; ++b) {
+        counters[b].store(0, std::memory_order_relaxed);
+    }
+    pool.parallelFor(0, count, 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t bucket = bucketOf(cellOf(positions.get(i)));
+            m_bucketOf[i] = bucket;
+            counters[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    m_count.resize(buckets);
+    m_start.resize(buckets + 1);
+    uint32_t offset = 0;
+    for (size_t b = 0; b < buckets; ++b) {
+        const uint32_t n = counters[b].load(std::memory_order_relaxed);
+        m_start[b] = offset;
+        m_count[b] = n;
+        offset += n + static_cast<uint32_t>(n * SLACK) + MIN_SLACK;
+        counters[b].store(0, std::memory_order_relaxed);
+    }
+    m_start[buckets] = offset;
+    m_slots.assign(offset, 0);
+
+    pool.parallelFor(0, count, 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t bucket = m_bucketOf[i];
+            const uint32_t slot = m_start[bucket] + counters[bucket].fetch_add(1, std::memory_order_relaxed);
+            m_slots[slot] = static_cast<uint32_t>(i);
+            m_slotOf[i] = slot;
+        }
+    });
+}
+
+bool SpatialGrid::rebin(const PositionsSoA& positions, const uint32_t* moved, size_t count, ThreadPool& pool) {
+    for (size_t m = 0; m < count; ++m) {
+        const uint32_t i = moved[m];
+        const uint32_t from = m_bucketOf[i];
+        const uint32_t to = bucketOf(cellOf(positions.get(i)));
+        if (from == to) continue;
+        if (m_count[to] == m_start[to + 1] - m_start[to]) {
+            build(positions, m_cellSize, pool);
+            return false;
+        }
+        // The last point of the old bucket fills the hole
+        const uint32_t last = m_start[from] + --m_count[from];
+        const uint32_t hole = m_slotOf[i];
+        m_slots[hole] = m_slots[last];
+        m_slotOf[m_slots[hole]] = hole;
+
+        const uint32_t slot = m_start[to] + m_count[to]++;
+        m_slots[slot] = i;
+        m_slotOf[i] = slot;
+        m_bucketOf[i] = to;
+    }
+    return true;
+}
+
+bool SpatialGrid::query(const glm::vec3& center, float radius, std::vector<GridSpan>& spans) const {
+    if (m_count.empty()) return true;
+    const glm::ivec3 lo = cellOf(center - glm::vec3(radius));
+    const glm::ivec3 hi = cellOf(center + glm::vec3(radius));
+    const glm::dvec3 extent = glm::dvec3(hi - lo) + 1.0;
+    if (extent.x * extent.y * extent.z > static_cast<double>(MAX_QUERY_CELLS)) return false;
+
+    // Cells can share a bucket, every bucket is reported once
+    uint32_t buckets[MAX_QUERY_CELLS];
+    size_t bucketCount = 0;
+    const float radius2 = radius * radius;
+    for (int z = lo.z; z <= hi.z; ++z) {
+        for (int y = lo.y; y <= hi.y; ++y) {
+            for (int x = lo.x; x <= hi.x; ++x) {
+                const glm::vec3 cellMin = glm::vec3(x, y, z) * m_cellSize;
+                const glm::vec3 d = glm::max(glm::max(cellMin - center, center - (cellMin + glm::vec3(m_cellSize))), glm::vec3(0.0f));
+                if (glm::dot(d, d) > radius2) continue;
+                const uint32_t bucket = bucketOf(glm::ivec3(x, y, z));
+                if (m_count[bucket] > 0) buckets[bucketCount++] = bucket;
+            }
+        }
+    }
+    std::sort(buckets, buckets + bucketCount);
+    const size_t unique = std::unique(buckets, buckets + bucketCount) - buckets;
+    for (size_t b = 0; b < unique; ++b) {
+        const uint32_t* first = m_slots.data() + m_start[buckets[b]];
+        spans.push_back(GridSpan{first, first + m_count[buckets[b]]});
+    }
+    return true;
+}
+
+void SpatialGrid::gather(const PositionsSoA& positions, const glm::vec3& center, float radius, std::vector<uint32_t>& out) const {
+    const float radius2 = radius * radius;
+    auto inside = [&](uint32_t i) {
+        const glm::vec3 d = positions.get(i) - center;
+        return glm::dot(d, d) <= radius2;
+    };
+    std::vector<GridSpan> spans;
+    if (query(center, radius, spans)) {
+        for (const GridSpan& span : spans) {
+            for (const uint32_t* i = span.begin; i != span.end; ++i) {
+                if (inside(*i)) out.push_back(*i);
+            }
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < positions.size(); ++i) {
+        if (inside(i)) out.push_back(i);
+    }
+}
+
+bool SpatialGrid::isBuilt() const {
+    return !m_start.empty();
+}
+
+size_t SpatialGrid::size() const {
+    return m_bucketOf.size();
+}
+
+size_t SpatialGrid::getBucketCount() const {
+    return m_count.size();
+}
+
+float SpatialGrid::getCellSize() const {
+    return m_cellSize;
+}
+
+float SpatialGrid::suggestCellSize(const PositionsSoA& positions, const std::vector<unsigned int>& indices) {
+    // A few thousand triangles spread over the mesh are enough for the mean
+    const size_t triangles = indices.size() / 3;
+    const size_t step = std::max<size_t>(1, triangles / 4096);
+    double total = 0.0;
+    size_t edges = 0;
+    for (size_t t = 0; t < triangles; t += step) {
+        for (int e = 0; e < 3; ++e) {
+            const unsigned int a = indices[3 * t + e];
+            const unsigned int b = indices[3 * t + (e + 1) % 3];
+            if (a >= positions.size() || b >= positions.size()) continue;
+            total += glm::length(positions.get(a) - positions.get(b));
+            edges++;
+        }
+    }
+    if (edges == 0 || total <= 0.0) return 1.0f;
+    return static_cast<float>(2.0 * total / edges);
+}
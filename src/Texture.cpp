@@ -1,34 +1,42 @@
 #include <iostream>
 
 #include <Texture.hpp>
+#include <GLExtensions.hpp>
+#include <Hash.hpp>
+#include <Ktx2Cache.hpp>
+#include <MappedFile.hpp>
+
+// EXT_texture_compression_s3tc, not part of core GL
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+std::atomic<bool> Texture::s3tc_supported(false);
+std::atomic<bool> Texture::rgtc_supported(false);
+
+namespace {
+    GLenum gl_compressed_format(BlockFormat format) {
+        switch (format) {
+            case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+            case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        }
+        return GL_NONE;
+    }
 
-Texture::Texture(const char* image_path) {
-    glGenTextures(1, &ID);
-    glBindTexture(GL_TEXTURE_2D, ID);
-
-    // Paramètres de la texture
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(image_path, &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else format = GL_RGBA;
-
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        
-    } else {
-            std::cout<< "Failed to load texture" << std::endl;
+    // A null base is an offset into the bound GL_PIXEL_UNPACK_BUFFER
+    const void* at_offset(const unsigned char* base, size_t offset) {
+        return reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(base) + offset);
     }
-    stbi_image_free(data);
+}
+
+Texture::Texture(const char* image_path) {
+    path = image_path;
+    upload();
 }
 
 Texture::Texture(const char* image_path, const std::string &directory, const std::string &tex_type) {
@@ -36,98 +44,149 @@ Texture::Texture(const char* image_path, const std::string &directory, const std
     filename = directory + '/' + filename;
     path = filename;
     type = tex_type;
-
-    glGenTextures(1, &ID);
-    glBindTexture(GL_TEXTURE_2D, ID);
-
-    // Paramètres de la texture
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else format = GL_RGBA;
-            
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);    
-        glGenerateMipmap(GL_TEXTURE_2D);    
-    
-    } else {
-        std::cout<< "Failed to load texture" << std::endl;
-        }
-    stbi_image_free(data);
+    upload();
 }
 
 Texture::Texture(std::string &filename, const std::string &directory, const std::string &tex_type) {
     filename = directory + '/' + filename;
     path = filename;
     type = tex_type;
+    upload();
+}
 
-    glGenTextures(1, &ID);
-    glBindTexture(GL_TEXTURE_2D, ID);
+Texture::Texture(const std::string &filename_with_dir, const std::string &tex_type) {
+    path = filename_with_dir;
+    type = tex_type;
+    upload();
+}
 
-    // Paramètres de la texture
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void Texture::detect_compression_support() {
+    s3tc_supported = hasGLExtension("GL_EXT_texture_compression_s3tc");
+    // RGTC is core since 3.0
+    rgtc_supported = GLAD_GL_VERSION_3_0 != 0;
+}
 
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else format = GL_RGBA;
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        
-    } else {
-            std::cout<< "Failed to load texture" << std::endl;
+bool Texture::supports_compression(BlockFormat format) {
+    if (format == BlockFormat::BC4 || format == BlockFormat::BC5) return rgtc_supported;
+    return s3tc_supported;
+}
+
+bool Texture::decode() {
+    std::lock_guard<std::mutex> lock(decode_mutex);
+    if (decoded) return pixels != nullptr || !compressed.levels.empty();
+    decoded = true;
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        std::cout << "Failed to load texture " << path << std::endl;
+        return false;
     }
-    stbi_image_free(data);
+    if (decode_compressed(file.data(), file.size())) return true;
+    return decode_from_memory(file.data(), file.size());
 }
 
-Texture::Texture(const std::string &filename_with_dir, const std::string &tex_type) {
-    path = filename_with_dir;
-    type = tex_type;
+bool Texture::decode_compressed(const unsigned char* data, size_t size) {
+    // The header is enough to pick the format
+    int image_channels = 0;
+    if (!stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &image_channels)) return false;
+    const bool normal_map = type == "normal_map";
+    const BlockFormat format = chooseBlockFormat(image_channels, normal_map);
+    if (!supports_compression(format)) return false;
+
+    const uint64_t source_hash = fnv1a64(data, size);
+    const std::string cache_path = Ktx2Cache::cachePath(path);
+    if (Ktx2Cache::read(cache_path, source_hash, format, compressed)) return true;
+
+    if (!decode_from_memory(data, size)) return false;
+    compressed = compressImage(pixels.get(), width, height, channels, format, normal_map);
+    pixels.reset();
+    if (!Ktx2Cache::write(cache_path, source_hash, compressed)) {
+        std::cout << "Failed to write texture cache " << cache_path << std::endl;
+    }
+    return true;
+}
+
+bool Texture::decode_from_memory(const unsigned char* data, size_t size) {
+    unsigned char* image = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels, 0);
+    if (!image) {
+        std::cout << "Failed to load texture " << path << std::endl;
+        return false;
+    }
+    pixels = std::shared_ptr<unsigned char>(image, stbi_image_free);
+    return true;
+}
+
+void Texture::upload() {
+    if (ID != 0) return;
+    decode();
+    create_gl_texture(pixel_data());
+}
+
+void Texture::upload_from_unpack_buffer() {
+    if (ID != 0) return;
+    create_gl_texture(nullptr);
+}
 
+void Texture::create_gl_texture(const unsigned char* data) {
     glGenTextures(1, &ID);
     glBindTexture(GL_TEXTURE_2D, ID);
 
     // Paramètres de la texture
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(filename_with_dir.c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
+    if (!compressed.levels.empty()) {
+        // Mips come from the cache, the chain stops at the last stored level
+        const GLenum format = gl_compressed_format(compressed.format);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressed.levels.size() - 1));
+        for (size_t level = 0; level < compressed.levels.size(); ++level) {
+            const CompressedLevel& info = compressed.levels[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, info.width, info.height, 0,
+                                   static_cast<GLsizei>(info.size), at_offset(data, info.offset));
+        }
+        compressed_bytes = compressed.data.size();
+        compressed = CompressedImage();
+    }
+    else if (pixels) {
         GLenum format;
-        if (nrChannels == 1)
+        if (channels == 1)
             format = GL_RED;
-        else if (nrChannels == 3)
+        else if (channels == 3)
             format = GL_RGB;
         else format = GL_RGBA;
-            
+
+        // Rows of 1 and 3 channel images are not 4-byte aligned.
+        // A null data reads from the bound GL_PIXEL_UNPACK_BUFFER.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         glGenerateMipmap(GL_TEXTURE_2D);
-        
-    } else {
-            std::cout<< "Failed to load texture" << std::endl;
     }
-    stbi_image_free(data);
+    pixels.reset();
+    uploaded.store(true, std::memory_order_release);
+}
+
+const unsigned char* Texture::pixel_data() const {
+    if (!compressed.levels.empty()) return compressed.data.data();
+    return pixels.get();
+}
+
+size_t Texture::pixel_bytes() const {
+    if (!compressed.levels.empty()) return compressed.data.size();
+    return pixels ? static_cast<size_t>(width) * height * channels : 0;
+}
+
+bool Texture::is_uploaded() const {
+    return uploaded.load(std::memory_order_acquire);
+}
+
+size_t Texture::gpu_bytes() const {
+    if (ID == 0) return 0;
+    if (compressed_bytes != 0) return compressed_bytes;
+    // RGB is padded to 4 bytes per texel by most drivers, mips add a third
+    const size_t texel = channels == 3 ? 4 : static_cast<size_t>(channels);
+    return static_cast<size_t>(width) * height * texel * 4 / 3;
 }
 
 unsigned int Texture::texture_from_file(const char* image_path, const std::string &directory) {
@@ -0,0 +1,156 @@
+#include <TextureCache.hpp>
+#include <Hash.hpp>
+#include <MappedFile.hpp>
+#include <algorithm>
+#include <iterator>
+
+TextureCache& TextureCache::instance() {
+    static TextureCache cache;
+    return cache;
+}
+
+std::string TextureCache::normalizePath(const std::string& path) {
+    std::string unified = path;
+    std::replace(unified.begin(), unified.end(), '\\', '/');
+    const bool absolute = !unified.empty() && unified[0] == '/';
+    // Drop empty and "." segments, resolve ".." against the previous one
+    std::vector<std::string> segments;
+    size_t begin = 0;
+    while (begin <= unified.size()) {
+        size_t end = unified.find('/', begin);
+        if (end == std::string::npos) end = unified.size();
+        const std::string segment = unified.substr(begin, end - begin);
+        if (segment == "..") {
+            if (!segments.empty() && segments.back() != "..") {
+                segments.pop_back();
+            }
+            else if (!absolute) {
+                segments.push_back(segment);
+            }
+        }
+        else if (!segment.empty() && segment != ".") {
+            segments.push_back(segment);
+        }
+        begin = end + 1;
+    }
+    std::string normalized = absolute ? "/" : "";
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (i > 0) normalized += '/';
+        normalized += segments[i];
+    }
+    return normalized;
+}
+
+std::shared_ptr<Texture> TextureCache::find(const std::string& key) {
+    auto it = m_byPath.find(key);
+    if (it == m_byPath.end()) return nullptr;
+    std::shared_ptr<Texture> texture = it->second.texture.lock();
+    if (!texture) m_byPath.erase(it);
+    return texture;
+}
+
+std::shared_ptr<Texture> TextureCache::acquire(const std::string& path, const std::string& type) {
+    const std::string key = normalizePath(path);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (auto texture = find(key)) {
+            m_hits++;
+            return texture;
+        }
+    }
+
+    // Hash outside the lock, decoding is left to Texture::decode()
+    uint64_t contentHash = 0;
+    {
+        MappedFile file(key);
+        if (file.isOpen()) contentHash = fnv1a64(file.data(), file.size());
+    }
+    if (contentHash != 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_byContent.find(contentHash);
+        if (it != m_byContent.end()) {
+            if (auto texture = it->second.lock()) {
+                // Same image under another name
+                m_byPath[key] = Entry{texture, contentHash};
+                m_hits++;
+                return texture;
+            }
+        }
+    }
+    std::shared_ptr<Texture> texture(new Texture(), [this, key, contentHash](Texture* evicted) {
+        release(evicted, key, contentHash);
+    });
+    texture->path = key;
+    texture->type = type;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Another thread may have loaded it meanwhile, keep the first one
+    if (auto existing = find(key)) {
+        m_hits++;
+        return existing;
+    }
+    m_byPath[key] = Entry{texture, contentHash};
+    if (contentHash != 0) m_byContent[contentHash] = texture;
+    m_misses++;
+    return texture;
+}
+
+void TextureCache::evict(const Texture& texture) {
+    // The caller holds a reference, locking here can't drop the last one
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_byPath.begin(); it != m_byPath.end();) {
+        it = it->second.texture.lock().get() == &texture ? m_byPath.erase(it) : std::next(it);
+    }
+    for (auto it = m_byContent.begin(); it != m_byContent.end();) {
+        it = it->second.lock().get() == &texture ? m_byContent.erase(it) : std::next(it);
+    }
+}
+
+void TextureCache::release(Texture* texture, const std::string& key, uint64_t contentHash) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // The slots may already hold a newer texture for the same key
+        auto pathIt = m_byPath.find(key);
+        if (pathIt != m_byPath.end() && pathIt->second.texture.expired()) m_byPath.erase(pathIt);
+        auto contentIt = m_byContent.find(contentHash);
+        if (contentIt != m_byContent.end() && contentIt->second.expired()) m_byContent.erase(contentIt);
+        // The last owner may be a loader thread, the GL name is freed later on the GL thread
+        if (texture->ID != 0) m_pendingDeletes.push_back(texture->ID);
+    }
+    delete texture;
+}
+
+void TextureCache::collectGarbage() {
+    std::vector<unsigned int> ids;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ids.swap(m_pendingDeletes);
+    }
+    if (!ids.empty()) {
+        glDeleteTextures(static_cast<GLsizei>(ids.size()), ids.data());
+    }
+}
+
+TextureCacheStats TextureCache::getStats() const {
+    TextureCacheStats stats;
+    // Live references are dropped after unlocking, dropping the last one re-enters release()
+    std::vector<std::shared_ptr<Texture>> live;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        for (const auto& item : m_byPath) {
+            // Textures with a content hash are counted once through m_byContent
+            if (item.second.contentHash != 0) continue;
+            if (auto texture = item.second.texture.lock()) live.push_back(texture);
+        }
+        for (const auto& item : m_byContent) {
+            if (auto texture = item.second.lock()) live.push_back(texture);
+        }
+    }
+    stats.textures = live.size();
+    for (const auto& texture : live) {
+        stats.residentBytes += texture->gpu_bytes();
+    }
+    return stats;
+}
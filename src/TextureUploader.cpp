@@ -0,0 +1,72 @@
+#include <TextureUploader.hpp>
+#include <TextureCache.hpp>
+#include <cstring>
+
+TextureUploader::TextureUploader() {}
+
+TextureUploader::~TextureUploader() {
+    for (Slot& slot : m_slots) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        if (slot.buffer) glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+void TextureUploader::enqueue(std::shared_ptr<Texture> texture) {
+    m_queue.push_back(std::move(texture));
+}
+
+void TextureUploader::update(size_t budgetBytes) {
+    size_t sent = 0;
+    while (!m_queue.empty() && (sent == 0 || sent < budgetBytes)) {
+        Slot& slot = m_slots[m_nextSlot];
+        if (slot.fence) {
+            if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) break;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        std::shared_ptr<Texture> texture = m_queue.front();
+        m_queue.pop_front();
+        if (texture->is_uploaded()) continue;
+        // Normally decoded by the loader already, decode() returns at once then
+        const bool decoded = texture->decode();
+        if (!decoded) TextureCache::instance().evict(*texture);
+        if (!decoded || !uploadThroughSlot(slot, *texture)) {
+            texture->upload();
+            continue;
+        }
+        sent += texture->gpu_bytes();
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_nextSlot = (m_nextSlot + 1) % RING_SIZE;
+    }
+}
+
+bool TextureUploader::uploadThroughSlot(Slot& slot, Texture& texture) {
+    const size_t size = texture.pixel_bytes();
+    if (!slot.buffer) glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    if (slot.capacity < size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_DRAW);
+        slot.capacity = size;
+    }
+    // The fence guarantees the GPU is done with the old content
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+    std::memcpy(mapped, texture.pixel_data(), size);
+    const bool unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+    if (unmapped) {
+        texture.upload_from_unpack_buffer();
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return unmapped;
+}
+
+void TextureUploader::clear() {
+    m_queue.clear();
+}
+
+size_t TextureUploader::getPendingCount() const {
+    return m_queue.size();
+}
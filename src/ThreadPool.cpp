@@ -0,0 +1,196 @@
+#include <ThreadPool.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+namespace {
+    thread_local const ThreadPool* t_pool = nullptr;
+    thread_local size_t t_workerIndex = 0;
+}
+
+ThreadPool::ThreadPool() {
+    start(defaultThreadCount());
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    start(threadCount);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+unsigned int ThreadPool::defaultThreadCount() {
+    // The thread that waits on a group helps, so one worker less than cores
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+void ThreadPool::setThreadCount(unsigned int threadCount) {
+    if (threadCount == getThreadCount()) return;
+    joinWorkers();
+    // Queued tasks move to the new workers rather than running here, m_queued still counts them
+    std::deque<Task> pending;
+    for (auto& worker : m_workers) {
+        std::move(worker->tasks.begin(), worker->tasks.end(), std::back_inserter(pending));
+    }
+    start(threadCount);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        const size_t index = threadCount > 0 ? 1 + i % threadCount : 0;
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(pending[i]));
+    }
+    if (!pending.empty()) m_wakeUp.notify_all();
+}
+
+unsigned int ThreadPool::getThreadCount() const {
+    return static_cast<unsigned int>(m_threads.size());
+}
+
+void ThreadPool::start(unsigned int threadCount) {
+    m_stopping = false;
+    m_workers.clear();
+    for (unsigned int i = 0; i <= threadCount; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned int i = 1; i <= threadCount; ++i) {
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+void ThreadPool::joinWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void ThreadPool::stop() {
+    joinWorkers();
+    // Anything still queued runs on the caller so no group is left waiting
+    while (tryRunOne(0)) {}
+}
+
+void ThreadPool::run(TaskGroup& group, Task task) {
+    group.m_pending.fetch_add(1, std::memory_order_relaxed);
+    Task wrapped = [&group, task = std::move(task)]() {
+        task();
+        group.m_pending.fetch_sub(1, std::memory_order_release);
+    };
+    size_t index = currentWorker();
+    if (index == 0 && !m_threads.empty()) {
+        index = 1 + m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_threads.size();
+    }
+    // Counted before it is published, a thief's decrement can't wrap m_queued
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(wrapped));
+    }
+    m_wakeUp.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    const size_t index = currentWorker();
+    while (!group.done()) {
+        if (!tryRunOne(index)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const RangeTask& fn) {
+    if (begin >= end) return;
+    grain = std::max<size_t>(grain, 1);
+    if (m_threads.empty() || end - begin <= grain) {
+        fn(begin, end);
+        return;
+    }
+    TaskGroup group;
+    for (size_t chunk = begin; chunk < end; chunk += grain) {
+        const size_t chunkEnd = std::min(chunk + grain, end);
+        run(group, [&fn, chunk, chunkEnd]() { fn(chunk, chunkEnd); });
+    }
+    wait(group);
+}
+
+std::vector<WorkerStats> ThreadPool::getStats() const {
+    std::vector<WorkerStats> stats;
+    for (const auto& worker : m_workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        stats.push_back(worker->stats);
+    }
+    return stats;
+}
+
+void ThreadPool::resetStats() {
+    for (auto& worker : m_workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->stats = WorkerStats();
+    }
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    t_pool = this;
+    t_workerIndex = index;
+    while (true) {
+        if (tryRunOne(index)) continue;
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeUp.wait(lock, [this]() { return m_stopping || m_queued.load(std::memory_order_relaxed) > 0; });
+        if (m_stopping) break;
+    }
+    t_pool = nullptr;
+}
+
+bool ThreadPool::tryRunOne(size_t index) {
+    Task task;
+    bool stolen = false;
+    if (!popLocal(index, task)) {
+        if (!steal(index, task)) return false;
+        stolen = true;
+    }
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    task();
+    auto end = std::chrono::steady_clock::now();
+    Worker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.stats.tasks++;
+    worker.stats.steals += stolen ? 1 : 0;
+    worker.stats.busyMs += std::chrono::duration<double, std::milli>(end - start).count();
+    return true;
+}
+
+bool ThreadPool::popLocal(size_t index, Task& task) {
+    Worker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t index, Task& task) {
+    const size_t count = m_workers.size();
+    for (size_t offset = 1; offset < count; ++offset) {
+        Worker& victim = *m_workers[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+size_t ThreadPool::currentWorker() const {
+    return t_pool == this ? t_workerIndex : 0;
+}
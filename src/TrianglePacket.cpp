@@ -0,0 +1,159 @@
+#include <TrianglePacket.hpp>
+#include <Simd.hpp>
+#include <cmath>
+
+namespace {
+    constexpr float EPSILON = 1e-8f;
+
+    // Keeps the closest of the lanes flagged in mask
+    bool selectClosest(const TrianglePacket& packet, int mask, const float* t, const float* u, const float* v, RayHit& hit) {
+        bool updated = false;
+        for (int lane = 0; lane < TrianglePacket::WIDTH; ++lane) {
+            if ((mask & (1 << lane)) && t[lane] < hit.t) {
+                hit.t = t[lane];
+                hit.u = u[lane];
+                hit.v = v[lane];
+                hit.triangle = packet.ids[lane];
+                updated = true;
+            }
+        }
+        return updated;
+    }
+}
+
+TrianglePacket::TrianglePacket() {
+    for (int lane = 0; lane < WIDTH; ++lane) {
+        clear(lane);
+    }
+}
+
+void TrianglePacket::set(int lane, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, uint32_t id) {
+    const glm::vec3 edge1 = p1 - p0;
+    const glm::vec3 edge2 = p2 - p0;
+    const glm::vec3 normal = glm::cross(edge1, edge2);
+    for (int c = 0; c < 3; ++c) {
+        v0[c][lane] = p0[c];
+        e1[c][lane] = edge1[c];
+        e2[c][lane] = edge2[c];
+        n[c][lane] = normal[c];
+    }
+    ids[lane] = id;
+}
+
+void TrianglePacket::clear(int lane) {
+    for (int c = 0; c < 3; ++c) {
+        v0[c][lane] = e1[c][lane] = e2[c][lane] = n[c][lane] = 0.0f;
+    }
+    ids[lane] = INVALID_ID;
+}
+
+// Möller–Trumbore rewritten around the precomputed normal n = e1 x e2:
+// det = -d.n, q = s x d, u = e2.q / det, v = -e1.q / det, t = s.n / det
+// with s = o - v0, which needs a single cross product per triangle.
+bool intersectTrianglePacket(const TrianglePacket& packet, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) {
+    alignas(32) float t[TrianglePacket::WIDTH];
+    alignas(32) float u[TrianglePacket::WIDTH];
+    alignas(32) float v[TrianglePacket::WIDTH];
+    int mask = 0;
+#if defined(KELVINLET_KERNEL_AVX2)
+    const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    const __m256 dx = _mm256_set1_ps(direction.x), dy = _mm256_set1_ps(direction.y), dz = _mm256_set1_ps(direction.z);
+    const __m256 nx = _mm256_load_ps(packet.n[0]), ny = _mm256_load_ps(packet.n[1]), nz = _mm256_load_ps(packet.n[2]);
+    const __m256 det = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_fmadd_ps(dz, nz, _mm256_fmadd_ps(dy, ny, _mm256_mul_ps(dx, nx))));
+    const __m256 sx = _mm256_sub_ps(ox, _mm256_load_ps(packet.v0[0]));
+    const __m256 sy = _mm256_sub_ps(oy, _mm256_load_ps(packet.v0[1]));
+    const __m256 sz = _mm256_sub_ps(oz, _mm256_load_ps(packet.v0[2]));
+    const __m256 qx = _mm256_fmsub_ps(sy, dz, _mm256_mul_ps(sz, dy));
+    const __m256 qy = _mm256_fmsub_ps(sz, dx, _mm256_mul_ps(sx, dz));
+    const __m256 qz = _mm256_fmsub_ps(sx, dy, _mm256_mul_ps(sy, dx));
+    const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+    const __m256 uu = _mm256_fmadd_ps(_mm256_load_ps(packet.e2[2]), qz, _mm256_fmadd_ps(_mm256_load_ps(packet.e2[1]), qy, _mm256_mul_ps(_mm256_load_ps(packet.e2[0]), qx)));
+    const __m256 vv = _mm256_fmadd_ps(_mm256_load_ps(packet.e1[2]), qz, _mm256_fmadd_ps(_mm256_load_ps(packet.e1[1]), qy, _mm256_mul_ps(_mm256_load_ps(packet.e1[0]), qx)));
+    const __m256 tt = _mm256_fmadd_ps(sz, nz, _mm256_fmadd_ps(sy, ny, _mm256_mul_ps(sx, nx)));
+    const __m256 uL = _mm256_mul_ps(uu, invDet);
+    const __m256 vL = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(vv, invDet));
+    const __m256 tL = _mm256_mul_ps(tt, invDet);
+    const __m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+    __m256 valid = _mm256_cmp_ps(absDet, _mm256_set1_ps(EPSILON), _CMP_GE_OQ);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(uL, _mm256_setzero_ps(), _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(vL, _mm256_setzero_ps(), _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(uL, vL), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(tL, _mm256_set1_ps(EPSILON), _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(tL, _mm256_set1_ps(hit.t), _CMP_LT_OQ));
+    mask = _mm256_movemask_ps(valid);
+    if (!mask) return false;
+    _mm256_store_ps(t, tL);
+    _mm256_store_ps(u, uL);
+    _mm256_store_ps(v, vL);
+#elif defined(KELVINLET_KERNEL_SSE)
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 eps = _mm_set1_ps(EPSILON);
+    const __m128 tMax = _mm_set1_ps(hit.t);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (int half = 0; half < TrianglePacket::WIDTH; half += 4) {
+        const __m128 nx = _mm_load_ps(packet.n[0] + half), ny = _mm_load_ps(packet.n[1] + half), nz = _mm_load_ps(packet.n[2] + half);
+        const __m128 det = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz)));
+        const __m128 sx = _mm_sub_ps(ox, _mm_load_ps(packet.v0[0] + half));
+        const __m128 sy = _mm_sub_ps(oy, _mm_load_ps(packet.v0[1] + half));
+        const __m128 sz = _mm_sub_ps(oz, _mm_load_ps(packet.v0[2] + half));
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, dz), _mm_mul_ps(sz, dy));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, dx), _mm_mul_ps(sx, dz));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, dy), _mm_mul_ps(sy, dx));
+        const __m128 invDet = _mm_div_ps(one, det);
+        const __m128 uu = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(packet.e2[0] + half), qx), _mm_mul_ps(_mm_load_ps(packet.e2[1] + half), qy)), _mm_mul_ps(_mm_load_ps(packet.e2[2] + half), qz));
+        const __m128 vv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(packet.e1[0] + half), qx), _mm_mul_ps(_mm_load_ps(packet.e1[1] + half), qy)), _mm_mul_ps(_mm_load_ps(packet.e1[2] + half), qz));
+        const __m128 tt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, nx), _mm_mul_ps(sy, ny)), _mm_mul_ps(sz, nz));
+        const __m128 uL = _mm_mul_ps(uu, invDet);
+        const __m128 vL = _mm_sub_ps(zero, _mm_mul_ps(vv, invDet));
+        const __m128 tL = _mm_mul_ps(tt, invDet);
+        __m128 valid = _mm_cmpge_ps(_mm_andnot_ps(signMask, det), eps);
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(uL, zero));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(vL, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uL, vL), one));
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(tL, eps));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(tL, tMax));
+        mask |= _mm_movemask_ps(valid) << half;
+        _mm_store_ps(t + half, tL);
+        _mm_store_ps(u + half, uL);
+        _mm_store_ps(v + half, vL);
+    }
+    if (!mask) return false;
+#else
+    for (int lane = 0; lane < TrianglePacket::WIDTH; ++lane) {
+        const glm::vec3 normal(packet.n[0][lane], packet.n[1][lane], packet.n[2][lane]);
+        const float det = -glm::dot(direction, normal);
+        if (std::fabs(det) < EPSILON) continue;
+        const glm::vec3 s = origin - glm::vec3(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+        const glm::vec3 q = glm::cross(s, direction);
+        const float invDet = 1.0f / det;
+        u[lane] = glm::dot(glm::vec3(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]), q) * invDet;
+        v[lane] = -glm::dot(glm::vec3(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]), q) * invDet;
+        t[lane] = glm::dot(s, normal) * invDet;
+        if (u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f && t[lane] > EPSILON && t[lane] < hit.t) {
+            mask |= 1 << lane;
+        }
+    }
+    if (!mask) return false;
+#endif
+    return selectClosest(packet, mask, t, u, v, hit);
+}
+
+bool intersectTrianglePackets(const std::vector<TrianglePacket>& packets, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) {
+    bool found = false;
+    for (const TrianglePacket& packet : packets) {
+        found |= intersectTrianglePacket(packet, origin, direction, hit);
+    }
+    return found;
+}
+
+std::vector<TrianglePacket> buildTrianglePackets(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    const size_t triangleCount = indices.size() / 3;
+    std::vector<TrianglePacket> packets((triangleCount + TrianglePacket::WIDTH - 1) / TrianglePacket::WIDTH);
+    for (size_t i = 0; i < triangleCount; ++i) {
+        packets[i / TrianglePacket::WIDTH].set(i % TrianglePacket::WIDTH, positions[indices[3 * i]], positions[indices[3 * i + 1]], positions[indices[3 * i + 2]], static_cast<uint32_t>(i));
+    }
+    return packets;
+}
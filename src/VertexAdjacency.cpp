@@ -0,0 +1,214 @@
+#include <VertexAdjacency.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Vertices per task of recomputeFrames()
+    constexpr size_t FRAME_GRAIN = 1024;
+
+    // Any unit vector orthogonal to n
+    glm::vec3 orthogonal(const glm::vec3& n) {
+        const glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::normalize(glm::cross(n, axis));
+    }
+
+    void recomputeFrame(const VertexAdjacency& adjacency, const std::vector<unsigned int>& indices, const PositionsSoA& positions, const std::vector<glm::vec2>& uvs, uint32_t v, const FramesSoA& rest, FramesSoA& frames) {
+        glm::vec3 normal(0.0f);
+        glm::vec3 tangent(0.0f);
+        glm::vec3 bitangent(0.0f);
+        for (const uint32_t* t = adjacency.trianglesBegin(v); t != adjacency.trianglesEnd(v); ++t) {
+            const unsigned int* corners = &indices[3 * *t];
+            const glm::vec3 p0 = positions.get(corners[0]);
+            const glm::vec3 e1 = positions.get(corners[1]) - p0;
+            const glm::vec3 e2 = positions.get(corners[2]) - p0;
+            // Twice the area along the face normal
+            const glm::vec3 faceNormal = glm::cross(e1, e2);
+            normal += faceNormal;
+            // Welded duplicates share the normal, tangents only follow the uvs of v
+            if (uvs.empty() || (corners[0] != v && corners[1] != v && corners[2] != v)) continue;
+            const glm::vec2 d1 = uvs[corners[1]] - uvs[corners[0]];
+            const glm::vec2 d2 = uvs[corners[2]] - uvs[corners[0]];
+            const float determinant = d1.x * d2.y - d2.x * d1.y;
+            if (std::fabs(determinant) < 1e-12f) continue;
+            // Unit uv gradients weighted by the area, like the normals
+            const float area = glm::length(faceNormal);
+            const glm::vec3 faceTangent = (e1 * d2.y - e2 * d1.y) / determinant;
+            const glm::vec3 faceBitangent = (e2 * d1.x - e1 * d2.x) / determinant;
+            const float tangentLength = glm::length(faceTangent);
+            const float bitangentLength = glm::length(faceBitangent);
+            if (tangentLength > 0.0f) tangent += faceTangent * (area / tangentLength);
+            if (bitangentLength > 0.0f) bitangent += faceBitangent * (area / bitangentLength);
+        }
+        const float normalLength = glm::length(normal);
+        // Isolated or degenerate vertices take their rest frame
+        if (normalLength <= 0.0f) {
+            frames.normal.set(v, rest.normal.get(v));
+            frames.tangent.set(v, rest.tangent.get(v));
+            frames.bitangent.set(v, rest.bitangent.get(v));
+            return;
+        }
+        normal /= normalLength;
+        // Gram-Schmidt against the new normal, the uv bitangent only picks the handedness
+        tangent -= normal * glm::dot(normal, tangent);
+        const float tangentLength = glm::length(tangent);
+        if (tangentLength > 1e-12f) {
+            tangent /= tangentLength;
+        }
+        else {
+            tangent = rest.tangent.get(v) - normal * glm::dot(normal, rest.tangent.get(v));
+            tangent = glm::length(tangent) > 1e-6f ? glm::normalize(tangent) : orthogonal(normal);
+        }
+        if (uvs.empty() || glm::dot(bitangent, bitangent) == 0.0f) bitangent = rest.bitangent.get(v);
+        const float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+        frames.normal.set(v, normal);
+        frames.tangent.set(v, tangent);
+        frames.bitangent.set(v, glm::cross(normal, tangent) * handedness);
+    }
+}
+
+VertexAdjacency::VertexAdjacency() {}
+
+VertexAdjacency::VertexAdjacency(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions) {
+    build(indices, positions);
+}
+
+void VertexAdjacency::weld(const std::vector<glm::vec3>& positions) {
+    const size_t vertexCount = positions.size();
+    // Equal positions end up next to each other, lowest vertex first
+    std::vector<uint32_t> order(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) order[v] = static_cast<uint32_t>(v);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const glm::vec3& p = positions[a];
+        const glm::vec3& q = positions[b];
+        if (p.x != q.x) return p.x < q.x;
+        if (p.y != q.y) return p.y < q.y;
+        if (p.z != q.z) return p.z < q.z;
+        return a < b;
+    });
+    std::vector<uint32_t> first(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const bool same = i > 0 && positions[order[i]] == positions[order[i - 1]];
+        first[order[i]] = same ? first[order[i - 1]] : order[i];
+    }
+    // Groups are numbered in the order of their lowest vertex
+    m_groups.resize(vertexCount);
+    uint32_t groupCount = 0;
+    for (size_t v = 0; v < vertexCount; ++v) {
+        m_groups[v] = first[v] == v ? groupCount++ : m_groups[first[v]];
+    }
+    m_memberOffsets.assign(groupCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) m_memberOffsets[m_groups[v] + 1]++;
+    for (uint32_t g = 0; g < groupCount; ++g) m_memberOffsets[g + 1] += m_memberOffsets[g];
+    m_members.resize(vertexCount);
+    std::vector<uint32_t> next(m_memberOffsets.begin(), m_memberOffsets.end() - 1);
+    for (size_t v = 0; v < vertexCount; ++v) m_members[next[m_groups[v]]++] = static_cast<uint32_t>(v);
+}
+
+void VertexAdjacency::build(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions) {
+    const size_t vertexCount = positions.size();
+    weld(positions);
+    const size_t groupCount = m_memberOffsets.size() - 1;
+    const size_t triangles = indices.size() / 3;
+    // Triangles with a corner out of range are left out
+    auto valid = [&](size_t t) {
+        return indices[3 * t] < vertexCount && indices[3 * t + 1] < vertexCount && indices[3 * t + 2] < vertexCount;
+    };
+    // Counting sort of the corners by welded position, triangles stay in increasing order
+    m_offsets.assign(groupCount + 1, 0);
+    for (size_t t = 0; t < triangles; ++t) {
+        if (!valid(t)) continue;
+        for (int corner = 0; corner < 3; ++corner) m_offsets[m_groups[indices[3 * t + corner]] + 1]++;
+    }
+    for (size_t g = 0; g < groupCount; ++g) {
+        m_offsets[g + 1] += m_offsets[g];
+    }
+    m_triangles.resize(m_offsets[groupCount]);
+    std::vector<uint32_t> next(m_offsets.begin(), m_offsets.end() - 1);
+    for (size_t t = 0; t < triangles; ++t) {
+        if (!valid(t)) continue;
+        const uint32_t groups[3] = {m_groups[indices[3 * t]], m_groups[indices[3 * t + 1]], m_groups[indices[3 * t + 2]]};
+        for (int corner = 0; corner < 3; ++corner) {
+            const uint32_t g = groups[corner];
+            // A degenerate triangle lists its repeated position once
+            if (corner > 0 && groups[0] == g) continue;
+            if (corner > 1 && groups[1] == g) continue;
+            m_triangles[next[g]++] = static_cast<uint32_t>(t);
+        }
+    }
+    // Repeated corners left slots unused at the end of their group
+    size_t write = 0;
+    for (size_t g = 0; g < groupCount; ++g) {
+        const uint32_t begin = m_offsets[g];
+        m_offsets[g] = static_cast<uint32_t>(write);
+        for (uint32_t i = begin; i < next[g]; ++i) {
+            m_triangles[write++] = m_triangles[i];
+        }
+    }
+    m_offsets[groupCount] = static_cast<uint32_t>(write);
+    m_triangles.resize(write);
+    m_visited.assign(groupCount, 0);
+    m_generation = 0;
+}
+
+void VertexAdjacency::oneRing(const std::vector<unsigned int>& indices, const uint32_t* vertices, size_t count, std::vector<uint32_t>& out) {
+    if (++m_generation == 0) {
+        std::fill(m_visited.begin(), m_visited.end(), 0);
+        m_generation = 1;
+    }
+    const size_t first = out.size();
+    // Every vertex at a reached position is listed
+    auto visit = [&](uint32_t g) {
+        if (m_visited[g] == m_generation) return;
+        m_visited[g] = m_generation;
+        out.insert(out.end(), m_members.begin() + m_memberOffsets[g], m_members.begin() + m_memberOffsets[g + 1]);
+    };
+    for (size_t n = 0; n < count; ++n) {
+        const uint32_t v = vertices[n];
+        if (v >= vertexCount()) continue;
+        const uint32_t g = m_groups[v];
+        visit(g);
+        for (uint32_t i = m_offsets[g]; i < m_offsets[g + 1]; ++i) {
+            const uint32_t t = m_triangles[i];
+            for (int corner = 0; corner < 3; ++corner) {
+                visit(m_groups[indices[3 * t + corner]]);
+            }
+        }
+    }
+    std::sort(out.begin() + first, out.end());
+}
+
+size_t VertexAdjacency::vertexCount() const {
+    return m_groups.size();
+}
+
+size_t VertexAdjacency::positionCount() const {
+    return m_memberOffsets.empty() ? 0 : m_memberOffsets.size() - 1;
+}
+
+size_t VertexAdjacency::triangleCount() const {
+    return m_triangles.size();
+}
+
+const uint32_t* VertexAdjacency::trianglesBegin(uint32_t vertex) const {
+    return m_triangles.data() + m_offsets[m_groups[vertex]];
+}
+
+const uint32_t* VertexAdjacency::trianglesEnd(uint32_t vertex) const {
+    return m_triangles.data() + m_offsets[m_groups[vertex] + 1];
+}
+
+void recomputeFrames(const VertexAdjacency& adjacency, const std::vector<unsigned int>& indices, const PositionsSoA& positions, const std::vector<glm::vec2>& uvs, const uint32_t* vertices, size_t count, const FramesSoA& rest, FramesSoA& frames, ThreadPool& pool) {
+    pool.parallelFor(0, count, FRAME_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t n = begin; n < end; ++n) {
+            recomputeFrame(adjacency, indices, positions, uvs, vertices[n], rest, frames);
+        }
+    });
+}
+
+void recomputeFrames(const VertexAdjacency& adjacency, const std::vector<unsigned int>& indices, const PositionsSoA& positions, const std::vector<glm::vec2>& uvs, const FramesSoA& rest, FramesSoA& frames, ThreadPool& pool) {
+    pool.parallelFor(0, adjacency.vertexCount(), FRAME_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            recomputeFrame(adjacency, indices, positions, uvs, static_cast<uint32_t>(v), rest, frames);
+        }
+    });
+}
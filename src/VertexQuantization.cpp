@@ -0,0 +1,98 @@
+#include <VertexQuantization.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr float SNORM16_MAX = 32767.0f;
+    // Smallest |w| that survives quantization, keeps the handedness sign readable
+    constexpr float MIN_W = 1.0f / SNORM16_MAX;
+
+    int16_t toSnorm16(float value) {
+        return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * SNORM16_MAX));
+    }
+
+    float fromSnorm16(int16_t value) {
+        return std::max(value / SNORM16_MAX, -1.0f);
+    }
+
+    float angleDegrees(const glm::vec3& a, const glm::vec3& b) {
+        // atan2 stays accurate for the tiny angles acos rounds away
+        return glm::degrees(std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+    }
+
+    // Orthonormal frame from the imported attributes, returns the handedness
+    float orthonormalize(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent, glm::vec3& n, glm::vec3& t) {
+        n = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+        t = tangent - n * glm::dot(n, tangent);
+        if (glm::dot(t, t) < 1e-12f) {
+            // No usable tangent, any direction orthogonal to the normal will do
+            t = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            t = t - n * glm::dot(n, t);
+        }
+        t = glm::normalize(t);
+        return glm::dot(glm::cross(n, t), bitangent) < 0.0f ? -1.0f : 1.0f;
+    }
+}
+
+void QuantizationError::grow(const QuantizationError& other) {
+    normal = std::max(normal, other.normal);
+    tangent = std::max(tangent, other.tangent);
+    bitangent = std::max(bitangent, other.bitangent);
+    uv = std::max(uv, other.uv);
+}
+
+PackedAttributes packAttributes(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent, const glm::vec2& uv) {
+    glm::vec3 n, t;
+    const float handedness = orthonormalize(normal, tangent, bitangent, n, t);
+    glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, glm::cross(n, t), n)));
+    if (q.w < 0.0f) q = -q;
+    if (q.w < MIN_W) {
+        // Rescale xyz so the quaternion stays unit length with the biased w
+        const float scale = std::sqrt(1.0f - MIN_W * MIN_W) / glm::length(glm::vec3(q.x, q.y, q.z));
+        q = glm::quat(MIN_W, q.x * scale, q.y * scale, q.z * scale);
+    }
+    if (handedness < 0.0f) q = -q;
+
+    PackedAttributes packed;
+    packed.tangent_frame[0] = toSnorm16(q.x);
+    packed.tangent_frame[1] = toSnorm16(q.y);
+    packed.tangent_frame[2] = toSnorm16(q.z);
+    packed.tangent_frame[3] = toSnorm16(q.w);
+    packed.uv[0] = glm::packHalf1x16(uv.x);
+    packed.uv[1] = glm::packHalf1x16(uv.y);
+    return packed;
+}
+
+void unpackAttributes(const PackedAttributes& packed, glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent, glm::vec2& uv) {
+    glm::quat q(fromSnorm16(packed.tangent_frame[3]), fromSnorm16(packed.tangent_frame[0]), fromSnorm16(packed.tangent_frame[1]), fromSnorm16(packed.tangent_frame[2]));
+    const float handedness = q.w < 0.0f ? -1.0f : 1.0f;
+    q = glm::normalize(q);
+    normal = q * glm::vec3(0.0f, 0.0f, 1.0f);
+    tangent = q * glm::vec3(1.0f, 0.0f, 0.0f);
+    bitangent = glm::cross(normal, tangent) * handedness;
+    uv = glm::vec2(glm::unpackHalf1x16(packed.uv[0]), glm::unpackHalf1x16(packed.uv[1]));
+}
+
+std::vector<PackedAttributes> packAttributes(const std::vector<glm::vec3>& normals, const std::vector<glm::vec3>& tangents, const std::vector<glm::vec3>& bitangents, const std::vector<glm::vec2>& uvs, QuantizationError& error) {
+    std::vector<PackedAttributes> packed(normals.size());
+    for (size_t i = 0; i < normals.size(); ++i) {
+        packed[i] = packAttributes(normals[i], tangents[i], bitangents[i], uvs[i]);
+
+        // Measured against the orthonormalized frame, which is what gets encoded
+        glm::vec3 n, t;
+        const float handedness = orthonormalize(normals[i], tangents[i], bitangents[i], n, t);
+        glm::vec3 decodedNormal, decodedTangent, decodedBitangent;
+        glm::vec2 decodedUV;
+        unpackAttributes(packed[i], decodedNormal, decodedTangent, decodedBitangent, decodedUV);
+        QuantizationError vertexError;
+        vertexError.normal = angleDegrees(n, decodedNormal);
+        vertexError.tangent = angleDegrees(t, decodedTangent);
+        vertexError.bitangent = angleDegrees(glm::cross(n, t) * handedness, decodedBitangent);
+        const glm::vec2 uvError = glm::abs(uvs[i] - decodedUV);
+        vertexError.uv = std::max(uvError.x, uvError.y);
+        error.grow(vertexError);
+    }
+    return packed;
+}